@@ -0,0 +1,126 @@
+#include "src/compositor.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define COMPOSITOR_AVX2
+#endif
+
+void Compositor::composite_line(const CompositorLine & line, Word * output) {
+#if defined(COMPOSITOR_AVX2)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+#else
+    static const bool has_avx2 = false;
+#endif
+
+    int x = has_avx2 ? composite_line_avx2(line, output) : composite_line_sse2(line, output);
+    composite_line_scalar(line, output, x);
+}
+
+void Compositor::composite_line_scalar(const CompositorLine & line, Word * output, int start_x) {
+    for (int x = start_x; x < line.width; x++) {
+        HalfWord color = line.backdrop[x];
+        Byte mask = line.layer_masks[x];
+        Byte priority = 4; // Behind every layer
+
+        for (int i = 0; i < COMPOSITOR_LAYERS; i++) {
+            HalfWord layer_color = line.layers[i][x];
+            Byte layer_priority = line.priorities[i][x];
+            if (layer_color != COMPOSITOR_TRANSPARENT && (mask & line.layer_bits[i]) && layer_priority < priority) {
+                color = layer_color;
+                priority = layer_priority;
+            }
+        }
+
+        output[x] = to_argb(color);
+    }
+}
+
+// Layers are blended bottom up, each taking the pixels where it is at the
+// same or a lower priority than what is there, so ties go to the earlier
+// layer as in the scalar version. Returns where it stopped.
+#if defined(__SSE2__)
+static inline __m128i argb_sse2(__m128i colors) {
+    __m128i red = _mm_slli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0x001F)), 19);
+    __m128i green = _mm_slli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0x03E0)), 6);
+    __m128i blue = _mm_srli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0x7C00)), 7);
+    return _mm_or_si128(_mm_or_si128(red, green), _mm_or_si128(blue, _mm_set1_epi32(0xFF000000)));
+}
+
+int Compositor::composite_line_sse2(const CompositorLine & line, Word * output) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i transparent = _mm_set1_epi16((short)COMPOSITOR_TRANSPARENT);
+
+    int x = 0;
+    for (; x + 8 <= line.width; x += 8) {
+        __m128i color = _mm_loadu_si128((const __m128i *)&line.backdrop[x]);
+        __m128i masks = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&line.layer_masks[x]), zero);
+        __m128i priority = _mm_set1_epi16(4);
+
+        for (int i = COMPOSITOR_LAYERS - 1; i >= 0; i--) {
+            __m128i layer_color = _mm_loadu_si128((const __m128i *)&line.layers[i][x]);
+            __m128i layer_priority = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&line.priorities[i][x]), zero);
+            __m128i bit = _mm_set1_epi16(line.layer_bits[i]);
+            __m128i allowed = _mm_cmpeq_epi16(_mm_and_si128(masks, bit), bit);
+            allowed = _mm_andnot_si128(_mm_cmpgt_epi16(layer_priority, priority), allowed);
+            __m128i take = _mm_andnot_si128(_mm_cmpeq_epi16(layer_color, transparent), allowed);
+            color = _mm_or_si128(_mm_and_si128(take, layer_color), _mm_andnot_si128(take, color));
+            priority = _mm_or_si128(_mm_and_si128(take, layer_priority), _mm_andnot_si128(take, priority));
+        }
+
+        _mm_storeu_si128((__m128i *)&output[x], argb_sse2(_mm_unpacklo_epi16(color, zero)));
+        _mm_storeu_si128((__m128i *)&output[x + 4], argb_sse2(_mm_unpackhi_epi16(color, zero)));
+    }
+    return x;
+}
+#else
+int Compositor::composite_line_sse2(const CompositorLine & line, Word * output) {
+    return 0;
+}
+#endif
+
+#if defined(COMPOSITOR_AVX2)
+__attribute__((target("avx2")))
+static inline __m256i argb_avx2(__m256i colors) {
+    __m256i red = _mm256_slli_epi32(_mm256_and_si256(colors, _mm256_set1_epi32(0x001F)), 19);
+    __m256i green = _mm256_slli_epi32(_mm256_and_si256(colors, _mm256_set1_epi32(0x03E0)), 6);
+    __m256i blue = _mm256_srli_epi32(_mm256_and_si256(colors, _mm256_set1_epi32(0x7C00)), 7);
+    return _mm256_or_si256(_mm256_or_si256(red, green), _mm256_or_si256(blue, _mm256_set1_epi32(0xFF000000)));
+}
+
+__attribute__((target("avx2")))
+int Compositor::composite_line_avx2(const CompositorLine & line, Word * output) {
+    const __m256i transparent = _mm256_set1_epi16((short)COMPOSITOR_TRANSPARENT);
+
+    int x = 0;
+    for (; x + 16 <= line.width; x += 16) {
+        __m256i color = _mm256_loadu_si256((const __m256i *)&line.backdrop[x]);
+        __m256i masks = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)&line.layer_masks[x]));
+        __m256i priority = _mm256_set1_epi16(4);
+
+        for (int i = COMPOSITOR_LAYERS - 1; i >= 0; i--) {
+            __m256i layer_color = _mm256_loadu_si256((const __m256i *)&line.layers[i][x]);
+            __m256i layer_priority = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)&line.priorities[i][x]));
+            __m256i bit = _mm256_set1_epi16(line.layer_bits[i]);
+            __m256i allowed = _mm256_cmpeq_epi16(_mm256_and_si256(masks, bit), bit);
+            allowed = _mm256_andnot_si256(_mm256_cmpgt_epi16(layer_priority, priority), allowed);
+            __m256i take = _mm256_andnot_si256(_mm256_cmpeq_epi16(layer_color, transparent), allowed);
+            color = _mm256_blendv_epi8(color, layer_color, take);
+            priority = _mm256_blendv_epi8(priority, layer_priority, take);
+        }
+
+        __m256i low = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(color));
+        __m256i high = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(color, 1));
+        _mm256_storeu_si256((__m256i *)&output[x], argb_avx2(low));
+        _mm256_storeu_si256((__m256i *)&output[x + 8], argb_avx2(high));
+    }
+    return x;
+}
+#else
+int Compositor::composite_line_avx2(const CompositorLine & line, Word * output) {
+    return 0;
+}
+#endif
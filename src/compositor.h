@@ -0,0 +1,36 @@
+#ifndef COMPOSITOR_INCLUDED
+#define COMPOSITOR_INCLUDED
+
+#include "src/cpu/cpu_types.h"
+
+#define COMPOSITOR_LAYERS 5
+#define COMPOSITOR_TRANSPARENT 0xFFFF
+
+// One scanline of layers to composite. Each pixel shows the layer with the
+// lowest priority there out of those that are opaque and have their bit
+// set in the pixel's layer mask, or the backdrop when none does. Layers of
+// the same priority go in the order given.
+typedef struct CompositorLine {
+    const HalfWord * layers[COMPOSITOR_LAYERS]; // Topmost first
+    const Byte * priorities[COMPOSITOR_LAYERS]; // 0-3 per pixel
+    Byte layer_bits[COMPOSITOR_LAYERS]; // A single bit each
+    const HalfWord * backdrop;
+    const Byte * layer_masks;
+    int width;
+} CompositorLine;
+
+// Writes the line out as ARGB8888. The SIMD versions give the same output
+// as the scalar one, the best one the CPU has is picked once.
+typedef struct Compositor {
+    static void composite_line(const CompositorLine & line, Word * output);
+
+    static void composite_line_scalar(const CompositorLine & line, Word * output, int start_x);
+    static int composite_line_sse2(const CompositorLine & line, Word * output);
+    static int composite_line_avx2(const CompositorLine & line, Word * output);
+
+    static Word to_argb(HalfWord color) {
+        return 0xFF000000 | ((color & 0x001F) << 19) | ((color & 0x03E0) << 6) | ((color & 0x7C00) >> 7);
+    }
+} Compositor;
+
+#endif
@@ -4,10 +4,12 @@
 #include "src/cpu/cpu.h"
 #include "src/cpu/irq_manager.h"
 #include "src/memory.h"
+#include "src/dma.h"
 
 typedef struct Context {
     ARM7TDMI * cpu;
     Memory * memory;
+    Dma * dma;
 } Context;
 
 #endif
\ No newline at end of file
@@ -4,19 +4,108 @@
 #include <stdint.h>
 #include "cpu_types.h"
 
+typedef struct AluResult {
+    Word value;
+    bool carry;
+    bool overflow;
+} AluResult;
+
+typedef struct ShiftResult {
+    Word value;
+    bool carry;
+} ShiftResult;
+
+// Fixed arity ALU and barrel shifter kernels. Every kernel returns the
+// carry (and overflow) out alongside the result, so nothing is kept between calls.
 typedef struct ArithmaticLogicUnit {
-    bool carry_flag;
+    // op1 + op2 + carry_in
+    static AluResult add(Word op1, Word op2, bool carry_in = false) {
+        AluResult result;
+        Word partial;
+        int32_t signed_partial;
+        int32_t signed_result;
+
+        bool carry_1 = __builtin_add_overflow(op1, op2, &partial);
+        bool carry_2 = __builtin_add_overflow(partial, (Word)carry_in, &result.value);
+        bool overflow_1 = __builtin_add_overflow((int32_t)op1, (int32_t)op2, &signed_partial);
+        bool overflow_2 = __builtin_add_overflow(signed_partial, (int32_t)carry_in, &signed_result);
+
+        result.carry = carry_1 | carry_2;
+        result.overflow = overflow_1 ^ overflow_2;
+        return result;
+    }
+
+    // op1 - op2 - !carry_in, carry out is NOT borrow
+    static AluResult subtract(Word op1, Word op2, bool carry_in = true) {
+        AluResult result;
+        Word partial;
+        int32_t signed_partial;
+        int32_t signed_result;
+
+        bool borrow_1 = __builtin_sub_overflow(op1, op2, &partial);
+        bool borrow_2 = __builtin_sub_overflow(partial, (Word)!carry_in, &result.value);
+        bool overflow_1 = __builtin_sub_overflow((int32_t)op1, (int32_t)op2, &signed_partial);
+        bool overflow_2 = __builtin_sub_overflow(signed_partial, (int32_t)!carry_in, &signed_result);
+
+        result.carry = !(borrow_1 | borrow_2);
+        result.overflow = overflow_1 ^ overflow_2;
+        return result;
+    }
+
+    static AluResult add_with_carry(Word op1, Word op2, bool c_flag) { return add(op1, op2, c_flag); }
+    static AluResult subtract_with_carry(Word op1, Word op2, bool c_flag) { return subtract(op1, op2, c_flag); }
+    static AluResult reverse_subtract(Word op1, Word op2) { return subtract(op2, op1); }
+    static AluResult reverse_subtract_with_carry(Word op1, Word op2, bool c_flag) { return subtract(op2, op1, c_flag); }
+
+    // Shifts by a register amount: 0 passes the value and carry through unchanged,
+    // amounts of 32 and over follow the ARM7TDMI rules.
+    static ShiftResult logical_left_shift(Word number, unsigned int shift_amount, bool c_flag) {
+        if (shift_amount == 0) {
+            return {number, c_flag};
+        } else if (shift_amount < 32) {
+            return {number << shift_amount, (bool)((number >> (32 - shift_amount)) & 1)};
+        } else if (shift_amount == 32) {
+            return {0, (bool)(number & 1)};
+        }
+        return {0, false};
+    }
+
+    static ShiftResult logical_right_shift(Word number, unsigned int shift_amount, bool c_flag) {
+        if (shift_amount == 0) {
+            return {number, c_flag};
+        } else if (shift_amount < 32) {
+            return {number >> shift_amount, (bool)((number >> (shift_amount - 1)) & 1)};
+        } else if (shift_amount == 32) {
+            return {0, (bool)(number >> 31)};
+        }
+        return {0, false};
+    }
 
-    Word add(int total_addends, ...);
-    Word subtract(int total_subtrahends, Word base, ...);
+    static ShiftResult arithmetic_right_shift(Word number, unsigned int shift_amount, bool c_flag) {
+        if (shift_amount == 0) {
+            return {number, c_flag};
+        } else if (shift_amount < 32) {
+            return {(Word)((int32_t)number >> shift_amount), (bool)((number >> (shift_amount - 1)) & 1)};
+        }
+        bool bit_31 = number >> 31;
+        return {bit_31 ? UINT32_MAX : 0, bit_31};
+    }
 
-    Word logical_right_shift(Word number, unsigned int shift_amount);
-    Word logical_left_shift(Word number, unsigned int shift_amount);
-    int32_t arithmetic_right_shift(int32_t number, unsigned int shift_amount);
-    Word rotate_right(Word number, unsigned int rotate_amount);
+    static ShiftResult rotate_right(Word number, unsigned int rotate_amount, bool c_flag) {
+        if (rotate_amount == 0) {
+            return {number, c_flag};
+        }
+        rotate_amount &= 31;
+        if (rotate_amount == 0) {
+            return {number, (bool)(number >> 31)};
+        }
+        return {(number >> rotate_amount) | (number << (32 - rotate_amount)), (bool)((number >> (rotate_amount - 1)) & 1)};
+    }
 
-    Word rotate_right_extended(Word number, bool cpsr_c);
+    static ShiftResult rotate_right_extended(Word number, bool c_flag) {
+        return {(number >> 1) | ((Word)c_flag << 31), (bool)(number & 1)};
+    }
 } CpuALU;
 
 
-#endif
\ No newline at end of file
+#endif
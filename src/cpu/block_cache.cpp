@@ -0,0 +1,251 @@
+#include "src/cpu/cpu.h"
+#include "src/cpu/opcodes/opcode_types.h"
+
+// Blocks end at the first instruction that can write the PC. Anything missed here
+// (e.g. a load with writeback to the PC) is still caught at run time, it only makes
+// the cached block longer than it needs to be.
+static bool arm_ends_block(ArmOpcodeType opcode_type, Word opcode)
+{
+    Byte rd = Utils::read_bit_range(opcode, 12, 15);
+    bool load = Utils::read_bit(opcode, 20);
+
+    switch (opcode_type)
+    {
+        case BRANCH:
+        case BX:
+        case SWI:
+        case UNDEFINED:
+            return true;
+        case ALU:
+            return rd == REGISTER_PC;
+        case SINGLE_DATA_TRANSFER:
+        case HALF_WORD_SIGNED_DATA_TRANSFER:
+            return load && rd == REGISTER_PC;
+        case BLOCK_DATA_TRANSFER:
+            return load && Utils::read_bit(opcode, REGISTER_PC);
+        default:
+            return false;
+    }
+}
+
+static bool thumb_ends_block(ThumbOpcodeType opcode_type, HalfWord opcode)
+{
+    switch (opcode_type)
+    {
+        case CONDITIONAL_BRANCH:
+        case SOFTWARE_INTERRUPT:
+        case UNCONDITIONAL_BRANCH:
+        case THUMB_UNDEFINED:
+            return true;
+        case LONG_BRANCH_WITH_LINK:
+            return Utils::read_bit(opcode, 11); // Second half
+        case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE: {
+            Byte sub_opcode = Utils::read_bit_range(opcode, 8, 9);
+            bool hi_destination = Utils::read_bit(opcode, 7);
+            Byte destination_register = Utils::read_bit_range(opcode, 0, 2);
+            return sub_opcode == 3 || (sub_opcode != 1 && hi_destination && destination_register == 7);
+        }
+        case PUSH_POP_REGISTERS:
+            return Utils::read_bit(opcode, 11) && Utils::read_bit(opcode, 8); // POP {..., PC}
+        default:
+            return false;
+    }
+}
+
+ARM7TDMI::CachedBlock * ARM7TDMI::find_block(Word pc, CPUState state)
+{
+    Word key = pc | state;
+    std::unordered_map<Word, CachedBlock> & cache = Memory::wram_code_page(pc) >= 0
+        ? wram_block_cache
+        : block_cache;
+
+    auto found_block = cache.find(key);
+    if (found_block != cache.end()) {
+        return &found_block->second;
+    }
+
+    CachedBlock * block = &cache[key];
+    build_block(block, pc, state);
+    return block;
+}
+
+void ARM7TDMI::build_block(CachedBlock * block, Word pc, CPUState state)
+{
+    int first_code_page = Memory::wram_code_page(pc);
+    Word address = pc;
+
+    for (int i = 0; i < MAX_BLOCK_LENGTH; i++) {
+        bool ends_block;
+
+        if (state == STATE_ARM) {
+            Word opcode = read_word_from_memory(address);
+            block->arm_instructions.push_back(decode_arm_instruction(opcode));
+            ends_block = arm_ends_block(decode_opcode_arm(opcode), opcode);
+            address += 4;
+        } else {
+            HalfWord opcode = read_halfword_from_memory(address);
+            block->thumb_instructions.push_back(decode_thumb_instruction(opcode));
+            ends_block = thumb_ends_block(decode_opcode_thumb(opcode), opcode);
+            address += 2;
+        }
+
+        // Stop where a WRAM mirror wraps around so the block covers one range of pages,
+        // and at the end of a region so every fetch in the block takes as long.
+        if (ends_block || Memory::wram_code_page(address) < first_code_page || (address >> 24) != (pc >> 24)) {
+            break;
+        }
+    }
+
+    block->idle_loop = detect_idle_loops && is_idle_loop(block, pc, state);
+    block->first_code_page = first_code_page;
+    block->last_code_page = Memory::wram_code_page(address - 1);
+
+    if (first_code_page >= 0) {
+        for (Word page_address = pc; page_address < address; page_address += 1 << CODE_PAGE_SHIFT) {
+            memory.mark_code_page(page_address);
+        }
+        memory.mark_code_page(address - 1);
+    }
+}
+
+void ARM7TDMI::invalidate_written_blocks()
+{
+    if (memory.written_code_pages.empty()) {
+        return;
+    }
+
+    for (auto block = wram_block_cache.begin(); block != wram_block_cache.end();) {
+        bool written = false;
+        for (int code_page : memory.written_code_pages) {
+            if (code_page >= block->second.first_code_page && code_page <= block->second.last_code_page) {
+                written = true;
+                break;
+            }
+        }
+        block = written ? wram_block_cache.erase(block) : std::next(block);
+    }
+
+    memory.written_code_pages.clear();
+    memory.code_page_written = false;
+}
+
+void ARM7TDMI::flush_block_cache()
+{
+    block_cache.clear();
+    wram_block_cache.clear();
+    memory.clear_code_pages();
+    memory.written_code_pages.clear();
+    memory.code_page_written = false;
+    jit.reset();
+}
+
+// Runs the block at the PC until cycles reaches max_cycles and returns how
+// many instructions ran. Follows run_next_opcode step for step, the block is
+// left as soon as an instruction moves the PC, switches state, or writes
+// over cached code.
+int ARM7TDMI::run_next_block(int max_cycles)
+{
+    if (cycles >= max_cycles) {
+        return 0;
+    }
+
+    if (irq_manager.irq_pending && !cpsr.i()) {
+        enter_interrupt();
+    }
+
+    Word pc = read_register(REGISTER_PC);
+
+    // Back from an interrupt that wasn't the one being waited for.
+    if (interrupt_wait && pc == interrupt_wait_return) {
+        interrupt_wait = !check_interrupt_wait();
+        halted = interrupt_wait;
+        if (halted) {
+            return 0;
+        }
+    }
+
+    // Unmapped and BIOS addresses are left to the single step path, the
+    // only BIOS code run is the interrupt return.
+    if (pc < 0x01000000 || pc >= 0x10000000) {
+        idle_loop_armed = IDLE_LOOP_NONE;
+        if (pc == BIOS_IRQ_RETURN_ADDRESS) {
+            return_from_interrupt();
+        } else {
+            run_next_opcode();
+        }
+        return 1;
+    }
+
+    invalidate_written_blocks();
+    if (jit.full) {
+        flush_block_cache();
+    }
+
+    CPUState state = cpsr.t();
+    CachedBlock * block = find_block(pc, state);
+
+    // Overridden loops can run through other blocks, detected ones can't.
+    Word key = pc | state;
+    if (block->idle_loop || key == idle_loop_override) {
+        if (idle_loop_armed == key && !memory.unsettled_io_read) {
+            idle_loop_reached = true;
+            return 0;
+        }
+        idle_loop_armed = key;
+        memory.unsettled_io_read = false;
+    } else if (idle_loop_armed != idle_loop_override) {
+        idle_loop_armed = IDLE_LOOP_NONE;
+    }
+
+    fetch_cycles = memory.code_fetch_cycles[ACCESS_SEQUENTIAL][state == STATE_ARM ? ACCESS_32 : ACCESS_16][(pc >> 24) & 0xF];
+
+    if (use_jit) {
+        if (block->compiled == nullptr && !block->jit_failed && ++block->executions >= JIT_HOT_THRESHOLD) {
+            block->compiled = compile_block(block, pc, state);
+            block->jit_failed = block->compiled == nullptr;
+        }
+        if (block->compiled != nullptr) {
+            return block->compiled(this, max_cycles);
+        }
+    }
+
+    int executed = 0;
+
+    if (state == STATE_ARM) {
+        for (ArmBlockInstruction & instruction : block->arm_instructions) {
+            if (cycles >= max_cycles) {break;}
+            executed++;
+            cycles += fetch_cycles;
+
+            if (instruction.condition == 0xE || condition_field(instruction.condition)) {
+                (this->*instruction.handler)(instruction);
+                if (read_register(REGISTER_PC) != pc) {
+                    refill_pipeline();
+                    break;
+                }
+            }
+
+            pc += 4;
+            write_register(REGISTER_PC, pc);
+            if (cpsr.t() != state || memory.code_page_written) {break;}
+        }
+    } else {
+        for (ThumbBlockInstruction & instruction : block->thumb_instructions) {
+            if (cycles >= max_cycles) {break;}
+            executed++;
+            cycles += fetch_cycles;
+
+            (this->*instruction.handler)(instruction);
+            if (read_register(REGISTER_PC) != pc) {
+                refill_pipeline();
+                break;
+            }
+
+            pc += 2;
+            write_register(REGISTER_PC, pc);
+            if (cpsr.t() != state || memory.code_page_written) {break;}
+        }
+    }
+
+    return executed;
+}
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 
 #include <SDL3/SDL.h>
@@ -7,134 +8,71 @@
 #include "cpu.h"
 #include "../utils.h"
 
-#include "src/cpu/opcodes/arm/data_processing.h"
-#include "src/cpu/opcodes/arm/block_data_transfer.h"
-
 // Private
 
-RegisterSet * ARM7TDMI::mode_to_register_set(OperatingMode mode) 
+void ARM7TDMI::set_mode(OperatingMode new_mode)
 {
-    switch (mode) {
-        case MODE_USER :
-            return &registers_user;
-        case MODE_SYSTEM:
-            return &registers_user;
-        case MODE_FIQ:
-            return &registers_fiq;
-        case MODE_IRQ :
-            return &registers_irq;
-        case MODE_SUPERVISOR:
-            return &registers_supervisor;
-        case MODE_ABORT:
-            return &registers_abort;
-        case MODE_UNDEFINED:
-            return &registers_undefined;
-    }
-    assert(false);
+    register_file.switch_bank(
+        RegisterFile::mode_to_bank(cpsr.mode()), 
+        RegisterFile::mode_to_bank(new_mode)
+    );
+    cpsr.set_mode(new_mode);
+}
+
+void ARM7TDMI::write_cpsr(ProgramStatusRegister new_cpsr)
+{
+    set_mode(new_cpsr.mode());
+    cpsr = new_cpsr;
+}
+
+Word ARM7TDMI::read_user_register(int register_number)
+{
+    return register_file.read_user_register(RegisterFile::mode_to_bank(cpsr.mode()), register_number);
 }
 
-RegisterSet * ARM7TDMI::current_register_set() 
+void ARM7TDMI::write_user_register(int register_number, Word register_value)
 {
-    return mode_to_register_set(cpsr.mode);
+    register_file.write_user_register(RegisterFile::mode_to_bank(cpsr.mode()), register_number, register_value);
 }
 
 void ARM7TDMI::set_irq(bool irq_on)
 {
-    bool is_privileged = cpsr.mode != MODE_USER;
+    bool is_privileged = cpsr.mode() != MODE_USER;
     if (!is_privileged) return;
 
-    cpsr.i = irq_on ? 0 : 1;
+    cpsr.set_i(irq_on ? 0 : 1);
 }
 
 void ARM7TDMI::set_fiq(bool fiq_on)
 {
-    bool is_privileged = cpsr.mode != MODE_USER;
+    bool is_privileged = cpsr.mode() != MODE_USER;
     if (!is_privileged) return;
 
-    cpsr.f = fiq_on ? 0 : 1;
+    cpsr.set_f(fiq_on ? 0 : 1);
 }
 
 void ARM7TDMI::trigger_exception(OperatingMode new_mode, unsigned int exception_vector, unsigned int saved_pc_offset, int priority)
 {
-    RegisterSet * new_register_set = mode_to_register_set(new_mode);
+    ProgramStatusRegister old_cpsr = cpsr;
     Word pc_value = read_register(REGISTER_PC);
     Word ls_value = pc_value;
 
     ls_value += saved_pc_offset;
-    *new_register_set->registers[REGISTER_LR] = ls_value;
 
-    new_register_set->spsr = cpsr;
-    cpsr.t = STATE_ARM;
-    cpsr.mode = new_mode;
-    cpsr.i = true;
+    set_mode(new_mode);
+    write_register(REGISTER_LR, ls_value);
+
+    *current_spsr() = old_cpsr;
+    cpsr.set_t(STATE_ARM);
+    cpsr.set_i(true);
 
     write_register(REGISTER_PC, exception_vector);
 };
 
-Word ARM7TDMI::read_word_from_memory(Word address) {
-    if (address < 0x10000000) {
-        return memory.read_word_from_memory(address);
-    } else {
-        return read_register(REGISTER_PC) + 8;
-    }
-}
-
-HalfWord ARM7TDMI::read_halfword_from_memory(Word address) {
-    return memory.read_halfword_from_memory(address);
-}
-
-void ARM7TDMI::write_word_to_memory(Word address, Word value) {
-    memory.write_word_to_memory(address, value);
-}
-
-void ARM7TDMI::write_halfword_to_memory(Word address, HalfWord value) {
-    memory.write_halfword_to_memory(address, value);
-}
-
 // Public
 
 ARM7TDMI::ARM7TDMI() : irq_manager(&memory) 
 {
-    registers_user = RegisterSet();
-
-    RegisterSet * register_sets[5] = {&registers_fiq, &registers_irq, &registers_supervisor, &registers_abort, &registers_undefined};
-
-    for (int i = 0; i < 5; i++) {
-        RegisterSet * current = register_sets[i];
-        *current = RegisterSet(); 
-
-        for (int i = 0; i < 13; i++) {
-            free(current->registers[i]);
-            current->registers[i] = registers_user.registers[i];
-        }
-
-        free(current->registers[REGISTER_PC]);
-        current->registers[REGISTER_PC] = registers_user.registers[REGISTER_PC];
-    }
-
-    for (int i = 8; i < 13; i++) {
-        registers_fiq.registers[i] = (Word *) malloc(sizeof(Word));
-    }
-};
-
-Word ARM7TDMI::read_register(int register_number)
-{
-    assert(register_number < 16);
-
-    if (register_number == REGISTER_PC)
-    {
-        // TODO: Once memory is added chnage offset to emulate pipeling.
-        return *registers_user.registers[REGISTER_PC] + 0;
-    }
-
-    return *(current_register_set()->registers[register_number]);
-};
-
-void ARM7TDMI::write_register(int register_number, Word register_value)
-{
-    SDL_assert(register_number < 16);
-    // if (register_number == 1) {SDL_Log("register: 1 %0x, %0x", read_register(1), read_register(REGISTER_PC));}
-    current_register_set()->write_register(register_number, register_value);
 };
 
 bool ARM7TDMI::condition_field(int condition_code) 
@@ -144,33 +82,33 @@ bool ARM7TDMI::condition_field(int condition_code)
     switch (condition_code) 
     {
         case 0x0:
-            condition = cpsr.z == 1; break;
+            condition = cpsr.z() == 1; break;
         case 0x1:
-            condition = cpsr.z == 0; break;
+            condition = cpsr.z() == 0; break;
         case 0x2:
-            condition = cpsr.c == 1; break;
+            condition = cpsr.c() == 1; break;
         case 0x3:
-            condition = cpsr.c == 0; break;
+            condition = cpsr.c() == 0; break;
         case 0x4:
-            condition = cpsr.n == 1; break;
+            condition = cpsr.n() == 1; break;
         case 0x5:
-            condition = cpsr.n == 0; break;
+            condition = cpsr.n() == 0; break;
         case 0x6:
-            condition = cpsr.v == 1; break;
+            condition = cpsr.v() == 1; break;
         case 0x7:
-            condition = cpsr.v == 0; break;
+            condition = cpsr.v() == 0; break;
         case 0x8:
-            condition = cpsr.c == 1 && cpsr.z == 0; break;
+            condition = cpsr.c() == 1 && cpsr.z() == 0; break;
         case 0x9:
-            condition = cpsr.c == 0 || cpsr.z == 1; break;
+            condition = cpsr.c() == 0 || cpsr.z() == 1; break;
         case 0xA:
-            condition = cpsr.n == cpsr.v; break;
+            condition = cpsr.n() == cpsr.v(); break;
         case 0xB:
-            condition = cpsr.n != cpsr.v; break;
+            condition = cpsr.n() != cpsr.v(); break;
         case 0xC:
-            condition = cpsr.z == 0 && cpsr.n == cpsr.v; break;
+            condition = cpsr.z() == 0 && cpsr.n() == cpsr.v(); break;
         case 0xD:
-            condition = cpsr.z == 1 || cpsr.n != cpsr.v; break;
+            condition = cpsr.z() == 1 || cpsr.n() != cpsr.v(); break;
         case 0xE:
             condition = true; break;
         case 0xF:
@@ -181,7 +119,7 @@ bool ARM7TDMI::condition_field(int condition_code)
 }
 
 bool ARM7TDMI::is_priviledged() {
-    return cpsr.mode != MODE_USER;
+    return cpsr.mode() != MODE_USER;
 }
 
 void ARM7TDMI::skip_bios() {
@@ -189,22 +127,22 @@ void ARM7TDMI::skip_bios() {
         memory.wram_chip[i] = 0x0;
     }
     
+    set_mode(MODE_SYSTEM);
+    cpsr.set_t(STATE_ARM);
+
     for (Word i = 0; i < 13; i++) {
-        *registers_user.registers[i] = 0;
+        write_register(i, 0);
     }
     
-    *registers_supervisor.registers[REGISTER_LR] = 0;
-    registers_supervisor.spsr.write_value(0); 
+    register_file.banked_r13_r14[BANK_SUPERVISOR][1] = 0;
+    register_file.spsr[BANK_SUPERVISOR].write_value(0); 
 
-    *registers_irq.registers[REGISTER_LR] = 0;
-    registers_irq.spsr.write_value(0); 
+    register_file.banked_r13_r14[BANK_IRQ][1] = 0;
+    register_file.spsr[BANK_IRQ].write_value(0); 
 
-    *registers_supervisor.registers[REGISTER_SP] = 0x3007FE0;
-    *registers_irq.registers[REGISTER_SP] = 0x03007FA0;
-    *registers_user.registers[REGISTER_SP] = 0x03007F00;
-
-    cpsr.mode = MODE_SYSTEM;
-    cpsr.t = STATE_ARM;
+    register_file.banked_r13_r14[BANK_SUPERVISOR][0] = 0x3007FE0;
+    register_file.banked_r13_r14[BANK_IRQ][0] = 0x03007FA0;
+    write_register(REGISTER_SP, 0x03007F00);
 
     write_register(REGISTER_PC, GAMEPAK_ROM_START);
 
@@ -216,7 +154,7 @@ void ARM7TDMI::run_exception(Exception exception_type) {
     {
         case EXCEPTION_RESET:
             trigger_exception(MODE_SUPERVISOR, 0x00, 0, 1);
-            cpsr.f = true;
+            cpsr.set_f(true);
             break;
         case EXCEPTION_UNDEFINED:
             trigger_exception(MODE_UNDEFINED, 0x04, 4, 7);
@@ -231,64 +169,66 @@ void ARM7TDMI::run_exception(Exception exception_type) {
             trigger_exception(MODE_ABORT, 0x10, 8, 2);
             break;
         case EXCEPTION_INTERRUPT:
-            if (cpsr.i) break;
+            if (cpsr.i()) break;
             trigger_exception(MODE_IRQ, 0x18, 4, 4);
             break;
         case EXCEPTION_FAST_INTERRUPT:
-            if (cpsr.f) break;
+            if (cpsr.f()) break;
             trigger_exception(MODE_FIQ, 0x1C, 4, 3);
-            cpsr.f = true;
+            cpsr.set_f(true);
             break;
     }
 };
 
-void ARM7TDMI::start_interrupt(Interrupt interrupt) {
-    if (cpsr.i) {return;}
+void ARM7TDMI::request_interrupt(Interrupt interrupt) {
     irq_manager.start_interrupt(interrupt);
+}
 
+// What the BIOS IRQ vector does: save r0-r3, r12 and LR on the IRQ stack
+// and call the game's handler with LR pointing at the BIOS return code.
+void ARM7TDMI::enter_interrupt() {
     run_exception(EXCEPTION_INTERRUPT);
 
-    HalfWord saved_registers = 
-    ((1 << 4) - 1) |
-    (1 << 12) |
-    (1 << REGISTER_LR);
-
-    OpcodeBlockDataTransferBuilder(false, REGISTER_SP)
-    .set_flags(true, false, false, true)
-    .set_register_list(saved_registers)
-    .get_product()
-    .run(this);
+    Word stack_pointer = read_register(REGISTER_SP) - 6 * 4;
+    static const int saved_registers[6] = {0, 1, 2, 3, 12, REGISTER_LR};
+    for (int i = 0; i < 6; i++) {
+        write_word_to_memory(stack_pointer + i * 4, read_register(saved_registers[i]));
+    }
+    write_register(REGISTER_SP, stack_pointer);
+    add_data_cycles(stack_pointer, ACCESS_32, ACCESS_NONSEQUENTIAL);
+    cycles += 5 * memory.data_access_cycles[ACCESS_SEQUENTIAL][ACCESS_32][(stack_pointer >> 24) & 0xF];
 
-    write_register(REGISTER_LR, 0x00000138);
+    write_register(REGISTER_LR, BIOS_IRQ_RETURN_ADDRESS);
     write_register(0, 0x04000000);
 
-    Word interrupt_pointer = read_word_from_memory(0x03FFFFFC);
-    write_register(REGISTER_PC, interrupt_pointer);
+    Word interrupt_pointer = read_word_from_memory(BIOS_IRQ_HANDLER_ADDRESS);
+    add_data_cycles(BIOS_IRQ_HANDLER_ADDRESS, ACCESS_32, ACCESS_NONSEQUENTIAL);
     if (interrupt_pointer == 0) {
         return_from_interrupt();
-    } else {
-        // SDL_Log("interrupt pointer in: %0x", interrupt_pointer);
+        return;
     }
+    write_register(REGISTER_PC, interrupt_pointer);
+    refill_pipeline();
 }
 
+// The BIOS code at BIOS_IRQ_RETURN_ADDRESS, restores the registers and
+// returns to the interrupted instruction.
 void ARM7TDMI::return_from_interrupt() {
-    HalfWord loaded_registers = 
-    ((1 << 4) - 1) |
-    (1 << 12) |
-    (1 << REGISTER_LR);
-
-    OpcodeBlockDataTransferBuilder(true, REGISTER_SP)
-    .set_flags(false, true, false, true)
-    .set_register_list(loaded_registers)
-    .get_product()
-    .run(this);
-
-    OpcodeDataProcessingBuilder(OpcodeDataProcess::SUB, true)
-    .set_destination_register(REGISTER_PC)
-    .set_source_register(REGISTER_LR)
-    .set_immediate_op2(0x4, 0)
-    .get_product()
-    .run(this);
+    Word stack_pointer = read_register(REGISTER_SP);
+    static const int saved_registers[6] = {0, 1, 2, 3, 12, REGISTER_LR};
+    for (int i = 0; i < 6; i++) {
+        write_register(saved_registers[i], read_word_from_memory(stack_pointer + i * 4));
+    }
+    write_register(REGISTER_SP, stack_pointer + 6 * 4);
+    add_data_cycles(stack_pointer, ACCESS_32, ACCESS_NONSEQUENTIAL);
+    cycles += 5 * memory.data_access_cycles[ACCESS_SEQUENTIAL][ACCESS_32][(stack_pointer >> 24) & 0xF];
+    add_internal_cycles(1);
+
+    // SUBS PC, LR, #4
+    Word return_address = read_register(REGISTER_LR) - 4;
+    write_cpsr(*current_spsr());
+    write_register(REGISTER_PC, return_address);
+    refill_pipeline();
 }
 
 void ARM7TDMI::warn(const char * msg)
@@ -296,95 +236,83 @@ void ARM7TDMI::warn(const char * msg)
     return;
 }
 
+// Moving the PC throws the prefetched instructions away, refetching takes
+// a nonsequential and a sequential fetch at the new PC.
+void ARM7TDMI::refill_pipeline()
+{
+    Word pc = read_register(REGISTER_PC);
+    AccessWidth width = cpsr.t() == STATE_ARM ? ACCESS_32 : ACCESS_16;
+    Byte region = (pc >> 24) & 0xF;
+    cycles += memory.code_fetch_cycles[ACCESS_NONSEQUENTIAL][width][region]
+        + memory.code_fetch_cycles[ACCESS_SEQUENTIAL][width][region];
+}
+
+// The multiplier array stops early once the rest of the multiplier is all
+// zeros (or all ones for signed multiplies).
+int ARM7TDMI::multiply_cycles(Word multiplier, bool signed_multiply)
+{
+    for (int array_cycles = 1; array_cycles < 4; array_cycles++) {
+        Word rest = multiplier >> (array_cycles * 8);
+        Word all_ones = UINT32_MAX >> (array_cycles * 8);
+        if (rest == 0 || (signed_multiply && rest == all_ones)) {
+            return array_cycles;
+        }
+    }
+    return 4;
+}
+
 void ARM7TDMI::run_next_opcode()
 {   
     static bool print = false;
     Word pc = read_register(REGISTER_PC);
+    AccessWidth width = cpsr.t() == STATE_ARM ? ACCESS_32 : ACCESS_16;
+    cycles += memory.code_fetch_cycles[ACCESS_SEQUENTIAL][width][(pc >> 24) & 0xF];
 
-    if (pc == 0x138) {
-        return_from_interrupt();
-        return;
-    }
-    
     if (pc < 0x01000000) {
         // SDL_TriggerBreakpoint();
         return;
     }
 
-    if (cpsr.t == STATE_ARM) {
+    if (cpsr.t() == STATE_ARM) {
         Word opcode = read_word_from_memory(pc);
-        ArmOpcodeType opcode_type = decode_opcode_arm(opcode);
 
         if (print) {
-            SDL_Log("ARM pc: %08x, opcode: %08x, type: %s, register: %08x \n", pc, opcode, dissassemble_opcode_arm(opcode_type).c_str(), read_register(0));
+            SDL_Log("ARM pc: %08x, opcode: %08x, type: %s, register: %08x \n", pc, opcode, dissassemble_opcode_arm(decode_opcode_arm(opcode)).c_str(), read_register(0));
         }
 
-        Byte condition_code = Utils::read_bit_range(opcode, 28, 31);
+        Byte condition_code = opcode >> 28;
         if (condition_field(condition_code) == false) {
             write_register(REGISTER_PC, pc + 4);
             return;
         }
 
-        switch (opcode_type)
-        {
-            case BRANCH: arm_opcode_branch(opcode); break;
-            case BX: arm_opcode_branch_exchange(opcode); break;
-            case SWI: arm_opcode_software_interrupt(opcode); break;
-            case UNDEFINED: arm_opcode_undefined_intruction(opcode); break;
-            case ALU: arm_opcode_data_processing(opcode); break;
-            case MULTIPLY: arm_opcode_multiply(opcode); break;
-            case MULTIPLY_LONG: arm_opcode_multiply_long(opcode); break;
-            case PSR_TRANSFER: arm_opcode_psr_transfer(opcode); break;
-            case SINGLE_DATA_TRANSFER: arm_opcode_single_data_transfer(opcode); break;
-            case HALF_WORD_SIGNED_DATA_TRANSFER: arm_opcode_half_word_signed_data_transfer(opcode); break;
-            case BLOCK_DATA_TRANSFER: arm_opcode_block_data_transfer(opcode); break;
-            case SWAP: arm_opcode_swap(opcode); break;
-            default:
-                break;
-        }
+        ArmBlockInstruction instruction = decode_arm_instruction(opcode);
+        (this->*instruction.handler)(instruction);
 
         bool pc_changed = pc != read_register(REGISTER_PC);
         if (!pc_changed) {
             write_register(REGISTER_PC, read_register(REGISTER_PC) + 4);
         } else {
+            refill_pipeline();
             // if (read_register(REGISTER_PC) < 0x01000000) {
             //     SDL_Log("STOPPED: PC: %0x", pc);
             // }
         }
     } else {
         HalfWord opcode = read_halfword_from_memory(pc);
-        ThumbOpcodeType opcode_type = decode_opcode_thumb(opcode);
 
         if (print) {
-            SDL_Log("THUMB pc: %08x, opcode: %04x, type: %s, register: %08x \n", pc, opcode, dissassemble_opcode_thumb(opcode_type).c_str(), read_register(7));
+            SDL_Log("THUMB pc: %08x, opcode: %04x, type: %s, register: %08x \n", pc, opcode, dissassemble_opcode_thumb(decode_opcode_thumb(opcode)).c_str(), read_register(7));
         }
 
-        switch (opcode_type)
-        {
-            case MOVE_SHIFTED_REGISTER: thumb_opcode_move_shifted_register(opcode); break;
-            case ADD_SUBTRACT: thumb_opcode_add_subtract(opcode); break;
-            case MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE: thumb_opcode_move_compare_add_subtract(opcode); break;
-            case ALU_OPERATION: thumb_opcode_alu_operations(opcode); break;
-            case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE: thumb_opcode_hi_register_operations_branch_exchange(opcode); break;
-            case PC_RELATIVE_LOAD: thumb_opcode_pc_relative_load(opcode); break;
-            case LOAD_STORE_REGISTER_OFFSET: thumb_opcode_load_store_register_offset(opcode); break;
-            case LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD: thumb_opcode_load_store_sign_extended_byte_halfword(opcode); break;
-            case LOAD_STORE_IMMEDIATE_OFFSET: thumb_opcode_load_store_immediate_offset(opcode); break;
-            case LOAD_STORE_HALFWORD: thumb_opcode_load_store_halfword(opcode); break;
-            case SP_RELATIVE_LOAD_STORE: thumb_opcode_sp_relative_load_store(opcode); break;
-            case LOAD_ADDRESS: thumb_opcode_load_address(opcode); break;
-            case ADD_OFFSET_TO_STACK_POINTER: thumb_opcode_add_offset_to_stack_pointer(opcode); break;
-            case PUSH_POP_REGISTERS: thumb_opcode_push_pop_registers(opcode); break;
-            case MULTIPLE_LOAD_STORE: thumb_opcode_multiple_load_store(opcode); break;
-            case CONDITIONAL_BRANCH: thumb_opcode_conditional_branch(opcode); break;
-            case SOFTWARE_INTERRUPT: thumb_opcode_software_interrupt(opcode); break;
-            case UNCONDITIONAL_BRANCH: thumb_opcode_unconditional_branch(opcode); break;
-            case LONG_BRANCH_WITH_LINK: thumb_opcode_long_branch_with_link(opcode); break;
-        }
+        ThumbBlockInstruction instruction = decode_thumb_instruction(opcode);
+        (this->*instruction.handler)(instruction);
 
         bool pc_changed = pc != read_register(REGISTER_PC);
         if (!pc_changed) {
             write_register(REGISTER_PC, read_register(REGISTER_PC) + 2);
+        } else {
+            refill_pipeline();
         }
     }
 }
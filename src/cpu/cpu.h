@@ -1,11 +1,15 @@
 #ifndef CPU_INCLUDED
 #define CPU_INCLUDED
 
+#include <array>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "cpu_types.h"
 #include "psr.h"
 #include "register.h"
+#include "jit.h"
 #include "./opcodes/opcode_types.h"
 
 #include "src/memory.h"
@@ -14,8 +18,14 @@
 #include "../utils.h"
 
 #define KEY_INPUT_ADDRESS 0x04000130
+#define BIOS_INTERRUPT_CHECK_ADDRESS 0x03007FF8
+#define BIOS_IRQ_HANDLER_ADDRESS 0x03FFFFFC
+#define BIOS_IRQ_RETURN_ADDRESS 0x00000138
 #define GAMEPAK_ROM_START 0x08000000
 
+#define MAX_BLOCK_LENGTH 64
+#define IDLE_LOOP_NONE 0
+
 enum Exception {
     EXCEPTION_RESET,
     EXCEPTION_UNDEFINED,
@@ -30,17 +40,20 @@ typedef struct ARM7TDMI {
     public:
         const Endian endian_type = ENDIAN_LITTLE;
         
-        RegisterSet registers_user;
-        RegisterSet registers_fiq;
-        RegisterSet registers_irq;
-        RegisterSet registers_supervisor;
-        RegisterSet registers_abort;
-        RegisterSet registers_undefined;
+        RegisterFile register_file;
 
         ProgramStatusRegister cpsr;
 
-        RegisterSet * mode_to_register_set(OperatingMode mode);
-        RegisterSet * current_register_set();
+        PSR * current_spsr() {
+            return &register_file.spsr[RegisterFile::mode_to_bank(cpsr.mode())];
+        }
+
+        // All CPSR mode changes go through these so the banked registers are swapped.
+        void set_mode(OperatingMode new_mode);
+        void write_cpsr(ProgramStatusRegister new_cpsr);
+
+        Word read_user_register(int register_number);
+        void write_user_register(int register_number, Word register_value);
 
         void set_irq(bool irq_on);
 
@@ -48,46 +61,131 @@ typedef struct ARM7TDMI {
 
         void trigger_exception(OperatingMode new_mode, unsigned int exception_vector, unsigned int saved_pc_offset, int priority);
 
+        struct ArmBlockInstruction;
+        struct ThumbBlockInstruction;
+
+        typedef void (ARM7TDMI::*ArmOpcodeHandler)(const ArmBlockInstruction & instruction);
+
+        // Indexed by opcode bits 27-20 and 7-4, see arm_decode_key.
+        static const std::array<ArmOpcodeHandler, 0x1000> arm_opcode_handlers;
+        static Word arm_decode_key(Word opcode) {
+            return ((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0xF);
+        }
+
+        typedef void (ARM7TDMI::*ThumbOpcodeHandler)(const ThumbBlockInstruction & instruction);
+
+        // Indexed by opcode bits 15-6, see thumb_decode_key.
+        static const std::array<ThumbOpcodeHandler, 0x400> thumb_opcode_handlers;
+        static Word thumb_decode_key(HalfWord opcode) {
+            return opcode >> 6;
+        }
+
+        // Straight line runs of instructions, decoded once and cached by their start address.
+        // The register and immediate fields are pulled out with the handler, handlers only go
+        // back to the opcode for single bit flags. Fields a format doesn't have are 0.
+        typedef struct ArmBlockInstruction {
+            ArmOpcodeHandler handler;
+            Word opcode;
+            Byte condition;
+            Byte rd; // 15-12
+            Byte rn; // 19-16
+            Byte rm; // 3-0
+            Byte rs; // 11-8
+            Byte shift_amount; // 11-7, or the rotation of a data processing immediate
+            Word immediate; // The rotated data processing immediate, a transfer offset or a branch offset
+        } ArmBlockInstruction;
+
+        typedef struct ThumbBlockInstruction {
+            ThumbOpcodeHandler handler;
+            HalfWord opcode;
+            Byte condition; // Conditional branches only
+            Byte rd; // 2-0, or 10-8 next to an 8 bit immediate. Hi register operations add H1.
+            Byte rs; // 5-3, the base of loads and stores. Hi register operations add H2.
+            Byte rn; // 8-6, an offset register or 3 bit immediate
+            Word immediate; // Scaled and sign extended for its format
+        } ThumbBlockInstruction;
+
+        static ArmBlockInstruction decode_arm_instruction(Word opcode);
+        static ThumbBlockInstruction decode_thumb_instruction(HalfWord opcode);
+
+        typedef struct CachedBlock {
+            std::vector<ArmBlockInstruction> arm_instructions;
+            std::vector<ThumbBlockInstruction> thumb_instructions;
+            int first_code_page; // WRAM pages covered, -1 outside WRAM
+            int last_code_page;
+
+            Word executions = 0;
+            JitCodeCache::CompiledBlock compiled = nullptr;
+            bool jit_failed = false;
+            bool idle_loop = false;
+        } CachedBlock;
+
+        // Keyed by the start address with the state in bit 0.
+        std::unordered_map<Word, CachedBlock> block_cache;
+        std::unordered_map<Word, CachedBlock> wram_block_cache;
+
+        CachedBlock * find_block(Word pc, CPUState state);
+        void build_block(CachedBlock * block, Word pc, CPUState state);
+        void invalidate_written_blocks();
+
+        JitCodeCache jit;
+        JitCodeCache::CompiledBlock compile_block(CachedBlock * block, Word pc, CPUState state);
+
+        // Called from compiled blocks for what isn't emitted natively.
+        static void jit_run_arm_instruction(ARM7TDMI * cpu, const ArmBlockInstruction * instruction);
+        static void jit_run_thumb_instruction(ARM7TDMI * cpu, const ThumbBlockInstruction * instruction);
+        static void jit_refill_pipeline(ARM7TDMI * cpu);
+
+        bool is_idle_loop(CachedBlock * block, Word pc, CPUState state);
+
         ArmOpcodeType decode_opcode_arm(Word opcode);
         ThumbOpcodeType decode_opcode_thumb(HalfWord opcode);
 
         void warn(const char * msg);
         
-        void arm_opcode_branch(Word opcode);
-        void arm_opcode_branch_exchange(Word opcode);
-        void arm_opcode_software_interrupt(Word opcode);
-        void arm_opcode_undefined_intruction(Word opcode);
-        void arm_opcode_data_processing(Word opcode);
-        void arm_opcode_multiply(Word opcode);
-        void arm_opcode_multiply_long(Word opcode);
-        void arm_opcode_psr_transfer(Word opcode);
-        void arm_opcode_single_data_transfer(Word opcode);
-        void arm_opcode_half_word_signed_data_transfer(Word opcode);
-        void arm_opcode_block_data_transfer(Word opcode);
-        void arm_opcode_swap(Word opcode);
-
-        void thumb_opcode_move_shifted_register(HalfWord opcode);
-        void thumb_opcode_add_subtract(HalfWord opcode);
-        void thumb_opcode_move_compare_add_subtract(HalfWord opcode);
-        void thumb_opcode_alu_operations(HalfWord opcode);
-        void thumb_opcode_hi_register_operations_branch_exchange(HalfWord opcode);
-        void thumb_opcode_pc_relative_load(HalfWord opcode);
-        void thumb_opcode_load_store_register_offset(HalfWord opcode);
-        void thumb_opcode_load_store_sign_extended_byte_halfword(HalfWord opcode);
-        void thumb_opcode_load_store_immediate_offset(HalfWord opcode);
-        void thumb_opcode_load_store_halfword(HalfWord opcode);
-        void thumb_opcode_sp_relative_load_store(HalfWord opcode);
-        void thumb_opcode_load_address(HalfWord opcode);
-        void thumb_opcode_add_offset_to_stack_pointer(HalfWord opcode);
-        void thumb_opcode_push_pop_registers(HalfWord opcode);
-        void thumb_opcode_multiple_load_store(HalfWord opcode);
-
-        void thumb_opcode_conditional_branch(HalfWord opcode);
-        void thumb_opcode_software_interrupt(HalfWord opcode);
-        void thumb_opcode_unconditional_branch(HalfWord opcode);
-        void thumb_opcode_long_branch_with_link(HalfWord opcode);
+        void arm_opcode_branch(const ArmBlockInstruction & instruction);
+        void arm_opcode_branch_exchange(const ArmBlockInstruction & instruction);
+        void arm_opcode_software_interrupt(const ArmBlockInstruction & instruction);
+        void arm_opcode_undefined_intruction(const ArmBlockInstruction & instruction);
+        template <Word instruction_type, bool set_condition_codes, Word operand_form, Word shift_type>
+        void arm_opcode_data_processing(const ArmBlockInstruction & instruction);
+        void arm_opcode_multiply(const ArmBlockInstruction & instruction);
+        void arm_opcode_multiply_long(const ArmBlockInstruction & instruction);
+        void arm_opcode_psr_transfer(const ArmBlockInstruction & instruction);
+        void arm_opcode_single_data_transfer(const ArmBlockInstruction & instruction);
+        void arm_opcode_half_word_signed_data_transfer(const ArmBlockInstruction & instruction);
+        void arm_opcode_block_data_transfer(const ArmBlockInstruction & instruction);
+        void arm_opcode_swap(const ArmBlockInstruction & instruction);
+
+        void thumb_opcode_move_shifted_register(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_add_subtract(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_move_compare_add_subtract(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_alu_operations(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_hi_register_operations_branch_exchange(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_pc_relative_load(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_load_store_register_offset(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_load_store_sign_extended_byte_halfword(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_load_store_immediate_offset(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_load_store_halfword(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_sp_relative_load_store(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_load_address(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_add_offset_to_stack_pointer(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_push_pop_registers(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_multiple_load_store(const ThumbBlockInstruction & instruction);
+
+        void thumb_opcode_conditional_branch(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_software_interrupt(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_unconditional_branch(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_long_branch_with_link(const ThumbBlockInstruction & instruction);
+        void thumb_opcode_undefined_instruction(const ThumbBlockInstruction & instruction);
         
         void emulate_software_interrupt(Word opcode);
+
+        // IntrWait returns to interrupt_wait_return once one of the flags is set.
+        bool interrupt_wait = false;
+        Word interrupt_wait_return;
+        HalfWord interrupt_wait_flags;
+        bool check_interrupt_wait();
     public:
         ARM7TDMI();
 
@@ -95,23 +193,75 @@ typedef struct ARM7TDMI {
         IrqManager irq_manager;
         int runs = 0;
         
-        Word read_word_from_memory(Word address);
-        HalfWord read_halfword_from_memory(Word address);
+        Word read_word_from_memory(Word address) {
+            if (address < 0x10000000) {
+                return memory.read_word_from_memory(address);
+            } else {
+                return read_register(REGISTER_PC) + 8;
+            }
+        }
+        HalfWord read_halfword_from_memory(Word address) {
+            return memory.read_halfword_from_memory(address);
+        }
 
-        void write_word_to_memory(Word address, Word value);
-        void write_halfword_to_memory(Word address, HalfWord value);
+        void write_word_to_memory(Word address, Word value) {
+            memory.write_word_to_memory(address, value);
+        }
+        void write_halfword_to_memory(Word address, HalfWord value) {
+            memory.write_halfword_to_memory(address, value);
+        }
 
-        Word read_register(int register_number);
-        void write_register(int register_number, Word register_value);
+        Word read_register(int register_number) {
+            return register_file.registers[register_number];
+        }
+        void write_register(int register_number, Word register_value) {
+            if (register_number == REGISTER_PC) {
+                register_value = register_value & (~1);
+            }
+            register_file.registers[register_number] = register_value;
+        }
 
         bool condition_field(int condition_code);
         bool is_priviledged();
         // Exception Functions
         void run_exception(Exception exception_type);
-        void start_interrupt(Interrupt interrupt);
+        // Requests only set IF, a pending IRQ is entered at the start of
+        // the next block.
+        void request_interrupt(Interrupt interrupt);
+        void enter_interrupt();
         void return_from_interrupt();
         
+        // Cycles run since the scheduler last collected them. Code fetches
+        // are charged by the run loops, data accesses and internal cycles
+        // by the handlers.
+        int cycles = 0;
+        int fetch_cycles = 0; // A sequential fetch in the running block
+        void add_data_cycles(Word address, AccessWidth width, AccessType type) {
+            cycles += memory.data_access_cycles[type][width][(address >> 24) & 0xF];
+        }
+        void add_internal_cycles(int count) {
+            cycles += count;
+        }
+        void refill_pipeline();
+        static int multiply_cycles(Word multiplier, bool signed_multiply);
+
         void run_next_opcode();
+        int run_next_block(int max_cycles);
+        bool use_jit = false;
+        void flush_block_cache();
+
+        // An idle loop is skipped once it has gone round twice without a
+        // scheduled event in between. Addresses have the state in bit 0.
+        bool detect_idle_loops = true;
+        Word idle_loop_override = IDLE_LOOP_NONE;
+        Word idle_loop_armed = IDLE_LOOP_NONE;
+        bool idle_loop_reached = false;
+        void load_idle_loop_override();
+
+        // Set by Halt, IntrWait and VBlankIntrWait, no instructions run until
+        // an enabled interrupt is requested.
+        bool halted = false;
+        void wake_on_interrupt();
 
         void skip_bios();
 } ARM7TDMI;
@@ -0,0 +1,277 @@
+#include <string.h>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+#include "src/cpu/cpu.h"
+#include "src/cpu/opcodes/opcode_types.h"
+
+// Loops the heuristic misses, found by hand. The loop address has bit 0 set
+// for THUMB code, the same as a BX target.
+typedef struct IdleLoopOverride {
+    char game_code[4]; // Game pak header 0xAC
+    Word loop_address;
+} IdleLoopOverride;
+
+static const std::vector<IdleLoopOverride> idle_loop_overrides = {
+};
+
+// Registers are bits 0-15, the flags follow.
+#define USE_N (1 << 16)
+#define USE_Z (1 << 17)
+#define USE_C (1 << 18)
+#define USE_V (1 << 19)
+#define USE_NZ (USE_N | USE_Z)
+#define USE_NZCV (USE_N | USE_Z | USE_C | USE_V)
+
+typedef struct RegisterUse {
+    Word read;
+    Word written;
+    bool allowed; // Only reads memory and doesn't move the PC
+} RegisterUse;
+
+static Word condition_flags(Byte condition)
+{
+    static const Word flags[0x10] = {
+        USE_Z, USE_Z, USE_C, USE_C, USE_N, USE_N, USE_V, USE_V,
+        USE_C | USE_Z, USE_C | USE_Z, USE_N | USE_V, USE_N | USE_V,
+        USE_NZ | USE_V, USE_NZ | USE_V, 0, 0
+    };
+    return flags[condition];
+}
+
+static Word bit(int register_number)
+{
+    return 1 << register_number;
+}
+
+static RegisterUse thumb_register_use(ThumbOpcodeType opcode_type, HalfWord opcode)
+{
+    Byte low_0 = Utils::read_bit_range(opcode, 0, 2);
+    Byte low_3 = Utils::read_bit_range(opcode, 3, 5);
+    Byte low_6 = Utils::read_bit_range(opcode, 6, 8);
+    Byte high_8 = Utils::read_bit_range(opcode, 8, 10);
+    bool load = Utils::read_bit(opcode, 11);
+
+    switch (opcode_type)
+    {
+        case MOVE_SHIFTED_REGISTER: {
+            // LSL #0 keeps the carry
+            bool keeps_carry = Utils::read_bit_range(opcode, 11, 12) == 0 && Utils::read_bit_range(opcode, 6, 10) == 0;
+            return {bit(low_3), bit(low_0) | USE_NZ | (keeps_carry ? 0 : USE_C), true};
+        }
+        case ADD_SUBTRACT: {
+            bool immediate = Utils::read_bit(opcode, 10);
+            return {bit(low_3) | (immediate ? 0 : bit(low_6)), bit(low_0) | USE_NZCV, true};
+        }
+        case MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE:
+            switch (Utils::read_bit_range(opcode, 11, 12)) {
+                case 0: return {0, bit(high_8) | USE_NZ, true}; // MOV
+                case 1: return {bit(high_8), USE_NZCV, true}; // CMP
+                default: return {bit(high_8), bit(high_8) | USE_NZCV, true}; // ADD, SUB
+            }
+        case ALU_OPERATION: {
+            Word operands = bit(low_0) | bit(low_3);
+            switch (Utils::read_bit_range(opcode, 6, 9)) {
+                case 0x2: case 0x3: case 0x4: case 0x7: // Register shifts, a shift of 0 keeps the carry
+                    return {operands | USE_C, bit(low_0) | USE_NZ | USE_C, true};
+                case 0x5: case 0x6: // ADC, SBC
+                    return {operands | USE_C, bit(low_0) | USE_NZCV, true};
+                case 0x8: // TST
+                    return {operands, USE_NZ, true};
+                case 0x9: // NEG
+                    return {bit(low_3), bit(low_0) | USE_NZCV, true};
+                case 0xA: case 0xB: // CMP, CMN
+                    return {operands, USE_NZCV, true};
+                case 0xD: // MUL
+                    return {operands, bit(low_0) | USE_NZ | USE_C, true};
+                case 0xF: // MVN
+                    return {bit(low_3), bit(low_0) | USE_NZ, true};
+                default: // AND, EOR, ORR, BIC
+                    return {operands, bit(low_0) | USE_NZ, true};
+            }
+        }
+        case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE: {
+            Byte sub_opcode = Utils::read_bit_range(opcode, 8, 9);
+            Byte source = low_3 | (Utils::read_bit(opcode, 6) << 3);
+            Byte destination = low_0 | (Utils::read_bit(opcode, 7) << 3);
+            if (sub_opcode == 3 || (sub_opcode != 1 && destination == REGISTER_PC)) {
+                break;
+            }
+            switch (sub_opcode) {
+                case 0: return {bit(destination) | bit(source), bit(destination), true}; // ADD
+                case 1: return {bit(destination) | bit(source), USE_NZCV, true}; // CMP
+                default: return {bit(source), bit(destination), true}; // MOV
+            }
+        }
+        case PC_RELATIVE_LOAD:
+            return {0, bit(high_8), true};
+        case LOAD_STORE_REGISTER_OFFSET:
+            return {bit(low_3) | bit(low_6), bit(low_0), load};
+        case LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD:
+            // H = 0 and S = 0 is STRH
+            return {bit(low_3) | bit(low_6), bit(low_0), Utils::read_bit_range(opcode, 10, 11) != 0};
+        case LOAD_STORE_IMMEDIATE_OFFSET:
+        case LOAD_STORE_HALFWORD:
+            return {bit(low_3), bit(low_0), load};
+        case SP_RELATIVE_LOAD_STORE:
+            return {bit(REGISTER_SP), bit(high_8), load};
+        case LOAD_ADDRESS:
+            return {load ? bit(REGISTER_SP) : 0, bit(high_8), true};
+        default:
+            break;
+    }
+    return {0, 0, false};
+}
+
+static RegisterUse arm_register_use(ArmOpcodeType opcode_type, Word opcode)
+{
+    Byte rn = Utils::read_bit_range(opcode, 16, 19);
+    Byte rd = Utils::read_bit_range(opcode, 12, 15);
+    Byte rm = Utils::read_bit_range(opcode, 0, 3);
+    bool immediate = Utils::read_bit(opcode, 25);
+    RegisterUse use = {0, 0, false};
+
+    switch (opcode_type)
+    {
+        case ALU: {
+            if (rd == REGISTER_PC) {
+                break;
+            }
+            Byte alu_opcode = Utils::read_bit_range(opcode, 21, 24);
+            bool set_condition_codes = Utils::read_bit(opcode, 20);
+            bool logical = (alu_opcode <= 0x1) || (alu_opcode >= 0x8 && alu_opcode <= 0x9) || alu_opcode >= 0xC;
+            bool compare = alu_opcode >= 0x8 && alu_opcode <= 0xB;
+            bool register_shift = !immediate && Utils::read_bit(opcode, 4);
+
+            use.allowed = true;
+            if (alu_opcode != 0xD && alu_opcode != 0xF) {use.read |= bit(rn);} // MOV and MVN have no Rn
+            if (!immediate) {use.read |= bit(rm);}
+            if (register_shift) {use.read |= bit(Utils::read_bit_range(opcode, 8, 11));}
+            if (alu_opcode >= 0x5 && alu_opcode <= 0x7) {use.read |= USE_C;} // ADC, SBC, RSC
+            if (!compare) {use.written |= bit(rd);}
+
+            if (set_condition_codes && !logical) {
+                use.written |= USE_NZCV;
+            } else if (set_condition_codes) {
+                // The shifter carry, kept by a rotate or shift of 0
+                bool keeps_carry = immediate
+                    ? Utils::read_bit_range(opcode, 8, 11) == 0
+                    : !register_shift && Utils::read_bit_range(opcode, 4, 11) == 0;
+                use.written |= USE_NZ | (keeps_carry ? 0 : USE_C);
+                if (register_shift) {use.read |= USE_C;}
+            }
+            if (!immediate && Utils::read_bit_range(opcode, 4, 6) == 0b110 && Utils::read_bit_range(opcode, 7, 11) == 0) {
+                use.read |= USE_C; // RRX
+            }
+            break;
+        }
+        case SINGLE_DATA_TRANSFER: {
+            bool load = Utils::read_bit(opcode, 20);
+            bool pre_index = Utils::read_bit(opcode, 24);
+            bool write_back = Utils::read_bit(opcode, 21);
+            if (!load || !pre_index || write_back || rd == REGISTER_PC) {
+                break;
+            }
+            bool register_offset = immediate; // The I bit is inverted for single data transfers
+            use = {bit(rn) | (register_offset ? bit(rm) : 0), bit(rd), true};
+            break;
+        }
+        case HALF_WORD_SIGNED_DATA_TRANSFER: {
+            bool load = Utils::read_bit(opcode, 20);
+            bool pre_index = Utils::read_bit(opcode, 24);
+            bool write_back = Utils::read_bit(opcode, 21);
+            bool immediate_offset = Utils::read_bit(opcode, 22);
+            if (!load || !pre_index || write_back || rd == REGISTER_PC) {
+                break;
+            }
+            use = {bit(rn) | (immediate_offset ? 0 : bit(rm)), bit(rd), true};
+            break;
+        }
+        default:
+            break;
+    }
+    return use;
+}
+
+// An idle loop branches back to its own start, only reads memory, and keeps
+// nothing from one pass to the next. Nothing but a scheduled event can then
+// change what the next pass sees, so every pass up to it runs the same way.
+// Which addresses are read is only known once it runs, reads of I/O that
+// can change between events stop the skip then (see read_io_halfword).
+bool ARM7TDMI::is_idle_loop(CachedBlock * block, Word pc, CPUState state)
+{
+    size_t block_length = state == STATE_ARM ? block->arm_instructions.size() : block->thumb_instructions.size();
+    Word read_before_written = 0;
+    Word written = 0;
+
+    for (size_t i = 0; i < block_length; i++) {
+        Word address = pc + i * (state == STATE_ARM ? 4 : 2);
+        bool last = i == block_length - 1;
+        RegisterUse use;
+
+        if (state == STATE_ARM) {
+            ArmBlockInstruction & instruction = block->arm_instructions[i];
+            ArmOpcodeType opcode_type = decode_opcode_arm(instruction.opcode);
+
+            if (last) {
+                bool link = Utils::read_bit(instruction.opcode, 24);
+                Word target = address + 8 + Utils::sign_extend(Utils::read_bit_range(instruction.opcode, 0, 23) << 2, 26);
+                read_before_written |= condition_flags(instruction.condition) & ~written;
+                return opcode_type == BRANCH && !link && target == pc && (read_before_written & written) == 0;
+            }
+
+            use = arm_register_use(opcode_type, instruction.opcode);
+            if (instruction.condition != 0xE) {
+                // Skipped instructions leave their destination as it was
+                use.read |= condition_flags(instruction.condition) | use.written;
+            }
+        } else {
+            ThumbBlockInstruction & instruction = block->thumb_instructions[i];
+            if (instruction.handler == &ARM7TDMI::thumb_opcode_undefined_instruction) {
+                return false;
+            }
+            ThumbOpcodeType opcode_type = decode_opcode_thumb(instruction.opcode);
+
+            if (last) {
+                Word target;
+                Word flags = 0;
+                if (opcode_type == CONDITIONAL_BRANCH) {
+                    Byte condition = Utils::read_bit_range(instruction.opcode, 8, 11);
+                    target = address + 4 + Utils::sign_extend(Utils::read_bit_range(instruction.opcode, 0, 7) << 1, 9);
+                    flags = condition_flags(condition);
+                } else if (opcode_type == UNCONDITIONAL_BRANCH) {
+                    target = address + 4 + Utils::sign_extend(Utils::read_bit_range(instruction.opcode, 0, 10) << 1, 12);
+                } else {
+                    return false;
+                }
+                read_before_written |= flags & ~written;
+                return target == pc && (read_before_written & written) == 0;
+            }
+
+            use = thumb_register_use(opcode_type, instruction.opcode);
+        }
+
+        if (!use.allowed) {
+            return false;
+        }
+        read_before_written |= use.read & ~written & ~bit(REGISTER_PC);
+        written |= use.written;
+    }
+
+    return false;
+}
+
+void ARM7TDMI::load_idle_loop_override()
+{
+    idle_loop_override = IDLE_LOOP_NONE;
+    if (memory.game_pak_rom_size < 0xB0) {
+        return;
+    }
+    for (const IdleLoopOverride & loop_override : idle_loop_overrides) {
+        if (memcmp(loop_override.game_code, &memory.game_pak_rom[0xAC], sizeof(loop_override.game_code)) == 0) {
+            idle_loop_override = loop_override.loop_address;
+            SDL_Log("Idle loop override: %08x", idle_loop_override);
+        }
+    }
+}
@@ -6,20 +6,48 @@ interrupt_enables(&memory->io_registers[0x200], 0, 15),
 interrupt_info(&memory->io_registers[0x202], 0, 15),
 interrupt_master_enable(&memory->io_registers[0x208], 0) 
 {
-    memory->addressable_regions.push_back(Memory::AddressableRegion(
-        0x04000202, 1, 
-        [](Word current_value, Word writed_value){
-            return current_value = current_value & (~writed_value);
+    memory->set_io_register_hook(INTERRUPT_ENABLE_ADDRESS, nullptr,
+        [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+            IrqManager * irq_manager = (IrqManager *)context;
+            irq_manager->interrupt_enables.set((current_value & ~mask) | (written_value & mask));
+            irq_manager->update_irq_line();
+            return irq_manager->interrupt_enables.get();
         },
-        [](Word current_value){
-            return current_value;
-        }
-    ));
+        this
+    );
+    // IF bits are cleared by writing 1 to them.
+    memory->set_io_register_hook(INTERRUPT_FLAGS_ADDRESS, nullptr,
+        [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+            IrqManager * irq_manager = (IrqManager *)context;
+            irq_manager->interrupt_info.set(current_value & ~(written_value & mask));
+            irq_manager->update_irq_line();
+            return irq_manager->interrupt_info.get();
+        },
+        this
+    );
+    memory->set_io_register_hook(INTERRUPT_MASTER_ENABLE_ADDRESS, nullptr,
+        [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+            IrqManager * irq_manager = (IrqManager *)context;
+            HalfWord value = (current_value & ~mask) | (written_value & mask);
+            irq_manager->set_master_enable(value & 1);
+            return value;
+        },
+        this
+    );
+}
+
+void IrqManager::update_irq_line() {
+    interrupt_requested = (interrupt_enables.get() & interrupt_info.get()) != 0;
+    irq_pending = interrupt_requested && interrupt_master_enable.get();
 }
 
+// Flags are set whether or not the interrupt is enabled.
 void IrqManager::start_interrupt(Interrupt interrupt) {
-    Word interrupt_enabled = interrupt_enables.get() & (1 << interrupt);
-    if (interrupt_enabled == 0 || interrupt_master_enable.get() == 0) {return;}
-    // if (true) {return;}
     interrupt_info.set(interrupt_info.get() | (1 << interrupt));
-}
\ No newline at end of file
+    update_irq_line();
+}
+
+void IrqManager::set_master_enable(bool enabled) {
+    interrupt_master_enable.set(enabled);
+    update_irq_line();
+}
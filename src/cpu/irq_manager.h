@@ -20,6 +20,10 @@ enum Interrupt {
     INTERRUPT_CARTRIDGE,
 };
 
+#define INTERRUPT_ENABLE_ADDRESS 0x04000200
+#define INTERRUPT_FLAGS_ADDRESS 0x04000202
+#define INTERRUPT_MASTER_ENABLE_ADDRESS 0x04000208
+
 typedef struct IrqManager {
     IrqManager(Memory * memory);
 
@@ -27,7 +31,14 @@ typedef struct IrqManager {
     BitRegion interrupt_info;    
     BitRegion interrupt_master_enable;
 
+    // Worked out again only when IE, IF or IME change, the CPU checks
+    // irq_pending between blocks.
+    bool interrupt_requested = false; // IE & IF, wakes a halted CPU
+    bool irq_pending = false; // And IME
+    void update_irq_line();
+
     void start_interrupt(Interrupt interrupt_type);
+    void set_master_enable(bool enabled);
 } IrqManager;
 
 
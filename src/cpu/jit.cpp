@@ -0,0 +1,1370 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+#include "src/cpu/cpu.h"
+#include "src/cpu/jit.h"
+#include "src/cpu/opcodes/opcode_types.h"
+#include "src/cpu/opcodes/arm/data_processing.h"
+#include "src/cpu/opcodes/arm/single_data_transfer.h"
+#include "src/cpu/opcodes/arm/half_word_signed_data_transfer.h"
+
+JitCodeCache::JitCodeCache() : code(nullptr), used(0), full(false), flags_routine(nullptr), slots(nullptr), slots_used(0), write_start(nullptr), write_size(0)
+{
+#if defined(__x86_64__)
+    void * memory = mmap(nullptr, JIT_CODE_CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void * slot_memory = mmap(nullptr, JIT_LINK_SLOT_COUNT * sizeof(Byte *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED && slot_memory != MAP_FAILED) {
+        code = (Byte *)memory;
+        slots = (Byte **)slot_memory;
+    } else {
+        if (memory != MAP_FAILED) {munmap(memory, JIT_CODE_CACHE_SIZE);}
+        if (slot_memory != MAP_FAILED) {munmap(slot_memory, JIT_LINK_SLOT_COUNT * sizeof(Byte *));}
+    }
+#endif
+}
+
+JitCodeCache::~JitCodeCache()
+{
+    if (code != nullptr) {
+        munmap(code, JIT_CODE_CACHE_SIZE);
+        munmap(slots, JIT_LINK_SLOT_COUNT * sizeof(Byte *));
+    }
+}
+
+bool JitCodeCache::available()
+{
+    return code != nullptr;
+}
+
+bool JitCodeCache::has_space()
+{
+    return used + JIT_MAX_BLOCK_CODE_SIZE <= JIT_CODE_CACHE_SIZE
+        && slots_used + JIT_MAX_BLOCK_LINK_SLOTS <= JIT_LINK_SLOT_COUNT;
+}
+
+void JitCodeCache::reset()
+{
+    used = 0;
+    full = false;
+    flags_routine = nullptr;
+    slots_used = 0;
+    linkable_blocks.clear();
+    link_slots.clear();
+}
+
+bool JitCodeCache::begin_write()
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start = used & ~(page_size - 1);
+    size_t end = (used + JIT_MAX_BLOCK_CODE_SIZE + page_size - 1) & ~(page_size - 1);
+    if (end > JIT_CODE_CACHE_SIZE) {
+        end = JIT_CODE_CACHE_SIZE;
+    }
+
+    if (mprotect(&code[start], end - start, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    write_start = &code[start];
+    write_size = end - start;
+    return true;
+}
+
+void JitCodeCache::end_write()
+{
+    if (mprotect(write_start, write_size, PROT_READ | PROT_EXEC) != 0) {
+        SDL_Log("JIT: code cache could not be made executable");
+        SDL_assert(false);
+    }
+}
+
+Byte ** JitCodeCache::create_link_slot(Word target_key)
+{
+    Byte ** slot = &slots[slots_used++];
+
+    auto linked_block = linkable_blocks.find(target_key);
+    *slot = linked_block != linkable_blocks.end() ? linked_block->second : nullptr;
+    if (*slot == nullptr) {
+        link_slots.insert({target_key, slot});
+    }
+    return slot;
+}
+
+void JitCodeCache::add_linkable_block(Word key, Byte * body)
+{
+    linkable_blocks[key] = body;
+
+    auto slots = link_slots.equal_range(key);
+    for (auto slot = slots.first; slot != slots.second; slot++) {
+        *slot->second = body;
+    }
+    link_slots.erase(key);
+}
+
+void JitCodeCache::emit_byte(Byte value)
+{
+    code[used++] = value;
+}
+
+void JitCodeCache::emit_word(Word value)
+{
+    memcpy(&code[used], &value, sizeof(value));
+    used += sizeof(value);
+}
+
+void JitCodeCache::emit_pointer(const void * value)
+{
+    memcpy(&code[used], &value, sizeof(value));
+    used += sizeof(value);
+}
+
+Byte * JitCodeCache::position()
+{
+    return &code[used];
+}
+
+void JitCodeCache::patch_relative_jump(Byte * rel32_position, Byte * target)
+{
+    int32_t offset = target - (rel32_position + 4);
+    memcpy(rel32_position, &offset, sizeof(offset));
+}
+
+void ARM7TDMI::jit_run_arm_instruction(ARM7TDMI * cpu, const ArmBlockInstruction * instruction)
+{
+    (cpu->*instruction->handler)(*instruction);
+}
+
+void ARM7TDMI::jit_run_thumb_instruction(ARM7TDMI * cpu, const ThumbBlockInstruction * instruction)
+{
+    (cpu->*instruction->handler)(*instruction);
+}
+
+void ARM7TDMI::jit_refill_pipeline(ARM7TDMI * cpu)
+{
+    cpu->refill_pipeline();
+}
+
+#if defined(__x86_64__)
+
+static_assert(MAX_BLOCK_LENGTH + 1 <= JIT_MAX_BLOCK_LINK_SLOTS, "a block can need a link slot per instruction and one to fall through");
+static_assert(sizeof(LazyCarryOverflow) == 4, "lazy_cv is written as a dword");
+static_assert(sizeof(Memory::MemoryPage) == 24, "pages are indexed as index * 3 * 8");
+
+// Register use: rbx = cpu, r12d = instructions run, r13d = max cycles.
+// eax, ecx, edx, esi and edi are free within an instruction.
+enum HostRegister {
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    EBX = 3,
+    ESI = 6,
+    EDI = 7
+};
+
+// op r/m32, r32 opcodes
+enum {
+    X86_ADD = 0x01,
+    X86_OR = 0x09,
+    X86_ADC = 0x11,
+    X86_SBB = 0x19,
+    X86_AND = 0x21,
+    X86_SUB = 0x29,
+    X86_XOR = 0x31,
+    X86_TEST = 0x85,
+    X86_STORE = 0x89,
+    X86_LOAD = 0x8B
+};
+
+// ModRM reg field of the 0x81 (ALU with immediate), 0xC1 (shift) and 0xF7 groups
+enum {
+    X86_IMMEDIATE_ADD = 0,
+    X86_IMMEDIATE_OR = 1,
+    X86_IMMEDIATE_AND = 4,
+    X86_IMMEDIATE_SUB = 5,
+    X86_IMMEDIATE_CMP = 7,
+
+    X86_SHIFT_ROR = 1,
+    X86_SHIFT_SHL = 4,
+    X86_SHIFT_SHR = 5,
+    X86_SHIFT_SAR = 7,
+
+    X86_NOT = 2
+};
+
+// Second byte of jcc rel32
+enum {
+    X86_JAE = 0x83,
+    X86_JE = 0x84,
+    X86_JNE = 0x85,
+    X86_JGE = 0x8D
+};
+
+// op reg, [rbx + offset] or op [rbx + offset], reg
+static void emit_cpu_operand(JitCodeCache * jit, Byte opcode, Byte reg, int32_t offset)
+{
+    jit->emit_byte(opcode);
+    jit->emit_byte(0x80 | (reg << 3) | EBX);
+    jit->emit_word(offset);
+}
+
+// op dword [rbx + offset], imm32 from the 0x81 group
+static void emit_cpu_immediate(JitCodeCache * jit, Byte extension, int32_t offset, Word value)
+{
+    emit_cpu_operand(jit, 0x81, extension, offset);
+    jit->emit_word(value);
+}
+
+static void emit_cpu_store_immediate(JitCodeCache * jit, int32_t offset, Word value)
+{
+    emit_cpu_operand(jit, 0xC7, 0, offset); // mov dword [rbx + offset], imm32
+    jit->emit_word(value);
+}
+
+static void emit_cpu_compare_byte_zero(JitCodeCache * jit, int32_t offset)
+{
+    emit_cpu_operand(jit, 0x80, X86_IMMEDIATE_CMP, offset); // cmp byte [rbx + offset], 0
+    jit->emit_byte(0x00);
+}
+
+// op destination, source
+static void emit_register_register(JitCodeCache * jit, Byte opcode, Byte destination, Byte source)
+{
+    jit->emit_byte(opcode);
+    jit->emit_byte(0xC0 | (source << 3) | destination);
+}
+
+static void emit_register_immediate(JitCodeCache * jit, Byte extension, Byte reg, Word value)
+{
+    jit->emit_byte(0x81);
+    jit->emit_byte(0xC0 | (extension << 3) | reg);
+    jit->emit_word(value);
+}
+
+static void emit_shift(JitCodeCache * jit, Byte extension, Byte reg, Byte amount)
+{
+    jit->emit_byte(0xC1);
+    jit->emit_byte(0xC0 | (extension << 3) | reg);
+    jit->emit_byte(amount);
+}
+
+static void emit_not(JitCodeCache * jit, Byte reg)
+{
+    jit->emit_byte(0xF7);
+    jit->emit_byte(0xC0 | (X86_NOT << 3) | reg);
+}
+
+static void emit_move_immediate(JitCodeCache * jit, Byte reg, Word value)
+{
+    jit->emit_byte(0xB8 + reg); // mov reg, imm32
+    jit->emit_word(value);
+}
+
+// movzx reg, byte [rbx + offset]
+static void emit_cpu_load_byte(JitCodeCache * jit, Byte reg, int32_t offset)
+{
+    jit->emit_byte(0x0F);
+    emit_cpu_operand(jit, 0xB6, reg, offset);
+}
+
+// movzx reg, byte [rbx + index + offset]
+static void emit_load_table_byte(JitCodeCache * jit, Byte reg, Byte index, int32_t offset)
+{
+    jit->emit_byte(0x0F); jit->emit_byte(0xB6);
+    jit->emit_byte(0x84 | (reg << 3));
+    jit->emit_byte((index << 3) | EBX);
+    jit->emit_word(offset);
+}
+
+static void emit_jump_if(JitCodeCache * jit, Byte condition_opcode, std::vector<Byte *> * patches)
+{
+    jit->emit_byte(0x0F); jit->emit_byte(condition_opcode); // jcc rel32
+    patches->push_back(jit->position());
+    jit->emit_word(0);
+}
+
+static void emit_jump(JitCodeCache * jit, std::vector<Byte *> * patches)
+{
+    jit->emit_byte(0xE9); // jmp rel32
+    patches->push_back(jit->position());
+    jit->emit_word(0);
+}
+
+static void patch_jumps(JitCodeCache * jit, std::vector<Byte *> * patches)
+{
+    for (Byte * patch : *patches) {
+        jit->patch_relative_jump(patch, jit->position());
+    }
+    patches->clear();
+}
+
+// Arguments other than the CPU go in esi, edx and ecx first.
+static void emit_call(JitCodeCache * jit, const void * function)
+{
+    jit->emit_byte(0x48); jit->emit_byte(0x89); jit->emit_byte(0xDF); // mov rdi, rbx
+    jit->emit_byte(0x48); jit->emit_byte(0xB8); jit->emit_pointer(function); // mov rax, function
+    jit->emit_byte(0xFF); jit->emit_byte(0xD0); // call rax
+}
+
+static bool is_linkable_address(Word address)
+{
+    return address >= GAMEPAK_ROM_START && address < 0x0E000000;
+}
+
+static bool condition_passes(Byte condition, bool n, bool z, bool c, bool v)
+{
+    switch (condition) {
+        case 0x0: return z;
+        case 0x1: return !z;
+        case 0x2: return c;
+        case 0x3: return !c;
+        case 0x4: return n;
+        case 0x5: return !n;
+        case 0x6: return v;
+        case 0x7: return !v;
+        case 0x8: return c && !z;
+        case 0x9: return !c || z;
+        case 0xA: return n == v;
+        case 0xB: return n != v;
+        case 0xC: return !z && n == v;
+        case 0xD: return z || n != v;
+        case 0xE: return true;
+        default: return false;
+    }
+}
+
+enum JitAccessSize {
+    JIT_ACCESS_WORD,
+    JIT_ACCESS_HALFWORD,
+    JIT_ACCESS_BYTE
+};
+
+// Where the shifter carry out of a logical operation comes from.
+enum JitShifterCarry {
+    JIT_CARRY_UNCHANGED,
+    JIT_CARRY_CLEAR,
+    JIT_CARRY_SET,
+    JIT_CARRY_FROM_SHIFT
+};
+
+// A data processing operation with an immediate or an immediate shifted
+// register operand. THUMB ALU instructions are described as the ARM one
+// that sets the same registers and flags.
+typedef struct JitDataProcessing {
+    OpcodeDataProcess::InstructionType operation;
+    bool set_flags;
+    Byte rd;
+    Byte rn;
+    Byte rm;
+    bool immediate_operand;
+    Word immediate;
+    bool immediate_rotated; // The carry out is bit 31 of the immediate
+    OpcodeDataProcess::BitShiftType shift_type;
+    Byte shift_amount; // As encoded, LSR and ASR #0 shift by 32. ROR #0 (RRX) isn't compiled.
+    Word pc_value; // Read in place of the PC
+} JitDataProcessing;
+
+// Offsets from the CPU of everything compiled code touches.
+typedef struct JitOffsets {
+    int32_t registers;
+    int32_t cycles;
+    int32_t fetch_cycles;
+    int32_t code_page_written;
+    int32_t irq_pending;
+    int32_t psr_bits;
+    int32_t lazy_result;
+    int32_t lazy_op1;
+    int32_t lazy_op2;
+    int32_t lazy_nz;
+    int32_t lazy_cv;
+    int32_t pages;
+    int32_t data_access_cycles;
+    int32_t code_fetch_cycles;
+} JitOffsets;
+
+typedef struct JitBlockCompiler {
+    JitCodeCache * jit;
+    JitOffsets offsets;
+    CPUState state;
+    Word block_pc;
+    bool idle_loop;
+    Word idle_loop_override;
+
+    Word stored_pc; // What the PC holds in memory here, kept up to date only before calls and exits
+    std::vector<Byte *> return_patches;
+    std::vector<std::pair<Word, Byte *>> exits; // Jumps out that store the PC first
+
+    int32_t register_offset(Byte reg) {
+        return offsets.registers + reg * 4;
+    }
+
+    void emit_load_register(Byte host, Byte reg, Word pc_value) {
+        if (reg == REGISTER_PC) {
+            emit_move_immediate(jit, host, pc_value);
+        } else {
+            emit_cpu_operand(jit, X86_LOAD, host, register_offset(reg));
+        }
+    }
+
+    void emit_store_register(Byte reg, Byte host) {
+        emit_cpu_operand(jit, X86_STORE, host, register_offset(reg));
+    }
+
+    void emit_sync_pc(Word address) {
+        if (stored_pc != address) {
+            emit_cpu_store_immediate(jit, register_offset(REGISTER_PC), address);
+            stored_pc = address;
+        }
+    }
+
+    void emit_exit_if(Byte condition_opcode, Word pc) {
+        jit->emit_byte(0x0F); jit->emit_byte(condition_opcode); // jcc rel32
+        exits.push_back({pc, jit->position()});
+        jit->emit_word(0);
+    }
+
+    void emit_call_flags_routine() {
+        jit->emit_byte(0xE8); // call rel32
+        jit->patch_relative_jump(jit->position(), jit->flags_routine);
+        jit->used += 4;
+    }
+
+    // Follows ProgramStatusRegister::n() to v(), a subtraction is an
+    // addition of the inverted second operand for both C and V.
+    void emit_flags_routine() {
+        std::vector<Byte *> nz_done;
+        std::vector<Byte *> done;
+        std::vector<Byte *> add;
+
+        jit->flags_routine = jit->position();
+        emit_cpu_operand(jit, X86_LOAD, EAX, offsets.psr_bits);
+        emit_cpu_compare_byte_zero(jit, offsets.lazy_nz);
+        emit_jump_if(jit, X86_JE, &nz_done);
+        emit_register_immediate(jit, X86_IMMEDIATE_AND, EAX, 0x3FFFFFFF);
+        emit_cpu_operand(jit, X86_LOAD, EDX, offsets.lazy_result);
+        emit_register_register(jit, X86_STORE, ECX, EDX); // mov ecx, edx
+        emit_register_immediate(jit, X86_IMMEDIATE_AND, ECX, 0x80000000);
+        emit_register_register(jit, X86_OR, EAX, ECX);
+        emit_register_register(jit, X86_TEST, EDX, EDX);
+        emit_jump_if(jit, X86_JNE, &nz_done);
+        emit_register_immediate(jit, X86_IMMEDIATE_OR, EAX, 0x40000000);
+        patch_jumps(jit, &nz_done);
+
+        emit_cpu_operand(jit, X86_LOAD, ECX, offsets.lazy_cv);
+        emit_register_register(jit, X86_TEST, ECX, ECX);
+        emit_jump_if(jit, X86_JE, &done);
+        emit_register_immediate(jit, X86_IMMEDIATE_AND, EAX, 0xC0000000);
+        emit_cpu_operand(jit, X86_LOAD, ESI, offsets.lazy_op1);
+        emit_cpu_operand(jit, X86_LOAD, EDI, offsets.lazy_op2);
+        emit_register_immediate(jit, X86_IMMEDIATE_CMP, ECX, LAZY_CV_ADD);
+        emit_jump_if(jit, X86_JE, &add);
+        emit_not(jit, EDI);
+        patch_jumps(jit, &add);
+
+        // V = ~(op1 ^ op2) & (op1 ^ result)
+        emit_register_register(jit, X86_STORE, ECX, ESI);
+        emit_register_register(jit, X86_XOR, ECX, EDI);
+        emit_not(jit, ECX);
+        emit_cpu_operand(jit, X86_LOAD, EDX, offsets.lazy_result);
+        emit_register_register(jit, X86_XOR, EDX, ESI);
+        emit_register_register(jit, X86_AND, ECX, EDX);
+        emit_shift(jit, X86_SHIFT_SHR, ECX, 31);
+        emit_shift(jit, X86_SHIFT_SHL, ECX, PSR_V_BIT);
+        emit_register_register(jit, X86_OR, EAX, ECX);
+
+        // C = (op1 & op2) | ((op1 | op2) & ~result)
+        emit_cpu_operand(jit, X86_LOAD, EDX, offsets.lazy_result);
+        emit_not(jit, EDX);
+        emit_register_register(jit, X86_STORE, ECX, ESI);
+        emit_register_register(jit, X86_OR, ECX, EDI);
+        emit_register_register(jit, X86_AND, ECX, EDX);
+        emit_register_register(jit, X86_AND, ESI, EDI);
+        emit_register_register(jit, X86_OR, ECX, ESI);
+        emit_shift(jit, X86_SHIFT_SHR, ECX, 31);
+        emit_shift(jit, X86_SHIFT_SHL, ECX, PSR_C_BIT);
+        emit_register_register(jit, X86_OR, EAX, ECX);
+        patch_jumps(jit, &done);
+
+        emit_shift(jit, X86_SHIFT_SHR, EAX, PSR_V_BIT);
+        jit->emit_byte(0xC3); // ret
+    }
+
+    // Jumps to skip_patches when the condition fails.
+    void emit_condition(Byte condition, std::vector<Byte *> * skip_patches) {
+        if (condition == 0xE) {
+            return;
+        }
+        if (condition == 0xF) {
+            emit_jump(jit, skip_patches);
+            return;
+        }
+
+        Word passing = 0;
+        for (int nzcv = 0; nzcv < 0x10; nzcv++) {
+            if (condition_passes(condition, nzcv & 8, nzcv & 4, nzcv & 2, nzcv & 1)) {
+                passing |= 1 << nzcv;
+            }
+        }
+
+        emit_call_flags_routine();
+        emit_move_immediate(jit, ECX, passing);
+        jit->emit_byte(0x0F); jit->emit_byte(0xA3); jit->emit_byte(0xC1); // bt ecx, eax
+        emit_jump_if(jit, X86_JAE, skip_patches); // jnc skip
+    }
+
+    // ProgramStatusRegister::resolve_cv
+    void emit_resolve_cv() {
+        std::vector<Byte *> done;
+        emit_cpu_immediate(jit, X86_IMMEDIATE_CMP, offsets.lazy_cv, LAZY_CV_NONE);
+        emit_jump_if(jit, X86_JE, &done);
+        emit_call_flags_routine();
+        emit_cpu_immediate(jit, X86_IMMEDIATE_AND, offsets.psr_bits, ~((1u << PSR_C_BIT) | (1u << PSR_V_BIT)));
+        jit->emit_byte(0x83); jit->emit_byte(0xE0); jit->emit_byte(0x03); // and eax, 3
+        emit_shift(jit, X86_SHIFT_SHL, EAX, PSR_V_BIT);
+        emit_cpu_operand(jit, X86_OR, EAX, offsets.psr_bits);
+        emit_cpu_store_immediate(jit, offsets.lazy_cv, LAZY_CV_NONE);
+        patch_jumps(jit, &done);
+    }
+
+    // Shifts reg by an immediate as the barrel shifter does, leaving the
+    // carry out in CF.
+    void emit_barrel_shift(Byte reg, OpcodeDataProcess::BitShiftType shift_type, Byte shift_amount) {
+        switch (shift_type) {
+            case OpcodeDataProcess::LSL:
+                emit_shift(jit, X86_SHIFT_SHL, reg, shift_amount);
+                break;
+            case OpcodeDataProcess::LSR:
+                if (shift_amount == 0) { // LSR #32
+                    emit_shift(jit, X86_SHIFT_SHL, reg, 1);
+                    emit_move_immediate(jit, reg, 0);
+                } else {
+                    emit_shift(jit, X86_SHIFT_SHR, reg, shift_amount);
+                }
+                break;
+            case OpcodeDataProcess::ASR:
+                if (shift_amount == 0) { // ASR #32
+                    emit_shift(jit, X86_SHIFT_SAR, reg, 31);
+                    jit->emit_byte(0x0F); jit->emit_byte(0xBA); jit->emit_byte(0xE0 | reg); jit->emit_byte(0); // bt reg, 0
+                } else {
+                    emit_shift(jit, X86_SHIFT_SAR, reg, shift_amount);
+                }
+                break;
+            case OpcodeDataProcess::ROR:
+                emit_shift(jit, X86_SHIFT_ROR, reg, shift_amount);
+                break;
+        }
+    }
+
+    // Follows arm_opcode_data_processing, op1 is kept in eax and op2 in ecx.
+    void emit_data_processing(const JitDataProcessing & op) {
+        bool logical =
+            op.operation == OpcodeDataProcess::AND || op.operation == OpcodeDataProcess::EOR ||
+            op.operation == OpcodeDataProcess::TST || op.operation == OpcodeDataProcess::TEQ ||
+            op.operation == OpcodeDataProcess::ORR || op.operation == OpcodeDataProcess::MOV ||
+            op.operation == OpcodeDataProcess::BIC || op.operation == OpcodeDataProcess::MVN;
+        bool write_result =
+            op.operation != OpcodeDataProcess::TST && op.operation != OpcodeDataProcess::TEQ &&
+            op.operation != OpcodeDataProcess::CMP && op.operation != OpcodeDataProcess::CMN;
+        bool carry_in =
+            op.operation == OpcodeDataProcess::ADC || op.operation == OpcodeDataProcess::SBC ||
+            op.operation == OpcodeDataProcess::RSC;
+        bool reverse = op.operation == OpcodeDataProcess::RSB || op.operation == OpcodeDataProcess::RSC;
+
+        if (op.set_flags && logical) {
+            emit_resolve_cv();
+        }
+        if (carry_in) {
+            emit_call_flags_routine();
+            emit_register_register(jit, X86_STORE, EDX, EAX); // mov edx, eax
+        }
+
+        JitShifterCarry carry = JIT_CARRY_UNCHANGED;
+        if (op.immediate_operand) {
+            emit_move_immediate(jit, ECX, op.immediate);
+            if (op.immediate_rotated) {
+                carry = op.immediate >> 31 ? JIT_CARRY_SET : JIT_CARRY_CLEAR;
+            }
+        } else {
+            emit_load_register(ECX, op.rm, op.pc_value);
+            if (op.shift_amount != 0 || op.shift_type != OpcodeDataProcess::LSL) {
+                emit_barrel_shift(ECX, op.shift_type, op.shift_amount);
+                carry = JIT_CARRY_FROM_SHIFT;
+                if (op.set_flags && logical) {
+                    jit->emit_byte(0x0F); jit->emit_byte(0x92); jit->emit_byte(0xC2); // setc dl
+                }
+            }
+        }
+
+        if (op.operation != OpcodeDataProcess::MOV && op.operation != OpcodeDataProcess::MVN) {
+            emit_load_register(EAX, op.rn, op.pc_value);
+        }
+
+        if (op.set_flags && !logical) {
+            emit_cpu_operand(jit, X86_STORE, reverse ? ECX : EAX, offsets.lazy_op1);
+            emit_cpu_operand(jit, X86_STORE, reverse ? EAX : ECX, offsets.lazy_op2);
+        }
+
+        switch (op.operation) {
+            case OpcodeDataProcess::AND:
+            case OpcodeDataProcess::TST:
+                emit_register_register(jit, X86_AND, EAX, ECX);
+                break;
+            case OpcodeDataProcess::EOR:
+            case OpcodeDataProcess::TEQ:
+                emit_register_register(jit, X86_XOR, EAX, ECX);
+                break;
+            case OpcodeDataProcess::ORR:
+                emit_register_register(jit, X86_OR, EAX, ECX);
+                break;
+            case OpcodeDataProcess::BIC:
+                emit_not(jit, ECX);
+                emit_register_register(jit, X86_AND, EAX, ECX);
+                break;
+            case OpcodeDataProcess::MOV:
+                emit_register_register(jit, X86_STORE, EAX, ECX); // mov eax, ecx
+                break;
+            case OpcodeDataProcess::MVN:
+                emit_register_register(jit, X86_STORE, EAX, ECX);
+                emit_not(jit, EAX);
+                break;
+            case OpcodeDataProcess::SUB:
+            case OpcodeDataProcess::CMP:
+                emit_register_register(jit, X86_SUB, EAX, ECX);
+                break;
+            case OpcodeDataProcess::ADD:
+            case OpcodeDataProcess::CMN:
+                emit_register_register(jit, X86_ADD, EAX, ECX);
+                break;
+            case OpcodeDataProcess::RSB:
+                emit_register_register(jit, X86_SUB, ECX, EAX);
+                emit_register_register(jit, X86_STORE, EAX, ECX);
+                break;
+            case OpcodeDataProcess::ADC:
+                jit->emit_byte(0x0F); jit->emit_byte(0xBA); jit->emit_byte(0xE2); jit->emit_byte(1); // bt edx, 1 (C)
+                emit_register_register(jit, X86_ADC, EAX, ECX);
+                break;
+            case OpcodeDataProcess::SBC:
+                jit->emit_byte(0x0F); jit->emit_byte(0xBA); jit->emit_byte(0xE2); jit->emit_byte(1);
+                jit->emit_byte(0xF5); // cmc, x86 borrows where ARM clears C
+                emit_register_register(jit, X86_SBB, EAX, ECX);
+                break;
+            case OpcodeDataProcess::RSC:
+                jit->emit_byte(0x0F); jit->emit_byte(0xBA); jit->emit_byte(0xE2); jit->emit_byte(1);
+                jit->emit_byte(0xF5);
+                emit_register_register(jit, X86_SBB, ECX, EAX);
+                emit_register_register(jit, X86_STORE, EAX, ECX);
+                break;
+        }
+
+        if (op.set_flags) {
+            emit_cpu_operand(jit, X86_STORE, EAX, offsets.lazy_result);
+            emit_cpu_operand(jit, 0xC6, 0, offsets.lazy_nz); jit->emit_byte(1); // mov byte [rbx + lazy_nz], 1
+
+            if (!logical) {
+                bool add = op.operation == OpcodeDataProcess::ADD || op.operation == OpcodeDataProcess::ADC || op.operation == OpcodeDataProcess::CMN;
+                emit_cpu_store_immediate(jit, offsets.lazy_cv, add ? LAZY_CV_ADD : LAZY_CV_SUBTRACT);
+            } else if (carry == JIT_CARRY_SET) {
+                emit_cpu_immediate(jit, X86_IMMEDIATE_OR, offsets.psr_bits, 1u << PSR_C_BIT);
+            } else if (carry == JIT_CARRY_CLEAR) {
+                emit_cpu_immediate(jit, X86_IMMEDIATE_AND, offsets.psr_bits, ~(1u << PSR_C_BIT));
+            } else if (carry == JIT_CARRY_FROM_SHIFT) {
+                emit_cpu_immediate(jit, X86_IMMEDIATE_AND, offsets.psr_bits, ~(1u << PSR_C_BIT));
+                jit->emit_byte(0x0F); jit->emit_byte(0xB6); jit->emit_byte(0xD2); // movzx edx, dl
+                emit_shift(jit, X86_SHIFT_SHL, EDX, PSR_C_BIT);
+                emit_cpu_operand(jit, X86_OR, EDX, offsets.psr_bits);
+            }
+        }
+
+        if (write_result) {
+            emit_store_register(op.rd, EAX);
+        }
+    }
+
+    // Looks up the host page of the address in ecx, leaving the page's
+    // memory in rsi and the offset into it in edi, or jumps to slow_patches.
+    void emit_page_lookup(size_t pointer_offset, JitAccessSize size, std::vector<Byte *> * slow_patches) {
+        emit_register_immediate(jit, X86_IMMEDIATE_CMP, ECX, 0x10000000);
+        emit_jump_if(jit, X86_JAE, slow_patches);
+        emit_register_register(jit, X86_STORE, EDX, ECX); // mov edx, ecx
+        emit_shift(jit, X86_SHIFT_SHR, EDX, MEMORY_PAGE_SHIFT);
+        jit->emit_byte(0x48); jit->emit_byte(0x8D); jit->emit_byte(0x14); jit->emit_byte(0x52); // lea rdx, [rdx + rdx * 2]
+        jit->emit_byte(0x48); jit->emit_byte(0x8B); jit->emit_byte(0xB4); jit->emit_byte(0xD3); // mov rsi, [rbx + rdx * 8 + pointer]
+        jit->emit_word(offsets.pages + pointer_offset);
+        jit->emit_byte(0x48); jit->emit_byte(0x85); jit->emit_byte(0xF6); // test rsi, rsi
+        emit_jump_if(jit, X86_JE, slow_patches);
+        jit->emit_byte(0x8B); jit->emit_byte(0xBC); jit->emit_byte(0xD3); // mov edi, [rbx + rdx * 8 + mask]
+        jit->emit_word(offsets.pages + offsetof(Memory::MemoryPage, mask));
+        emit_register_register(jit, X86_AND, EDI, ECX);
+        if (size == JIT_ACCESS_WORD) {
+            jit->emit_byte(0x83); jit->emit_byte(0xE7); jit->emit_byte(0xFC); // and edi, ~3
+        } else if (size == JIT_ACCESS_HALFWORD) {
+            jit->emit_byte(0x83); jit->emit_byte(0xE7); jit->emit_byte(0xFE); // and edi, ~1
+        }
+    }
+
+    // ARM7TDMI::add_data_cycles for a nonsequential access at ecx
+    void emit_data_cycles(JitAccessSize size) {
+        AccessWidth width = size == JIT_ACCESS_WORD ? ACCESS_32 : ACCESS_16;
+        emit_register_register(jit, X86_STORE, EDX, ECX);
+        emit_shift(jit, X86_SHIFT_SHR, EDX, 24);
+        jit->emit_byte(0x83); jit->emit_byte(0xE2); jit->emit_byte(0x0F); // and edx, 0xF
+        emit_load_table_byte(jit, EDX, EDX, offsets.data_access_cycles + (ACCESS_NONSEQUENTIAL * 2 + width) * 0x10);
+        emit_cpu_operand(jit, X86_ADD, EDX, offsets.cycles);
+    }
+
+    // Loads from the address in ecx into rd, as OpcodeSingleDataTransfer::load
+    // and OpcodeHalfWordSignedDataTransfer::load do for LDRH.
+    void emit_load(JitAccessSize size, Byte rd) {
+        std::vector<Byte *> slow_patches;
+        std::vector<Byte *> done_patches;
+
+        emit_page_lookup(offsetof(Memory::MemoryPage, read), size, &slow_patches);
+        emit_data_cycles(size);
+        emit_cpu_operand(jit, 0x83, X86_IMMEDIATE_ADD, offsets.cycles); jit->emit_byte(1); // add dword [rbx + cycles], 1
+
+        if (size == JIT_ACCESS_BYTE) {
+            jit->emit_byte(0x0F); jit->emit_byte(0xB6); jit->emit_byte(0x04); jit->emit_byte(0x3E); // movzx eax, byte [rsi + rdi]
+        } else {
+            if (size == JIT_ACCESS_WORD) {
+                jit->emit_byte(0x8B); jit->emit_byte(0x04); jit->emit_byte(0x3E); // mov eax, [rsi + rdi]
+                jit->emit_byte(0x83); jit->emit_byte(0xE1); jit->emit_byte(0x03); // and ecx, 3
+            } else {
+                jit->emit_byte(0x0F); jit->emit_byte(0xB7); jit->emit_byte(0x04); jit->emit_byte(0x3E); // movzx eax, word [rsi + rdi]
+                jit->emit_byte(0x83); jit->emit_byte(0xE1); jit->emit_byte(0x01); // and ecx, 1
+            }
+            // Misaligned loads rotate
+            emit_shift(jit, X86_SHIFT_SHL, ECX, 3);
+            jit->emit_byte(0xD3); jit->emit_byte(0xC8); // ror eax, cl
+        }
+        emit_store_register(rd, EAX);
+        emit_jump(jit, &done_patches);
+
+        patch_jumps(jit, &slow_patches);
+        emit_register_register(jit, X86_STORE, ESI, ECX); // mov esi, ecx
+        emit_move_immediate(jit, EDX, rd);
+        if (size == JIT_ACCESS_HALFWORD) {
+            emit_move_immediate(jit, ECX, OpcodeHalfWordSignedDataTransfer::UNSIGNED_HALFWORD);
+            emit_call(jit, (const void *)static_cast<void (*)(ARM7TDMI *, Word, Byte, OpcodeHalfWordSignedDataTransfer::DataType)>(&OpcodeHalfWordSignedDataTransfer::load));
+        } else {
+            emit_move_immediate(jit, ECX, size == JIT_ACCESS_BYTE);
+            emit_call(jit, (const void *)static_cast<void (*)(ARM7TDMI *, Word, Byte, bool)>(&OpcodeSingleDataTransfer::load));
+        }
+        patch_jumps(jit, &done_patches);
+    }
+
+    // Stores eax to the address in ecx, as OpcodeSingleDataTransfer::store
+    // and OpcodeHalfWordSignedDataTransfer::store do. Only the slow path
+    // can write over cached code.
+    void emit_store(JitAccessSize size, Word next_address) {
+        std::vector<Byte *> slow_patches;
+        std::vector<Byte *> done_patches;
+
+        emit_page_lookup(offsetof(Memory::MemoryPage, write), size, &slow_patches);
+        emit_data_cycles(size);
+        if (size == JIT_ACCESS_WORD) {
+            jit->emit_byte(0x89); jit->emit_byte(0x04); jit->emit_byte(0x3E); // mov [rsi + rdi], eax
+        } else if (size == JIT_ACCESS_HALFWORD) {
+            jit->emit_byte(0x66); jit->emit_byte(0x89); jit->emit_byte(0x04); jit->emit_byte(0x3E); // mov [rsi + rdi], ax
+        } else {
+            jit->emit_byte(0x88); jit->emit_byte(0x04); jit->emit_byte(0x3E); // mov [rsi + rdi], al
+        }
+        emit_jump(jit, &done_patches);
+
+        patch_jumps(jit, &slow_patches);
+        emit_register_register(jit, X86_STORE, EDX, EAX); // mov edx, eax
+        emit_register_register(jit, X86_STORE, ESI, ECX); // mov esi, ecx
+        if (size == JIT_ACCESS_HALFWORD) {
+            emit_call(jit, (const void *)&OpcodeHalfWordSignedDataTransfer::store);
+        } else {
+            emit_move_immediate(jit, ECX, size == JIT_ACCESS_BYTE);
+            emit_call(jit, (const void *)&OpcodeSingleDataTransfer::store);
+        }
+        emit_cpu_compare_byte_zero(jit, offsets.code_page_written);
+        emit_exit_if(X86_JNE, next_address);
+        patch_jumps(jit, &done_patches);
+    }
+
+    // Signed loads are rare enough to always go through the handler's load.
+    void emit_signed_load(OpcodeHalfWordSignedDataTransfer::DataType data_type, Byte rd) {
+        emit_register_register(jit, X86_STORE, ESI, ECX);
+        emit_move_immediate(jit, EDX, rd);
+        emit_move_immediate(jit, ECX, data_type);
+        emit_call(jit, (const void *)static_cast<void (*)(ARM7TDMI *, Word, Byte, OpcodeHalfWordSignedDataTransfer::DataType)>(&OpcodeHalfWordSignedDataTransfer::load));
+    }
+
+    // Jumps to the compiled block at target once it exists, otherwise returns.
+    // The PC has to hold target already.
+    void emit_link_or_return(Word target) {
+        // Idle loops go back through run_next_block each time round so they can be skipped.
+        bool idle_loop_branch = (idle_loop && target == block_pc) || (target | state) == idle_loop_override;
+        if (!is_linkable_address(target) || idle_loop_branch) {
+            emit_jump(jit, &return_patches);
+            return;
+        }
+
+        AccessWidth width = state == STATE_ARM ? ACCESS_32 : ACCESS_16;
+        Byte ** slot = jit->create_link_slot(target | state);
+
+        emit_cpu_compare_byte_zero(jit, offsets.code_page_written);
+        emit_jump_if(jit, X86_JNE, &return_patches);
+        // run_next_block takes pending IRQs between blocks
+        emit_cpu_compare_byte_zero(jit, offsets.irq_pending);
+        emit_jump_if(jit, X86_JNE, &return_patches);
+        jit->emit_byte(0x48); jit->emit_byte(0xB8); jit->emit_pointer(slot); // mov rax, slot
+        jit->emit_byte(0x48); jit->emit_byte(0x8B); jit->emit_byte(0x00); // mov rax, [rax]
+        jit->emit_byte(0x48); jit->emit_byte(0x85); jit->emit_byte(0xC0); // test rax, rax
+        emit_jump_if(jit, X86_JE, &return_patches);
+        // As run_next_block sets it for the block
+        emit_cpu_load_byte(jit, ECX, offsets.code_fetch_cycles + (ACCESS_SEQUENTIAL * 2 + width) * 0x10 + ((target >> 24) & 0xF));
+        emit_cpu_operand(jit, X86_STORE, ECX, offsets.fetch_cycles);
+        jit->emit_byte(0xFF); jit->emit_byte(0xE0); // jmp rax
+    }
+
+    // A branch to a target known when compiling: ARM7TDMI::refill_pipeline,
+    // then on to the target.
+    void emit_branch(Word target) {
+        AccessWidth width = state == STATE_ARM ? ACCESS_32 : ACCESS_16;
+        int32_t fetch_offset = offsets.code_fetch_cycles + width * 0x10 + ((target >> 24) & 0xF);
+
+        emit_cpu_store_immediate(jit, register_offset(REGISTER_PC), target);
+        emit_cpu_load_byte(jit, EAX, fetch_offset + ACCESS_NONSEQUENTIAL * 0x20);
+        emit_cpu_load_byte(jit, ECX, fetch_offset + ACCESS_SEQUENTIAL * 0x20);
+        emit_register_register(jit, X86_ADD, EAX, ECX);
+        emit_cpu_operand(jit, X86_ADD, EAX, offsets.cycles);
+        emit_link_or_return(target);
+    }
+
+    // Runs the interpreter's handler, leaving the block as run_next_block
+    // does if it moved the PC or wrote over cached code.
+    void emit_fallback(const void * instruction, const void * function, Word address, Word next_address) {
+        std::vector<Byte *> continue_patches;
+
+        jit->emit_byte(0x48); jit->emit_byte(0xBE); jit->emit_pointer(instruction); // mov rsi, instruction
+        emit_call(jit, function);
+        emit_cpu_immediate(jit, X86_IMMEDIATE_CMP, register_offset(REGISTER_PC), address);
+        emit_jump_if(jit, X86_JE, &continue_patches);
+        emit_call(jit, (const void *)&ARM7TDMI::jit_refill_pipeline);
+        emit_jump(jit, &return_patches);
+
+        patch_jumps(jit, &continue_patches);
+        emit_cpu_compare_byte_zero(jit, offsets.code_page_written);
+        emit_exit_if(X86_JNE, next_address);
+    }
+
+    // Applies the offset (edx, or an immediate) to the base in ecx as
+    // DataTransfer::calculate_address does, leaving the address in ecx.
+    void emit_transfer_address(bool pre_index, bool up, bool write_back, Byte rn, bool register_offset, Word immediate) {
+        Byte target = pre_index ? ECX : ESI;
+        if (!pre_index) {
+            emit_register_register(jit, X86_STORE, ESI, ECX); // mov esi, ecx
+        }
+
+        if (register_offset) {
+            emit_register_register(jit, up ? X86_ADD : X86_SUB, target, EDX);
+        } else if (immediate != 0) {
+            emit_register_immediate(jit, up ? X86_IMMEDIATE_ADD : X86_IMMEDIATE_SUB, target, immediate);
+        }
+
+        if (!pre_index || write_back) {
+            emit_store_register(rn, target);
+        }
+    }
+
+    // What emit_arm can compile, the rest goes through emit_fallback.
+    static bool arm_is_native(const ARM7TDMI::ArmBlockInstruction & instruction, ArmOpcodeType type) {
+        Word opcode = instruction.opcode;
+        bool pre_index = Utils::read_bit(opcode, 24);
+        bool write_back = Utils::read_bit(opcode, 21);
+        bool load = Utils::read_bit(opcode, 20);
+        bool rotate_extended = ((opcode >> 5) & 3) == OpcodeDataProcess::ROR && instruction.shift_amount == 0;
+        // Post-indexed writeback restores the base, and a PC base can't be written back.
+        bool simple_transfer = !(load && instruction.rd == REGISTER_PC)
+            && (pre_index || !write_back)
+            && !(instruction.rn == REGISTER_PC && (write_back || !pre_index));
+
+        switch (type) {
+            case BRANCH:
+                return true;
+            case ALU: {
+                bool immediate = Utils::read_bit(opcode, 25);
+                bool shift_by_register = !immediate && Utils::read_bit(opcode, 4);
+                return instruction.rd != REGISTER_PC && !shift_by_register && (immediate || !rotate_extended);
+            }
+            case SINGLE_DATA_TRANSFER:
+                return simple_transfer && !(Utils::read_bit(opcode, 25) && rotate_extended);
+            case HALF_WORD_SIGNED_DATA_TRANSFER: {
+                bool s = Utils::read_bit(opcode, 6);
+                bool h = Utils::read_bit(opcode, 5);
+                return simple_transfer && (load ? (s || h) : (!s && h));
+            }
+            default:
+                return false;
+        }
+    }
+
+    void emit_arm(const ARM7TDMI::ArmBlockInstruction & instruction, ArmOpcodeType type, Word address) {
+        Word opcode = instruction.opcode;
+        Word next_address = address + 4;
+
+        switch (type) {
+            case BRANCH: {
+                Word target = address + 8 + instruction.immediate;
+                if (Utils::read_bit(opcode, 24)) { // Link
+                    emit_cpu_store_immediate(jit, register_offset(REGISTER_LR), address + 4);
+                }
+                // A branch to itself leaves the PC where it was, so it runs on as in run_next_block.
+                if (target != address) {
+                    emit_branch(target);
+                }
+                break;
+            }
+            case ALU: {
+                bool immediate = Utils::read_bit(opcode, 25);
+                JitDataProcessing op = {
+                    (OpcodeDataProcess::InstructionType)((opcode >> 21) & 0xF),
+                    Utils::read_bit(opcode, 20),
+                    instruction.rd,
+                    instruction.rn,
+                    instruction.rm,
+                    immediate,
+                    instruction.immediate,
+                    immediate && instruction.shift_amount != 0,
+                    (OpcodeDataProcess::BitShiftType)((opcode >> 5) & 3),
+                    instruction.shift_amount,
+                    address + 8
+                };
+                emit_data_processing(op);
+                break;
+            }
+            case SINGLE_DATA_TRANSFER: {
+                bool register_offset = Utils::read_bit(opcode, 25);
+                bool load = Utils::read_bit(opcode, 20);
+                OpcodeDataProcess::BitShiftType shift_type = (OpcodeDataProcess::BitShiftType)((opcode >> 5) & 3);
+
+                if (!load) {
+                    emit_load_register(EAX, instruction.rd, address + 12);
+                }
+                emit_load_register(ECX, instruction.rn, address + 8);
+                if (register_offset) {
+                    emit_load_register(EDX, instruction.rm, address);
+                    if (instruction.shift_amount != 0 || shift_type != OpcodeDataProcess::LSL) {
+                        emit_barrel_shift(EDX, shift_type, instruction.shift_amount);
+                    }
+                }
+                emit_transfer_address(Utils::read_bit(opcode, 24), Utils::read_bit(opcode, 23), Utils::read_bit(opcode, 21), instruction.rn, register_offset, instruction.immediate);
+
+                JitAccessSize size = Utils::read_bit(opcode, 22) ? JIT_ACCESS_BYTE : JIT_ACCESS_WORD;
+                if (load) {
+                    emit_load(size, instruction.rd);
+                } else {
+                    emit_store(size, next_address);
+                }
+                break;
+            }
+            case HALF_WORD_SIGNED_DATA_TRANSFER: {
+                bool register_offset = !Utils::read_bit(opcode, 22);
+                bool load = Utils::read_bit(opcode, 20);
+
+                if (!load) {
+                    emit_load_register(EAX, instruction.rd, address + 12);
+                }
+                emit_load_register(ECX, instruction.rn, address + 8);
+                if (register_offset) {
+                    emit_load_register(EDX, instruction.rm, address);
+                }
+                emit_transfer_address(Utils::read_bit(opcode, 24), Utils::read_bit(opcode, 23), Utils::read_bit(opcode, 21), instruction.rn, register_offset, instruction.immediate);
+
+                OpcodeHalfWordSignedDataTransfer::DataType data_type = (OpcodeHalfWordSignedDataTransfer::DataType)((opcode >> 5) & 3);
+                if (!load) {
+                    emit_store(JIT_ACCESS_HALFWORD, next_address);
+                } else if (data_type == OpcodeHalfWordSignedDataTransfer::UNSIGNED_HALFWORD) {
+                    emit_load(JIT_ACCESS_HALFWORD, instruction.rd);
+                } else {
+                    emit_signed_load(data_type, instruction.rd);
+                }
+                break;
+            }
+            default:
+                SDL_assert(false);
+                break;
+        }
+    }
+
+    static bool thumb_is_native(const ARM7TDMI::ThumbBlockInstruction & instruction, ThumbOpcodeType type) {
+        switch (type) {
+            case MOVE_SHIFTED_REGISTER:
+            case ADD_SUBTRACT:
+            case MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE:
+            case PC_RELATIVE_LOAD:
+            case LOAD_STORE_REGISTER_OFFSET:
+            case LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD:
+            case LOAD_STORE_IMMEDIATE_OFFSET:
+            case LOAD_STORE_HALFWORD:
+            case SP_RELATIVE_LOAD_STORE:
+            case LOAD_ADDRESS:
+            case ADD_OFFSET_TO_STACK_POINTER:
+            case CONDITIONAL_BRANCH:
+            case UNCONDITIONAL_BRANCH:
+            case LONG_BRANCH_WITH_LINK:
+                return true;
+            case ALU_OPERATION: {
+                // Register shifts and MUL aren't compiled
+                Byte sub_opcode = (instruction.opcode >> 6) & 0xF;
+                return sub_opcode != 0x2 && sub_opcode != 0x3 && sub_opcode != 0x4 && sub_opcode != 0x7 && sub_opcode != 0xD;
+            }
+            case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE: {
+                Byte sub_opcode = (instruction.opcode >> 8) & 0x3;
+                return sub_opcode == 1 || (sub_opcode != 3 && instruction.rd != REGISTER_PC);
+            }
+            default:
+                return false;
+        }
+    }
+
+    static bool thumb_accesses_memory(ThumbOpcodeType type) {
+        return type == PC_RELATIVE_LOAD
+            || type == LOAD_STORE_REGISTER_OFFSET
+            || type == LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD
+            || type == LOAD_STORE_IMMEDIATE_OFFSET
+            || type == LOAD_STORE_HALFWORD
+            || type == SP_RELATIVE_LOAD_STORE;
+    }
+
+    void emit_thumb(const ARM7TDMI::ThumbBlockInstruction & instruction, ThumbOpcodeType type, Word address) {
+        HalfWord opcode = instruction.opcode;
+        Word next_address = address + 2;
+        bool load = Utils::read_bit(opcode, 11);
+
+        switch (type) {
+            case MOVE_SHIFTED_REGISTER: {
+                JitDataProcessing op = {
+                    OpcodeDataProcess::MOV, true, instruction.rd, 0, instruction.rs, false, 0, false,
+                    (OpcodeDataProcess::BitShiftType)((opcode >> 11) & 3), (Byte)instruction.immediate, 0
+                };
+                emit_data_processing(op);
+                break;
+            }
+            case ADD_SUBTRACT: {
+                JitDataProcessing op = {
+                    Utils::read_bit(opcode, 9) ? OpcodeDataProcess::SUB : OpcodeDataProcess::ADD, true,
+                    instruction.rd, instruction.rs, instruction.rn, Utils::read_bit(opcode, 10), instruction.immediate, false,
+                    OpcodeDataProcess::LSL, 0, 0
+                };
+                emit_data_processing(op);
+                break;
+            }
+            case MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE: {
+                static const OpcodeDataProcess::InstructionType operations[4] = {
+                    OpcodeDataProcess::MOV, OpcodeDataProcess::CMP, OpcodeDataProcess::ADD, OpcodeDataProcess::SUB
+                };
+                JitDataProcessing op = {
+                    operations[(opcode >> 11) & 3], true, instruction.rd, instruction.rd, 0, true, instruction.immediate, false,
+                    OpcodeDataProcess::LSL, 0, 0
+                };
+                emit_data_processing(op);
+                break;
+            }
+            case ALU_OPERATION: {
+                // NEG is RSB from 0, the shifts and MUL are left out
+                static const OpcodeDataProcess::InstructionType operations[0x10] = {
+                    OpcodeDataProcess::AND, OpcodeDataProcess::EOR, OpcodeDataProcess::MOV, OpcodeDataProcess::MOV,
+                    OpcodeDataProcess::MOV, OpcodeDataProcess::ADC, OpcodeDataProcess::SBC, OpcodeDataProcess::MOV,
+                    OpcodeDataProcess::TST, OpcodeDataProcess::RSB, OpcodeDataProcess::CMP, OpcodeDataProcess::CMN,
+                    OpcodeDataProcess::ORR, OpcodeDataProcess::MOV, OpcodeDataProcess::BIC, OpcodeDataProcess::MVN
+                };
+                Byte sub_opcode = (opcode >> 6) & 0xF;
+                bool negate = sub_opcode == 0x9;
+                JitDataProcessing op = {
+                    operations[sub_opcode], true, instruction.rd, negate ? instruction.rs : instruction.rd, instruction.rs,
+                    negate, 0, false, OpcodeDataProcess::LSL, 0, 0
+                };
+                emit_data_processing(op);
+                break;
+            }
+            case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE: {
+                static const OpcodeDataProcess::InstructionType operations[3] = {
+                    OpcodeDataProcess::ADD, OpcodeDataProcess::CMP, OpcodeDataProcess::MOV
+                };
+                Byte sub_opcode = (opcode >> 8) & 0x3;
+                JitDataProcessing op = {
+                    operations[sub_opcode], sub_opcode == 1, instruction.rd, instruction.rd, instruction.rs, false, 0, false,
+                    OpcodeDataProcess::LSL, 0, (address + 4) & ~1u
+                };
+                emit_data_processing(op);
+                break;
+            }
+            case PC_RELATIVE_LOAD:
+                emit_move_immediate(jit, ECX, ((address + 4) & ~3u) + instruction.immediate);
+                emit_load(JIT_ACCESS_WORD, instruction.rd);
+                break;
+            case LOAD_STORE_REGISTER_OFFSET:
+            case LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD: {
+                emit_load_register(EAX, instruction.rd, 0);
+                emit_load_register(ECX, instruction.rs, 0);
+                emit_load_register(EDX, instruction.rn, 0);
+                emit_register_register(jit, X86_ADD, ECX, EDX);
+
+                if (type == LOAD_STORE_REGISTER_OFFSET) {
+                    JitAccessSize size = Utils::read_bit(opcode, 10) ? JIT_ACCESS_BYTE : JIT_ACCESS_WORD;
+                    if (load) {
+                        emit_load(size, instruction.rd);
+                    } else {
+                        emit_store(size, next_address);
+                    }
+                    break;
+                }
+
+                // H in bit 11, S in bit 10
+                OpcodeHalfWordSignedDataTransfer::DataType data_type = (OpcodeHalfWordSignedDataTransfer::DataType)((Utils::read_bit(opcode, 10) << 1) | load);
+                if ((int)data_type == 0) { // STRH
+                    emit_store(JIT_ACCESS_HALFWORD, next_address);
+                } else if (data_type == OpcodeHalfWordSignedDataTransfer::UNSIGNED_HALFWORD) {
+                    emit_load(JIT_ACCESS_HALFWORD, instruction.rd);
+                } else {
+                    emit_signed_load(data_type, instruction.rd);
+                }
+                break;
+            }
+            case LOAD_STORE_IMMEDIATE_OFFSET:
+            case LOAD_STORE_HALFWORD:
+            case SP_RELATIVE_LOAD_STORE: {
+                JitAccessSize size = JIT_ACCESS_WORD;
+                if (type == LOAD_STORE_HALFWORD) {
+                    size = JIT_ACCESS_HALFWORD;
+                } else if (type == LOAD_STORE_IMMEDIATE_OFFSET && Utils::read_bit(opcode, 12)) {
+                    size = JIT_ACCESS_BYTE;
+                }
+
+                emit_load_register(EAX, instruction.rd, 0);
+                emit_load_register(ECX, type == SP_RELATIVE_LOAD_STORE ? (Byte)REGISTER_SP : instruction.rs, 0);
+                if (instruction.immediate != 0) {
+                    emit_register_immediate(jit, X86_IMMEDIATE_ADD, ECX, instruction.immediate);
+                }
+                if (load) {
+                    emit_load(size, instruction.rd);
+                } else {
+                    emit_store(size, next_address);
+                }
+                break;
+            }
+            case LOAD_ADDRESS:
+                if (load) { // SP
+                    emit_load_register(EAX, REGISTER_SP, 0);
+                    emit_register_immediate(jit, X86_IMMEDIATE_ADD, EAX, instruction.immediate);
+                } else {
+                    emit_move_immediate(jit, EAX, ((address + 4) & ~3u) + instruction.immediate);
+                }
+                emit_store_register(instruction.rd, EAX);
+                break;
+            case ADD_OFFSET_TO_STACK_POINTER:
+                emit_cpu_immediate(jit, X86_IMMEDIATE_ADD, register_offset(REGISTER_SP), instruction.immediate);
+                break;
+            case CONDITIONAL_BRANCH:
+            case UNCONDITIONAL_BRANCH: {
+                Word target = address + 4 + instruction.immediate;
+                if (target != address) {
+                    emit_branch(target);
+                }
+                break;
+            }
+            case LONG_BRANCH_WITH_LINK: {
+                if (!load) { // First half
+                    emit_cpu_store_immediate(jit, register_offset(REGISTER_LR), address + 4 + instruction.immediate);
+                    break;
+                }
+
+                std::vector<Byte *> continue_patches;
+                emit_load_register(EAX, REGISTER_LR, 0);
+                emit_register_immediate(jit, X86_IMMEDIATE_ADD, EAX, instruction.immediate);
+                emit_register_immediate(jit, X86_IMMEDIATE_AND, EAX, ~1u);
+                emit_cpu_store_immediate(jit, register_offset(REGISTER_LR), next_address | 1);
+                emit_register_immediate(jit, X86_IMMEDIATE_CMP, EAX, address);
+                emit_jump_if(jit, X86_JE, &continue_patches);
+
+                // ARM7TDMI::refill_pipeline at a target only known when run
+                emit_store_register(REGISTER_PC, EAX);
+                emit_register_register(jit, X86_STORE, ECX, EAX);
+                emit_shift(jit, X86_SHIFT_SHR, ECX, 24);
+                jit->emit_byte(0x83); jit->emit_byte(0xE1); jit->emit_byte(0x0F); // and ecx, 0xF
+                emit_load_table_byte(jit, EDX, ECX, offsets.code_fetch_cycles + (ACCESS_NONSEQUENTIAL * 2 + ACCESS_16) * 0x10);
+                emit_load_table_byte(jit, ECX, ECX, offsets.code_fetch_cycles + (ACCESS_SEQUENTIAL * 2 + ACCESS_16) * 0x10);
+                emit_register_register(jit, X86_ADD, EDX, ECX);
+                emit_cpu_operand(jit, X86_ADD, EDX, offsets.cycles);
+                emit_jump(jit, &return_patches);
+                patch_jumps(jit, &continue_patches);
+                break;
+            }
+            default:
+                SDL_assert(false);
+                break;
+        }
+    }
+} JitBlockCompiler;
+
+// Mirrors run_next_block: each instruction is budget and condition checked,
+// then emitted natively or run through its handler with the same PC and
+// code write checks. The PC is only written back before calls and exits.
+JitCodeCache::CompiledBlock ARM7TDMI::compile_block(CachedBlock * block, Word pc, CPUState state)
+{
+    if (!jit.available()) {
+        return nullptr;
+    }
+    if (!jit.has_space()) {
+        jit.full = true;
+        return nullptr;
+    }
+    if (!jit.begin_write()) {
+        return nullptr;
+    }
+
+    JitBlockCompiler compiler;
+    compiler.jit = &jit;
+    compiler.offsets = {
+        (int32_t)((Byte *)&register_file.registers - (Byte *)this),
+        (int32_t)((Byte *)&cycles - (Byte *)this),
+        (int32_t)((Byte *)&fetch_cycles - (Byte *)this),
+        (int32_t)((Byte *)&memory.code_page_written - (Byte *)this),
+        (int32_t)((Byte *)&irq_manager.irq_pending - (Byte *)this),
+        (int32_t)((Byte *)&cpsr.bits - (Byte *)this),
+        (int32_t)((Byte *)&cpsr.lazy_result - (Byte *)this),
+        (int32_t)((Byte *)&cpsr.lazy_op1 - (Byte *)this),
+        (int32_t)((Byte *)&cpsr.lazy_op2 - (Byte *)this),
+        (int32_t)((Byte *)&cpsr.lazy_nz - (Byte *)this),
+        (int32_t)((Byte *)&cpsr.lazy_cv - (Byte *)this),
+        (int32_t)((Byte *)&memory.pages - (Byte *)this),
+        (int32_t)((Byte *)&memory.data_access_cycles - (Byte *)this),
+        (int32_t)((Byte *)&memory.code_fetch_cycles - (Byte *)this),
+    };
+    compiler.state = state;
+    compiler.block_pc = pc;
+    compiler.idle_loop = block->idle_loop;
+    compiler.idle_loop_override = idle_loop_override;
+    compiler.stored_pc = pc;
+
+    size_t start = jit.used;
+    if (jit.flags_routine == nullptr) {
+        compiler.emit_flags_routine();
+    }
+
+    Word instruction_size = state == STATE_ARM ? 4 : 2;
+    size_t block_length = state == STATE_ARM ? block->arm_instructions.size() : block->thumb_instructions.size();
+    bool falls_through = true;
+
+    Byte * entry = jit.position();
+    jit.emit_byte(0x53); // push rbx
+    jit.emit_byte(0x41); jit.emit_byte(0x54); // push r12
+    jit.emit_byte(0x41); jit.emit_byte(0x55); // push r13
+    jit.emit_byte(0x48); jit.emit_byte(0x89); jit.emit_byte(0xFB); // mov rbx, rdi
+    jit.emit_byte(0x41); jit.emit_byte(0x89); jit.emit_byte(0xF5); // mov r13d, esi
+    jit.emit_byte(0x45); jit.emit_byte(0x31); jit.emit_byte(0xE4); // xor r12d, r12d
+
+    Byte * body = jit.position();
+    Word address = pc;
+
+    for (size_t i = 0; i < block_length; i++) {
+        Word next_address = address + instruction_size;
+        Byte condition;
+        bool native;
+        bool calls;
+        bool ends_block;
+
+        if (state == STATE_ARM) {
+            ArmOpcodeType type = decode_opcode_arm(block->arm_instructions[i].opcode);
+            condition = block->arm_instructions[i].condition;
+            native = JitBlockCompiler::arm_is_native(block->arm_instructions[i], type);
+            calls = !native || type == SINGLE_DATA_TRANSFER || type == HALF_WORD_SIGNED_DATA_TRANSFER;
+            // MSR can change the state without moving the PC, SWIs can halt the CPU.
+            ends_block = type == PSR_TRANSFER || type == SWI;
+        } else {
+            ThumbOpcodeType type = decode_opcode_thumb(block->thumb_instructions[i].opcode);
+            condition = type == CONDITIONAL_BRANCH ? block->thumb_instructions[i].condition : 0xE;
+            native = JitBlockCompiler::thumb_is_native(block->thumb_instructions[i], type);
+            calls = !native || JitBlockCompiler::thumb_accesses_memory(type);
+            // SWIs can halt the CPU.
+            ends_block = type == SOFTWARE_INTERRUPT;
+        }
+
+        jit.emit_byte(0x44); jit.emit_byte(0x39); jit.emit_byte(0xAB); jit.emit_word(compiler.offsets.cycles); // cmp [rbx + cycles], r13d
+        compiler.emit_exit_if(X86_JGE, address);
+        jit.emit_byte(0x41); jit.emit_byte(0xFF); jit.emit_byte(0xC4); // inc r12d
+        emit_cpu_operand(&jit, X86_LOAD, EAX, compiler.offsets.fetch_cycles);
+        emit_cpu_operand(&jit, X86_ADD, EAX, compiler.offsets.cycles);
+
+        // Both paths past the condition have to agree on what the PC holds.
+        if (calls) {
+            compiler.emit_sync_pc(address);
+        }
+
+        std::vector<Byte *> skip_patches;
+        compiler.emit_condition(condition, &skip_patches);
+
+        if (state == STATE_ARM) {
+            ArmBlockInstruction & instruction = block->arm_instructions[i];
+            if (native) {
+                compiler.emit_arm(instruction, decode_opcode_arm(instruction.opcode), address);
+            } else {
+                compiler.emit_fallback(&instruction, (const void *)&ARM7TDMI::jit_run_arm_instruction, address, next_address);
+            }
+        } else {
+            ThumbBlockInstruction & instruction = block->thumb_instructions[i];
+            if (native) {
+                compiler.emit_thumb(instruction, decode_opcode_thumb(instruction.opcode), address);
+            } else {
+                compiler.emit_fallback(&instruction, (const void *)&ARM7TDMI::jit_run_thumb_instruction, address, next_address);
+            }
+        }
+
+        patch_jumps(&jit, &skip_patches);
+
+        if (ends_block) {
+            compiler.emit_sync_pc(next_address);
+            emit_jump(&jit, &compiler.return_patches);
+            falls_through = false;
+            break;
+        }
+        address = next_address;
+    }
+
+    if (falls_through) {
+        compiler.emit_sync_pc(address);
+        compiler.emit_link_or_return(address);
+    }
+
+    Byte * return_position = jit.position();
+    jit.emit_byte(0x44); jit.emit_byte(0x89); jit.emit_byte(0xE0); // mov eax, r12d
+    jit.emit_byte(0x41); jit.emit_byte(0x5D); // pop r13
+    jit.emit_byte(0x41); jit.emit_byte(0x5C); // pop r12
+    jit.emit_byte(0x5B); // pop rbx
+    jit.emit_byte(0xC3); // ret
+
+    for (auto & exit : compiler.exits) {
+        jit.patch_relative_jump(exit.second, jit.position());
+        emit_cpu_store_immediate(&jit, compiler.register_offset(REGISTER_PC), exit.first);
+        emit_jump(&jit, &compiler.return_patches);
+    }
+    for (Byte * patch : compiler.return_patches) {
+        jit.patch_relative_jump(patch, return_position);
+    }
+
+    SDL_assert(jit.used - start <= JIT_MAX_BLOCK_CODE_SIZE);
+    jit.end_write();
+
+    if (is_linkable_address(pc)) {
+        jit.add_linkable_block(pc | state, body);
+    }
+
+    return reinterpret_cast<JitCodeCache::CompiledBlock>(entry);
+}
+
+#else
+
+JitCodeCache::CompiledBlock ARM7TDMI::compile_block(CachedBlock * block, Word pc, CPUState state)
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef JIT_INCLUDED
+#define JIT_INCLUDED
+
+#include <stddef.h>
+#include <unordered_map>
+
+#include "cpu_types.h"
+
+#define JIT_CODE_CACHE_SIZE 0x01000000
+#define JIT_MAX_BLOCK_CODE_SIZE 0x8000
+#define JIT_LINK_SLOT_COUNT 0x40000
+#define JIT_MAX_BLOCK_LINK_SLOTS 0x80
+#define JIT_HOT_THRESHOLD 8
+
+struct ARM7TDMI;
+
+// Executable memory for blocks recompiled to x86-64. Data processing,
+// loads and stores and branches are emitted as native code working on the
+// register file and CPSR in place, anything else calls back into its
+// interpreter handler. The cache is only writable while a block is being
+// emitted and executable otherwise. Blocks are linked through slots kept
+// outside the cache, filled in once the block they lead to is compiled.
+typedef struct JitCodeCache {
+    JitCodeCache();
+    ~JitCodeCache();
+
+    // Returns the number of instructions run, stopping once the CPU's
+    // cycle count reaches max_cycles.
+    typedef int (*CompiledBlock)(ARM7TDMI * cpu, int max_cycles);
+
+    Byte * code;
+    size_t used;
+    bool full;
+
+    // Works the lazy flags out into NZCV (N in bit 3) in eax, shared by
+    // every block and emitted again after a reset.
+    Byte * flags_routine;
+
+    Byte ** slots;
+    size_t slots_used;
+
+    // Block bodies by start address (with the state in bit 0), only
+    // for blocks that can't be overwritten.
+    std::unordered_map<Word, Byte *> linkable_blocks;
+    std::unordered_multimap<Word, Byte **> link_slots;
+
+    bool available();
+    bool has_space();
+    void reset();
+
+    // Makes the next JIT_MAX_BLOCK_CODE_SIZE bytes writable, and
+    // executable again afterwards.
+    bool begin_write();
+    void end_write();
+
+    Byte ** create_link_slot(Word target_key);
+    void add_linkable_block(Word key, Byte * body);
+
+    void emit_byte(Byte value);
+    void emit_word(Word value);
+    void emit_pointer(const void * value);
+    Byte * position();
+    void patch_relative_jump(Byte * rel32_position, Byte * target);
+
+    private:
+        Byte * write_start;
+        size_t write_size;
+} JitCodeCache;
+
+#endif
@@ -52,9 +52,9 @@ void OpcodeBlockDataTransfer::run(ARM7TDMI * cpu) {
 
     bool pre_increment = this->u ? this->p : !this->p;
 
-    RegisterSet * target_register_set = cpu->current_register_set();
+    bool user_bank_transfer = false;
     if ((this->s == 1) && (!pc_in_transfer_list)) {
-        target_register_set = &cpu->registers_user;
+        user_bank_transfer = true;
         if (this->w == 1) {
             cpu->warn("Block Data Transfer - writeback and using user register bank");
         }
@@ -64,6 +64,11 @@ void OpcodeBlockDataTransfer::run(ARM7TDMI * cpu) {
         cpu->write_register(this->base_register, write_back_address);
     }
 
+    AccessType access_type = ACCESS_NONSEQUENTIAL;
+    if (this->l == 1) {
+        cpu->add_internal_cycles(1);
+    }
+
     for (int i = 0; i < 16; i++) {
         bool transfer_register = Utils::read_bit(this->register_list, i);
         if (!transfer_register) {continue;}
@@ -72,23 +77,33 @@ void OpcodeBlockDataTransfer::run(ARM7TDMI * cpu) {
             current_address += 4;
         }
 
+        cpu->add_data_cycles(current_address, ACCESS_32, access_type);
+        access_type = ACCESS_SEQUENTIAL;
+
         if (this->l == 0) { // Store | Register -> Memory
             bool stored_register_is_base_register = i == this->base_register;
             bool first_stored_register = Utils::read_bit_range(this->register_list, 0, i - 1) == 0;
             if (stored_register_is_base_register && first_stored_register) {
                 cpu->write_word_to_memory(current_address, base_address);
             } else {
-                Word register_value = *target_register_set->registers[i];
+                Word register_value = user_bank_transfer 
+                    ? cpu->read_user_register(i) 
+                    : cpu->read_register(i);
                 if (i == REGISTER_PC) {
-                    register_value += cpu->cpsr.t == STATE_ARM ? 12 : 6;
+                    register_value += cpu->cpsr.t() == STATE_ARM ? 12 : 6;
                 }
                 cpu->write_word_to_memory(current_address, register_value);
             }
         } else { // Load | Memory -> Register
             if (this->s == 1 && i == REGISTER_PC) {
-                cpu->cpsr.mode = cpu->current_register_set()->spsr.mode;
+                cpu->set_mode(cpu->current_spsr()->mode());
+            }
+            Word register_value = cpu->read_word_from_memory(current_address);
+            if (user_bank_transfer) {
+                cpu->write_user_register(i, register_value);
+            } else {
+                cpu->write_register(i, register_value);
             }
-            target_register_set->write_register(i, cpu->read_word_from_memory(current_address));
         }
 
         if (pre_increment == 0) {
@@ -11,8 +11,6 @@ typedef struct OpcodeBranchExchange
 
     unsigned int register_number : 4;
 
-    static void build(OpcodeBranchExchange * target, Word register_number);
-
     void run(ARM7TDMI * cpu);
 } OpcodeBranchExchange;
 
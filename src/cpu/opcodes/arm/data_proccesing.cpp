@@ -24,94 +24,88 @@ OpcodeDataProcess::OpcodeDataProcess(Word opcode)
     operand_2_immediate = Utils::read_bit_range(opcode, 0, 7);
 }
 
-Word OpcodeDataProcess::calculate_immediate_op2(Word immediate, unsigned int ror_shift)
+ShiftResult OpcodeDataProcess::calculate_immediate_op2(Word immediate, unsigned int ror_shift, bool c_flag)
 {
-    Word rotated_immediate = alu.rotate_right(immediate, ror_shift);
-
-    return rotated_immediate;
+    return CpuALU::rotate_right(immediate, ror_shift, c_flag);
 }
 
-Word OpcodeDataProcess::shift_op2(CpuALU * alu, Word op2, Byte shift_amount, BitShiftType bit_shift_type, bool c_flag)
+ShiftResult OpcodeDataProcess::shift_op2(Word op2, Byte shift_amount, BitShiftType bit_shift_type, bool c_flag)
 {
     switch (bit_shift_type)
     {
         case LSL:
-            if (shift_amount == 0) {
-                alu->carry_flag = c_flag;
-                return op2;
-            }
-            return alu->logical_left_shift(op2, shift_amount);
+            return CpuALU::logical_left_shift(op2, shift_amount, c_flag);
         case LSR:
             if (shift_amount == 0)
                 shift_amount = 32;
-            return alu->logical_right_shift(op2, shift_amount);
+            return CpuALU::logical_right_shift(op2, shift_amount, c_flag);
         case ASR:
             if (shift_amount == 0)
                 shift_amount = 32;
-            return alu->arithmetic_right_shift(op2, shift_amount);
+            return CpuALU::arithmetic_right_shift(op2, shift_amount, c_flag);
         case ROR:
             if (shift_amount == 0) 
-                return alu->rotate_right_extended(op2, c_flag);
-            return alu->rotate_right(op2, shift_amount);
+                return CpuALU::rotate_right_extended(op2, c_flag);
+            return CpuALU::rotate_right(op2, shift_amount, c_flag);
         default:
             SDL_assert(false);
-            return op2;
+            return {op2, c_flag};
     }
 }
 
-u_int64_t OpcodeDataProcess::calculate_instruction(CpuALU * alu, InstructionType instruction, Word rn, Word op2, bool c_flag)
+AluResult OpcodeDataProcess::calculate_instruction(InstructionType instruction, Word rn, ShiftResult op2, bool c_flag)
 {
-    u_int64_t result;
+    AluResult result = {0, op2.carry, false};
 
     switch (instruction)
     {
         case 0x0: // AND
-            result = rn & op2;
+            result.value = rn & op2.value;
             break;
         case 0x1: // EOR
-            result = rn ^ op2;
+            result.value = rn ^ op2.value;
             break;
         case 0x2: // SUB 
-            result = alu->subtract(1, rn, op2);
+            result = CpuALU::subtract(rn, op2.value);
             break;
         case 0x3: // RSB
-            result = alu->subtract(1, op2, rn);
+            result = CpuALU::reverse_subtract(rn, op2.value);
             break;
         case 0x4: // ADD
-            result = alu->add(2, rn, op2);
+            result = CpuALU::add(rn, op2.value);
             break;
         case 0x5: // ADC
-            result = alu->add(3, rn, op2, c_flag);
+            result = CpuALU::add_with_carry(rn, op2.value, c_flag);
             break;
         case 0x6: // SBC
-            result = alu->subtract(2, rn, op2, -(c_flag - 1));
+            result = CpuALU::subtract_with_carry(rn, op2.value, c_flag);
             break;
         case 0x7: // RSC
-            result = alu->subtract(2, op2, rn, -(c_flag - 1));
+            result = CpuALU::reverse_subtract_with_carry(rn, op2.value, c_flag);
             break;
         case 0x8: // TST
-            result = rn & op2;
+            result.value = rn & op2.value;
             break;
         case 0x9: // TEQ
-            result = rn ^ op2;
+            result.value = rn ^ op2.value;
             break;
         case 0xA: // CMP
-            result = alu->subtract(1, rn, op2);
+            result = CpuALU::subtract(rn, op2.value);
             break;
         case 0xB: // CMN
-            result = alu->add(2, rn, op2);
+            result = CpuALU::add(rn, op2.value);
             break;
         case 0xC: // ORR
-            result = rn | op2;
+            result.value = rn | op2.value;
             break;
         case 0xD: // MOV
-            result = op2;
+            result.value = op2.value;
             break;
         case 0xE: // BIC
-            result = rn & (~op2);
+            result.value = rn & (~op2.value);
             break;
         case 0xF: // MVN
-            result = ~op2;
+            result.value = ~op2.value;
             break;
     }
     
@@ -166,27 +160,15 @@ OpcodeDataProcess::OperationClass OpcodeDataProcess::operation_class(Instruction
     }
 }
 
-void OpcodeDataProcess::set_psr_flags(CpuALU * alu, PSR * psr, u_int64_t result) 
-{
-    psr->c = alu->carry_flag;
-    psr->z = result == 0;
-    psr->n = Utils::read_bit(result, 31);
-}
-
-bool OpcodeDataProcess::get_overflow_flag(Word op1, Word op2, u_int64_t result, bool subtraction) {
-    if (subtraction) {op2 = (UINT32_MAX - op2);}
-
-    return ((op1^result)&(op2^result)&(1 << 31)) != 0;
-}
-
 void OpcodeDataProcess::run(ARM7TDMI * cpu) {
     Word rn_value = cpu->read_register(this->rn);
-    Word op2;
+    bool c_flag = cpu->cpsr.c();
+    ShiftResult op2;
 
     if (!use_immediate_operand_2) {
-        op2 = cpu->read_register(operand_2_register);
+        Word op2_value = cpu->read_register(operand_2_register);
         if (operand_2_register == REGISTER_PC) {
-            op2 = calculate_pc_with_prefetch_offset(op2, cpu->cpsr.t);
+            op2_value = calculate_pc_with_prefetch_offset(op2_value, cpu->cpsr.t());
         }
             
 
@@ -194,44 +176,37 @@ void OpcodeDataProcess::run(ARM7TDMI * cpu) {
         Byte shift_amount = get_op_2_register_shift_amount(shift_by_register, shift_register_value);
 
         if (shift_by_register && shift_amount == 0) {
-            alu.carry_flag = cpu->cpsr.c;
+            op2 = {op2_value, c_flag};
         } else {
-            op2 = shift_op2(&alu, op2, shift_amount, (BitShiftType)shift_type, cpu->cpsr.c);
+            op2 = shift_op2(op2_value, shift_amount, (BitShiftType)shift_type, c_flag);
         }
         
     } else {
-        op2 = calculate_immediate_op2(operand_2_immediate, immediate_ror_shift * 2);
+        op2 = calculate_immediate_op2(operand_2_immediate, immediate_ror_shift * 2, c_flag);
     } 
 
     if (this->rn == REGISTER_PC) {
-        rn_value = calculate_pc_with_prefetch_offset(rn_value, cpu->cpsr.t);
+        rn_value = calculate_pc_with_prefetch_offset(rn_value, cpu->cpsr.t());
 
     }
 
     InstructionType instruction_type = (InstructionType)this->instruction_type;
-    u_int64_t result = calculate_instruction(&alu, instruction_type, rn_value, op2, cpu->cpsr.c);
+    AluResult result = calculate_instruction(instruction_type, rn_value, op2, c_flag);
 
     if (set_condition_codes) {
-        set_psr_flags(&alu, &cpu->cpsr, result);
+        cpu->cpsr.set_nz(result.value);
+        cpu->cpsr.set_c(result.carry);
         if (operation_class(instruction_type) == OpcodeDataProcess::ARITHMETIC) {
-            bool sub = (
-                instruction_type == OpcodeDataProcess::SUB ||
-                instruction_type == OpcodeDataProcess::SBC ||
-                instruction_type == OpcodeDataProcess::RSB ||
-                instruction_type == OpcodeDataProcess::RSC ||
-                instruction_type == OpcodeDataProcess::CMP 
-            );
-
-            cpu->cpsr.v = get_overflow_flag(rn_value, op2, result, sub);
+            cpu->cpsr.set_v(result.overflow);
         }
 
         if (rd == REGISTER_PC) {
-            cpu->cpsr = cpu->current_register_set()->spsr;
+            cpu->write_cpsr(*cpu->current_spsr());
         }
     }
 
     if (do_write_result(instruction_type)) {
-        cpu->write_register(rd, result & UINT32_MAX);
+        cpu->write_register(rd, result.value);
     }
 }
 
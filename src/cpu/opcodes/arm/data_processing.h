@@ -34,6 +34,12 @@ typedef struct OpcodeDataProcess {
         MVN = 0xF
     };
 
+    enum OperandForm {
+        OPERAND_IMMEDIATE,
+        OPERAND_REGISTER_SHIFT_IMMEDIATE,
+        OPERAND_REGISTER_SHIFT_REGISTER
+    };
+
     enum OperationClass {
         ARITHMETIC,
         LOGICAL
@@ -59,21 +65,17 @@ typedef struct OpcodeDataProcess {
     unsigned int immediate_ror_shift : 4;
     unsigned int operand_2_immediate : 10; // PROBLEM 8 -> 10 or smth idk lolololololol
 
-    CpuALU alu;
-
     OpcodeDataProcess();
     OpcodeDataProcess(Word opcode);
 
-    Word calculate_immediate_op2(Word immediate, unsigned int ror_shift);
-    static u_int64_t calculate_instruction(CpuALU * alu, InstructionType instruction, Word rn, Word op2, bool c_flag);
-    static Word shift_op2(CpuALU * alu, Word op2, Byte shift_amount, BitShiftType bit_shift_type, bool c_flag);
-    static void set_psr_flags(CpuALU * alu, PSR * psr, u_int64_t result);
+    ShiftResult calculate_immediate_op2(Word immediate, unsigned int ror_shift, bool c_flag);
+    static AluResult calculate_instruction(InstructionType instruction, Word rn, ShiftResult op2, bool c_flag);
+    static ShiftResult shift_op2(Word op2, Byte shift_amount, BitShiftType bit_shift_type, bool c_flag);
     static bool do_write_result(InstructionType instruction);
     static OperationClass operation_class(InstructionType instruction);
 
     Byte get_op_2_register_shift_amount(bool shift_by_register, Word shift_register_value);
     unsigned int calculate_pc_with_prefetch_offset(Word address, CPUState state);
-    static bool get_overflow_flag(Word op1, Word op2, u_int64_t result, bool subtraction);
 
     void run(ARM7TDMI * cpu);
 } OpcodeDataProcess;
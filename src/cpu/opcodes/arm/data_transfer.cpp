@@ -25,7 +25,7 @@ Word DataTransfer::calculate_address(ARM7TDMI * cpu, Word offset) {
         if (w) {
             cpu->warn("Single Data Transfer - Base register == PC && writeback");
         }
-        if (cpu->cpsr.t == STATE_ARM) {
+        if (cpu->cpsr.t() == STATE_ARM) {
             base_register_value += 8;
         } else {
             base_register_value = (base_register_value + 4) & (~0b11);
@@ -30,7 +30,6 @@ void OpcodeHalfWordSignedDataTransfer::run(ARM7TDMI * cpu) {
     }
 
     Word address = calculate_address(cpu, offset);
-    Word aligned_address = address & (~0b1);
 
     // For little endian
     if (l == 0) { // Store
@@ -38,63 +37,51 @@ void OpcodeHalfWordSignedDataTransfer::run(ARM7TDMI * cpu) {
             if (h == 0) { // Byte || Reserved for SWP
 
             } else { // Halfword || STRH
-                HalfWord selected_halfword = source_register_value & 0xFFFF;
-                cpu->memory.write_halfword_to_memory(aligned_address, selected_halfword);
+                store(cpu, address, source_register_value);
             }
         } else { // Signed
             cpu->warn("Half-Word signed data transfer - Storing signed value");
         }
     } else { // Load
-        Word selected_halfword = cpu->memory.read_halfword_from_memory(aligned_address);
-        Byte rotate_amount = (address & 1) * 8;
-        selected_halfword = CpuALU().rotate_right(selected_halfword, rotate_amount);
-
-        if (s == 0) { // Unsigned
-            if (h == 0) { // Byte || Reserved for SWP
-
-            } else { // Halfword || LDRH
-                cpu->write_register(source_destination_register, selected_halfword);
-            }
-        } else { // Signed
-            if (h == 0) { // Byte || LDRSB
-                Byte selected_byte = cpu->memory.read_from_memory(address);
-                cpu->write_register(source_destination_register, Utils::sign_extend(selected_byte, 8));
-            } else { // Halfword || LDRSH
-                cpu->write_register(source_destination_register, Utils::sign_extend(selected_halfword, 16 - rotate_amount));
-            }
+        if (s == 0 && h == 0) { // Byte || Reserved for SWP
+            return;
         }
+        load(cpu, address, source_destination_register, (DataType)((s << 1) | h));
     }
 }
 
-OpcodeHalfWordSignedDataTransferBuilder::OpcodeHalfWordSignedDataTransferBuilder(bool load, Word base_register, Word source_destination_register) {
-    product.l = load;
-    product.base_register = base_register;
-    product.source_destination_register = source_destination_register;
-}
+void OpcodeHalfWordSignedDataTransfer::load(ARM7TDMI * cpu, Word address, Byte destination_register, DataType data_type) { // Memory -> Register
+    Word aligned_address = address & (~0b1);
+    cpu->add_data_cycles(address, ACCESS_16, ACCESS_NONSEQUENTIAL);
+    cpu->add_internal_cycles(1);
 
-OpcodeHalfWordSignedDataTransferBuilder& OpcodeHalfWordSignedDataTransferBuilder::set_datatype(OpcodeHalfWordSignedDataTransfer::DataType opcode) {
-    product.h = Utils::read_bit(opcode, 0);
-    product.s = Utils::read_bit(opcode, 1);
-    return *this;
-}
-OpcodeHalfWordSignedDataTransferBuilder& OpcodeHalfWordSignedDataTransferBuilder::set_flags(bool pre, bool up, bool writeback) {
-    product.p = pre;
-    product.u = up;
-    product.w = writeback;
-    return *this;
-}
-OpcodeHalfWordSignedDataTransferBuilder& OpcodeHalfWordSignedDataTransferBuilder::set_offset_immediate(Byte immediate) {
-    product.i = true;
-    product.immediate_high_nibble = (immediate >> 4) & 0xF;
-    product.immediate_low_nibble = immediate & 0xF;
-    return *this;
-}
-OpcodeHalfWordSignedDataTransferBuilder& OpcodeHalfWordSignedDataTransferBuilder::set_offset_register(Byte offset_register) {
-    product.i = false;
-    product.offset_register = offset_register;
-    return *this;
+    switch (data_type)
+    {
+        case UNSIGNED_HALFWORD: { // LDRH
+            Word selected_halfword = cpu->memory.read_halfword_from_memory(aligned_address);
+            Byte rotate_amount = (address & 1) * 8;
+            selected_halfword = CpuALU::rotate_right(selected_halfword, rotate_amount, false).value;
+            cpu->write_register(destination_register, selected_halfword);
+            break;
+        }
+        case SIGNED_BYTE: { // LDRSB
+            Byte selected_byte = cpu->memory.read_from_memory(address);
+            cpu->write_register(destination_register, Utils::sign_extend(selected_byte, 8));
+            break;
+        }
+        case SIGNED_HALFWORD: { // LDRSH
+            Word selected_halfword = cpu->memory.read_halfword_from_memory(aligned_address);
+            Byte rotate_amount = (address & 1) * 8;
+            selected_halfword = CpuALU::rotate_right(selected_halfword, rotate_amount, false).value;
+            cpu->write_register(destination_register, Utils::sign_extend(selected_halfword, 16 - rotate_amount));
+            break;
+        }
+    }
 }
 
-OpcodeHalfWordSignedDataTransfer OpcodeHalfWordSignedDataTransferBuilder::get_product() {
-    return product;
-}
\ No newline at end of file
+void OpcodeHalfWordSignedDataTransfer::store(ARM7TDMI * cpu, Word address, Word source_register_value) { // Register -> Memory
+    Word aligned_address = address & (~0b1);
+    HalfWord selected_halfword = source_register_value & 0xFFFF;
+    cpu->add_data_cycles(aligned_address, ACCESS_16, ACCESS_NONSEQUENTIAL);
+    cpu->memory.write_halfword_to_memory(aligned_address, selected_halfword);
+}
@@ -27,19 +27,10 @@ typedef struct OpcodeHalfWordSignedDataTransfer : DataTransfer {
     unsigned int immediate_high_nibble : 4; // 8 - 11
     unsigned int immediate_low_nibble : 4; // 0 - 3
 
+    void static load(ARM7TDMI * cpu, Word address, Byte destination_register, DataType data_type);
+    void static store(ARM7TDMI * cpu, Word address, Word source_register_value);
+
     void run(ARM7TDMI * cpu);
 } OpcodeHalfWordSignedDataTransfer;
 
-typedef struct OpcodeHalfWordSignedDataTransferBuilder {
-    OpcodeHalfWordSignedDataTransferBuilder(bool load, Word base_register, Word source_destination_register);
-    OpcodeHalfWordSignedDataTransfer product;
-
-    OpcodeHalfWordSignedDataTransferBuilder& set_datatype(OpcodeHalfWordSignedDataTransfer::DataType opcode);
-    OpcodeHalfWordSignedDataTransferBuilder& set_flags(bool pre, bool up, bool writeback);
-    OpcodeHalfWordSignedDataTransferBuilder& set_offset_immediate(Byte immediate);
-    OpcodeHalfWordSignedDataTransferBuilder& set_offset_register(Byte offset_register);
-
-    OpcodeHalfWordSignedDataTransfer get_product();
-} OpcodeHalfWordSignedDataTransferBuilder;
-
 #endif
\ No newline at end of file
@@ -30,6 +30,8 @@ void OpcodeMultiply::run(ARM7TDMI * cpu) {
         cpu->warn("Multiply - Invalid register value (rd == rm)");
     }
 
+    cpu->add_internal_cycles(ARM7TDMI::multiply_cycles(rs_value, true) + accumulate);
+
     if (accumulate) {
         destination_value = (rm_value * rs_value) + rn_value;
     } else { // Multiply Only
@@ -37,30 +39,9 @@ void OpcodeMultiply::run(ARM7TDMI * cpu) {
     }
 
     if (set_condition_codes) {
-        cpu->cpsr.n = Utils::read_bit(destination_value, 31);
-        cpu->cpsr.z = destination_value == 0;
-        cpu->cpsr.c = rand() & 1;
-        cpu->cpsr.v; // Unaffected
+        cpu->cpsr.set_nz(destination_value);
+        cpu->cpsr.set_c(rand() & 1); // V is unaffected
     }
 
     cpu->write_register(register_destination, destination_value);
 }
-
-OpcodeMultiplyBuilder::OpcodeMultiplyBuilder(Byte destination_register, Byte rs, Byte rm, bool set_condition_codes) {
-    product.accumulate = false;
-    product.rn = 0;
-    product.set_condition_codes = set_condition_codes;
-    product.register_destination = destination_register;
-    product.rs = rs;
-    product.rm = rm;
-}
-
-OpcodeMultiplyBuilder& OpcodeMultiplyBuilder::set_accumulate(Byte accumulate_register) {
-    product.accumulate = true;
-    product.rn = accumulate_register;
-    return *this;
-}
-
-OpcodeMultiply OpcodeMultiplyBuilder::get_product() {
-    return product;
-}
\ No newline at end of file
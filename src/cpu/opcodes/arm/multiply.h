@@ -17,14 +17,5 @@ typedef struct OpcodeMultiply {
     void run(ARM7TDMI * cpu);
 } OpcodeMultiply;
 
-typedef struct OpcodeMultiplyBuilder {
-    OpcodeMultiplyBuilder(Byte destination_register, Byte rs, Byte rm, bool set_condition_codes);
-    OpcodeMultiply product;
-
-    OpcodeMultiplyBuilder& set_accumulate(Byte accumulate_register);
-
-    OpcodeMultiply get_product();
-} OpcodeMultiplyBuilder;
-
 
 #endif
\ No newline at end of file
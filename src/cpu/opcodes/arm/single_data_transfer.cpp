@@ -18,6 +18,8 @@ OpcodeSingleDataTransfer::OpcodeSingleDataTransfer(Word opcode) : DataTransfer(o
 }
 
 void OpcodeSingleDataTransfer::load(ARM7TDMI * cpu, Word address, Byte destination_register, bool byte) { // Memory -> Register
+    cpu->add_data_cycles(address, byte ? ACCESS_16 : ACCESS_32, ACCESS_NONSEQUENTIAL);
+    cpu->add_internal_cycles(1);
     if (byte == 1) { // Byte
         cpu->write_register(
         destination_register,
@@ -26,7 +28,7 @@ void OpcodeSingleDataTransfer::load(ARM7TDMI * cpu, Word address, Byte destinati
     } else { // Word
         Word aligned_address = address & (~0b11);
         Word word_at_address = cpu->read_word_from_memory(aligned_address);
-        Word rotated_word_at_address = CpuALU().rotate_right(word_at_address, (address & 3) * 8); 
+        Word rotated_word_at_address = CpuALU::rotate_right(word_at_address, (address & 3) * 8, false).value; 
         cpu->write_register(
             destination_register,
             rotated_word_at_address
@@ -42,7 +44,7 @@ void OpcodeSingleDataTransfer::load(ARM7TDMI * cpu, Word address, Word value, By
         );
     } else { // Word
         Word aligned_address = address & (~0b11);
-        Word rotated_word_at_address = CpuALU().rotate_right(value, (address & 3) * 8); // Rotate it so that the first byte is the target byte in the address. 
+        Word rotated_word_at_address = CpuALU::rotate_right(value, (address & 3) * 8, false).value; // Rotate it so that the first byte is the target byte in the address. 
         cpu->write_register(
             destination_register,
             rotated_word_at_address
@@ -51,6 +53,7 @@ void OpcodeSingleDataTransfer::load(ARM7TDMI * cpu, Word address, Word value, By
 }
 
 void OpcodeSingleDataTransfer::store(ARM7TDMI * cpu, Word address, Word source_register_value, bool byte) { // Register -> Memory
+    cpu->add_data_cycles(address, byte ? ACCESS_16 : ACCESS_32, ACCESS_NONSEQUENTIAL);
     if (byte == 1) { // Byte
         Byte stored_byte = source_register_value & 0xFF;
         cpu->memory.write_to_memory(address, stored_byte);
@@ -70,8 +73,7 @@ void OpcodeSingleDataTransfer::run(ARM7TDMI * cpu) {
     if (i == 1) { // Offset = Shifted Register
         Word offset_register_value = cpu->read_register(offset_register);
         OpcodeDataProcess::BitShiftType shift_type = static_cast<OpcodeDataProcess::BitShiftType>(register_shift_type);
-        CpuALU alu;
-        offset = OpcodeDataProcess::shift_op2(&alu, offset_register_value, register_shift_amount, shift_type, cpu->cpsr.c);
+        offset = OpcodeDataProcess::shift_op2(offset_register_value, register_shift_amount, shift_type, cpu->cpsr.c()).value;
     } else { // Offset = immediate value
         offset = offset_immediate;
     }
@@ -89,33 +91,3 @@ void OpcodeSingleDataTransfer::run(ARM7TDMI * cpu) {
         load(cpu, address, source_destination_register, b);
     }
 }
-
-OpcodeSingleDataTransferBuilder::OpcodeSingleDataTransferBuilder(bool load, Word base_register, Word source_destination_register) {
-    product.l = load;
-    product.base_register = base_register;
-    product.source_destination_register = source_destination_register;
-}
-
-OpcodeSingleDataTransferBuilder& OpcodeSingleDataTransferBuilder::set_flags(bool pre, bool up, bool byte, bool writeback) {
-    product.p = pre;
-    product.u = up;
-    product.b = byte;
-    product.w = writeback;
-    return *this;
-}
-OpcodeSingleDataTransferBuilder& OpcodeSingleDataTransferBuilder::set_offset_immediate(Word immediate) {
-    product.i = false;
-    product.offset_immediate = immediate;
-    return *this;
-}
-OpcodeSingleDataTransferBuilder& OpcodeSingleDataTransferBuilder::set_offset_register(Byte offset_register, Byte shift_amount, Byte shift_type) {
-    product.i = true;
-    product.offset_register = offset_register;
-    product.register_shift_amount = shift_amount;
-    product.register_shift_type = shift_type;
-    return *this;
-}
-
-OpcodeSingleDataTransfer OpcodeSingleDataTransferBuilder::get_product() {
-    return product;
-}
\ No newline at end of file
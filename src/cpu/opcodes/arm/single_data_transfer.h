@@ -24,15 +24,4 @@ typedef struct OpcodeSingleDataTransfer : DataTransfer {
     void run(ARM7TDMI * cpu);
 } OpcodeSingleDataTransfer;
 
-typedef struct OpcodeSingleDataTransferBuilder {
-    OpcodeSingleDataTransferBuilder(bool load, Word base_register, Word source_destination_register);
-    OpcodeSingleDataTransfer product;
-
-    OpcodeSingleDataTransferBuilder& set_flags(bool pre, bool up, bool byte, bool writeback);
-    OpcodeSingleDataTransferBuilder& set_offset_immediate(Word immediate);
-    OpcodeSingleDataTransferBuilder& set_offset_register(Byte offset_register, Byte shift_amount, Byte shift_type);
-
-    OpcodeSingleDataTransfer get_product();
-} OpcodeSingleDataTransferBuilder;
-
 #endif
\ No newline at end of file
@@ -9,7 +9,6 @@
 
 #include "opcode_types.h"
 
-#include "src/cpu/opcodes/arm/branch.h"
 #include "./arm/data_processing.h"
 #include "./arm/branch_exchange.h"
 #include "./arm/multiply.h"
@@ -20,55 +19,214 @@
 #include "./arm/block_data_transfer.h"
 #include "./arm/swap.h"
 
-void ARM7TDMI::arm_opcode_branch(Word opcode)
+void ARM7TDMI::arm_opcode_branch(const ArmBlockInstruction & instruction)
 {
-    OpcodeBranch branch = OpcodeBranch(opcode);
     Word pc_with_prefetch_offset = read_register(REGISTER_PC) + 8;
 
-    Word offset = branch.offset;
-    offset = offset << 2;
-
-    if (branch.link_bit)
+    if (Utils::read_bit(instruction.opcode, 24)) // Link
     {
         Word return_address = pc_with_prefetch_offset - 4;
         write_register(REGISTER_LR, return_address);
     }
 
-    OpcodeBranch::branch(this, pc_with_prefetch_offset, offset, 26);
+    write_register(REGISTER_PC, pc_with_prefetch_offset + instruction.immediate);
 }
 
-void ARM7TDMI::arm_opcode_branch_exchange(Word opcode)
+void ARM7TDMI::arm_opcode_branch_exchange(const ArmBlockInstruction & instruction)
 {
-    OpcodeBranchExchange(opcode).run(this);
+    OpcodeBranchExchange(instruction.opcode).run(this);
 }
 
-void ARM7TDMI::arm_opcode_software_interrupt(Word opcode)
+void ARM7TDMI::arm_opcode_software_interrupt(const ArmBlockInstruction & instruction)
 {
-    Word comment_field = Utils::read_bit_range(opcode, 0, 23);
+    Word comment_field = Utils::read_bit_range(instruction.opcode, 0, 23);
     emulate_software_interrupt(comment_field>>16);
 }
 
-void ARM7TDMI::arm_opcode_undefined_intruction(Word opcode)
+void ARM7TDMI::arm_opcode_undefined_intruction(const ArmBlockInstruction & instruction)
 {
     run_exception(EXCEPTION_UNDEFINED);
 }
 
-void ARM7TDMI::arm_opcode_data_processing(Word opcode) 
+// Operand 2 barrel shifter, resolved at compile time for the shift type and form.
+template <Word shift_type, bool shift_by_register>
+static ShiftResult shift_operand_2(Word op2, Byte shift_amount, bool c_flag)
+{
+    if constexpr (!shift_by_register) {
+        if (shift_amount == 0) {
+            if constexpr (shift_type == OpcodeDataProcess::ROR) {
+                return CpuALU::rotate_right_extended(op2, c_flag);
+            } else if constexpr (shift_type != OpcodeDataProcess::LSL) { // LSR #0 and ASR #0 encode a shift by 32
+                shift_amount = 32;
+            }
+        }
+    }
+
+    if constexpr (shift_type == OpcodeDataProcess::LSL) {
+        return CpuALU::logical_left_shift(op2, shift_amount, c_flag);
+    } else if constexpr (shift_type == OpcodeDataProcess::LSR) {
+        return CpuALU::logical_right_shift(op2, shift_amount, c_flag);
+    } else if constexpr (shift_type == OpcodeDataProcess::ASR) {
+        return CpuALU::arithmetic_right_shift(op2, shift_amount, c_flag);
+    } else {
+        return CpuALU::rotate_right(op2, shift_amount, c_flag);
+    }
+}
+
+template <Word instruction_type, bool set_condition_codes, Word operand_form, Word shift_type>
+void ARM7TDMI::arm_opcode_data_processing(const ArmBlockInstruction & instruction) 
 {   
-    OpcodeDataProcess opcode_class = OpcodeDataProcess(opcode);
-    opcode_class.run(this);
+    constexpr OpcodeDataProcess::InstructionType operation = (OpcodeDataProcess::InstructionType)instruction_type;
+    constexpr bool shift_by_register = operand_form == OpcodeDataProcess::OPERAND_REGISTER_SHIFT_REGISTER;
+    constexpr Word pc_prefetch_offset = shift_by_register ? 12 : 8;
+
+    constexpr bool logical = 
+        operation == OpcodeDataProcess::AND ||
+        operation == OpcodeDataProcess::EOR ||
+        operation == OpcodeDataProcess::TST ||
+        operation == OpcodeDataProcess::TEQ ||
+        operation == OpcodeDataProcess::ORR ||
+        operation == OpcodeDataProcess::MOV ||
+        operation == OpcodeDataProcess::BIC ||
+        operation == OpcodeDataProcess::MVN;
+    constexpr bool write_result = !(
+        operation == OpcodeDataProcess::TST ||
+        operation == OpcodeDataProcess::TEQ ||
+        operation == OpcodeDataProcess::CMP ||
+        operation == OpcodeDataProcess::CMN
+    );
+
+    Byte rn = instruction.rn;
+    Byte rd = instruction.rd;
+
+    bool c_flag = cpsr.c();
+    ShiftResult op2;
+
+    if constexpr (operand_form == OpcodeDataProcess::OPERAND_IMMEDIATE) {
+        // Already rotated, a rotation of 0 keeps the carry
+        op2.value = instruction.immediate;
+        op2.carry = instruction.shift_amount == 0 ? c_flag : instruction.immediate >> 31;
+    } else {
+        Word rm_value = read_register(instruction.rm);
+        if (instruction.rm == REGISTER_PC) {
+            rm_value += pc_prefetch_offset;
+        }
+
+        Byte shift_amount;
+        if constexpr (shift_by_register) {
+            add_internal_cycles(1);
+            shift_amount = read_register(instruction.rs) & 0xFF;
+        } else {
+            shift_amount = instruction.shift_amount;
+        }
+        op2 = shift_operand_2<shift_type, shift_by_register>(rm_value, shift_amount, c_flag);
+    }
+
+    Word rn_value = 0;
+    if constexpr (operation != OpcodeDataProcess::MOV && operation != OpcodeDataProcess::MVN) {
+        rn_value = read_register(rn);
+        if (rn == REGISTER_PC) {
+            rn_value += pc_prefetch_offset;
+        }
+    }
+
+    AluResult result;
+    if constexpr (operation == OpcodeDataProcess::SUB || operation == OpcodeDataProcess::CMP) {
+        result = CpuALU::subtract(rn_value, op2.value);
+    } else if constexpr (operation == OpcodeDataProcess::RSB) {
+        result = CpuALU::reverse_subtract(rn_value, op2.value);
+    } else if constexpr (operation == OpcodeDataProcess::ADD || operation == OpcodeDataProcess::CMN) {
+        result = CpuALU::add(rn_value, op2.value);
+    } else if constexpr (operation == OpcodeDataProcess::ADC) {
+        result = CpuALU::add_with_carry(rn_value, op2.value, c_flag);
+    } else if constexpr (operation == OpcodeDataProcess::SBC) {
+        result = CpuALU::subtract_with_carry(rn_value, op2.value, c_flag);
+    } else if constexpr (operation == OpcodeDataProcess::RSC) {
+        result = CpuALU::reverse_subtract_with_carry(rn_value, op2.value, c_flag);
+    } else if constexpr (operation == OpcodeDataProcess::AND || operation == OpcodeDataProcess::TST) {
+        result.value = rn_value & op2.value;
+    } else if constexpr (operation == OpcodeDataProcess::EOR || operation == OpcodeDataProcess::TEQ) {
+        result.value = rn_value ^ op2.value;
+    } else if constexpr (operation == OpcodeDataProcess::ORR) {
+        result.value = rn_value | op2.value;
+    } else if constexpr (operation == OpcodeDataProcess::MOV) {
+        result.value = op2.value;
+    } else if constexpr (operation == OpcodeDataProcess::BIC) {
+        result.value = rn_value & (~op2.value);
+    } else {
+        result.value = ~op2.value;
+    }
+
+    if constexpr (set_condition_codes) {
+        if constexpr (logical) {
+            cpsr.set_nz(result.value);
+            cpsr.set_c(op2.carry);
+        } else if constexpr (
+            operation == OpcodeDataProcess::ADD || 
+            operation == OpcodeDataProcess::ADC || 
+            operation == OpcodeDataProcess::CMN
+        ) {
+            cpsr.set_nzcv_add(rn_value, op2.value, result.value);
+        } else if constexpr (operation == OpcodeDataProcess::RSB || operation == OpcodeDataProcess::RSC) {
+            cpsr.set_nzcv_subtract(op2.value, rn_value, result.value);
+        } else {
+            cpsr.set_nzcv_subtract(rn_value, op2.value, result.value);
+        }
+
+        if (rd == REGISTER_PC) {
+            write_cpsr(*current_spsr());
+        }
+    }
+
+    if constexpr (write_result) {
+        write_register(rd, result.value);
+    }
 }
 
-void ARM7TDMI::arm_opcode_multiply(Word opcode)
+#define INSTANTIATE_DATA_PROCESSING_SHIFT(instruction, s, shift) \
+    template void ARM7TDMI::arm_opcode_data_processing<OpcodeDataProcess::instruction, s, OpcodeDataProcess::OPERAND_REGISTER_SHIFT_IMMEDIATE, OpcodeDataProcess::shift>(const ArmBlockInstruction & instruction); \
+    template void ARM7TDMI::arm_opcode_data_processing<OpcodeDataProcess::instruction, s, OpcodeDataProcess::OPERAND_REGISTER_SHIFT_REGISTER, OpcodeDataProcess::shift>(const ArmBlockInstruction & instruction);
+
+#define INSTANTIATE_DATA_PROCESSING_FLAGS(instruction, s) \
+    template void ARM7TDMI::arm_opcode_data_processing<OpcodeDataProcess::instruction, s, OpcodeDataProcess::OPERAND_IMMEDIATE, OpcodeDataProcess::LSL>(const ArmBlockInstruction & instruction); \
+    INSTANTIATE_DATA_PROCESSING_SHIFT(instruction, s, LSL) \
+    INSTANTIATE_DATA_PROCESSING_SHIFT(instruction, s, LSR) \
+    INSTANTIATE_DATA_PROCESSING_SHIFT(instruction, s, ASR) \
+    INSTANTIATE_DATA_PROCESSING_SHIFT(instruction, s, ROR)
+
+#define INSTANTIATE_DATA_PROCESSING(instruction) \
+    INSTANTIATE_DATA_PROCESSING_FLAGS(instruction, false) \
+    INSTANTIATE_DATA_PROCESSING_FLAGS(instruction, true)
+
+INSTANTIATE_DATA_PROCESSING(AND)
+INSTANTIATE_DATA_PROCESSING(EOR)
+INSTANTIATE_DATA_PROCESSING(SUB)
+INSTANTIATE_DATA_PROCESSING(RSB)
+INSTANTIATE_DATA_PROCESSING(ADD)
+INSTANTIATE_DATA_PROCESSING(ADC)
+INSTANTIATE_DATA_PROCESSING(SBC)
+INSTANTIATE_DATA_PROCESSING(RSC)
+INSTANTIATE_DATA_PROCESSING(TST)
+INSTANTIATE_DATA_PROCESSING(TEQ)
+INSTANTIATE_DATA_PROCESSING(CMP)
+INSTANTIATE_DATA_PROCESSING(CMN)
+INSTANTIATE_DATA_PROCESSING(ORR)
+INSTANTIATE_DATA_PROCESSING(MOV)
+INSTANTIATE_DATA_PROCESSING(BIC)
+INSTANTIATE_DATA_PROCESSING(MVN)
+
+void ARM7TDMI::arm_opcode_multiply(const ArmBlockInstruction & instruction)
 {
-    OpcodeMultiply multiply = OpcodeMultiply(opcode);
+    OpcodeMultiply multiply = OpcodeMultiply(instruction.opcode);
     multiply.run(this);
 };
 
-void ARM7TDMI::arm_opcode_multiply_long(Word opcode)
+void ARM7TDMI::arm_opcode_multiply_long(const ArmBlockInstruction & instruction)
 {
-    OpcodeMultiplyLong multiply_long = OpcodeMultiplyLong(opcode);
+    OpcodeMultiplyLong multiply_long = OpcodeMultiplyLong(instruction.opcode);
     u_int64_t result;
+
+    add_internal_cycles(multiply_cycles(read_register(multiply_long.rs), multiply_long.sign) + 1 + multiply_long.accumulate);
     
     // int32_t rs_value_s = rs_value_u;
     // int32_t rm_value_s = rs_value_u;
@@ -108,27 +266,26 @@ void ARM7TDMI::arm_opcode_multiply_long(Word opcode)
 
     if (multiply_long.set_condition_codes)
     {
-        cpsr.n = Utils::read_bit(destination_high_value, 31);
-        cpsr.z = result == 0;
-        cpsr.c = rand() & 1;
-        cpsr.v = rand() & 1;
+        cpsr.set_n(Utils::read_bit(destination_high_value, 31));
+        cpsr.set_z(result == 0);
+        cpsr.set_c(rand() & 1);
+        cpsr.set_v(rand() & 1);
     }
 }
  
-void ARM7TDMI::arm_opcode_psr_transfer(Word opcode)
+void ARM7TDMI::arm_opcode_psr_transfer(const ArmBlockInstruction & instruction)
 {
-    OpcodePsrTransfer psr_transfer = OpcodePsrTransfer(opcode);
+    OpcodePsrTransfer psr_transfer = OpcodePsrTransfer(instruction.opcode);
     PSR * target_psr = psr_transfer.psr == 0 
         ? &cpsr 
-        : &current_register_set()->spsr;
+        : current_spsr();
 
     if (psr_transfer.is_msr_instruction) {
         Word write_value;
         if (psr_transfer.immediate_operand) {
-            CpuALU alu;
             Byte immediate = psr_transfer.immediate_value;
             Byte immediate_rotate = psr_transfer.immediate_rotate * 2;
-            write_value = alu.rotate_right(immediate, immediate_rotate);
+            write_value = CpuALU::rotate_right(immediate, immediate_rotate, false).value;
         } else {
             write_value = read_register(psr_transfer.register_source);
         }
@@ -143,31 +300,37 @@ void ARM7TDMI::arm_opcode_psr_transfer(Word opcode)
             Utils::write_bit_range(&new_psr_value, 0, 7, new_control_bits);
         }
 
-        target_psr->write_value(new_psr_value);
+        if (target_psr == &cpsr) {
+            ProgramStatusRegister new_cpsr;
+            new_cpsr.write_value(new_psr_value);
+            write_cpsr(new_cpsr);
+        } else {
+            target_psr->write_value(new_psr_value);
+        }
     } else { // MRS
         Byte destination_register = psr_transfer.register_destination;
         write_register(destination_register, target_psr->value());  
     }
 };
 
-void ARM7TDMI::arm_opcode_single_data_transfer(Word opcode)
+void ARM7TDMI::arm_opcode_single_data_transfer(const ArmBlockInstruction & instruction)
 {
-    OpcodeSingleDataTransfer data_transfer = OpcodeSingleDataTransfer(opcode);
+    OpcodeSingleDataTransfer data_transfer = OpcodeSingleDataTransfer(instruction.opcode);
     data_transfer.run(this);
 }
 
-void ARM7TDMI::arm_opcode_half_word_signed_data_transfer(Word opcode) {
-    OpcodeHalfWordSignedDataTransfer data_transfer = OpcodeHalfWordSignedDataTransfer(opcode);
+void ARM7TDMI::arm_opcode_half_word_signed_data_transfer(const ArmBlockInstruction & instruction) {
+    OpcodeHalfWordSignedDataTransfer data_transfer = OpcodeHalfWordSignedDataTransfer(instruction.opcode);
     data_transfer.run(this);
 }
 
-void ARM7TDMI::arm_opcode_block_data_transfer(Word opcode) {
-    OpcodeBlockDataTransfer data_transfer = OpcodeBlockDataTransfer(opcode);
+void ARM7TDMI::arm_opcode_block_data_transfer(const ArmBlockInstruction & instruction) {
+    OpcodeBlockDataTransfer data_transfer = OpcodeBlockDataTransfer(instruction.opcode);
     data_transfer.run(this);
 }
 
-void ARM7TDMI::arm_opcode_swap(Word opcode) {
-    OpcodeSwap swap = OpcodeSwap(opcode);
+void ARM7TDMI::arm_opcode_swap(const ArmBlockInstruction & instruction) {
+    OpcodeSwap swap = OpcodeSwap(instruction.opcode);
     if (swap.base_register == REGISTER_PC ||
         swap.source_register == REGISTER_PC ||
         swap.destination_register == REGISTER_PC
@@ -178,6 +341,8 @@ void ARM7TDMI::arm_opcode_swap(Word opcode) {
     Word address = read_register(swap.base_register);
     Word aligned_address = address & (~0b11);
     Word swap_address_value = read_word_from_memory(aligned_address);
+    add_data_cycles(address, swap.b ? ACCESS_16 : ACCESS_32, ACCESS_NONSEQUENTIAL);
+    add_internal_cycles(1);
 
     Word source_register_value = read_register(swap.source_register);
     if (swap.source_register == REGISTER_PC) {
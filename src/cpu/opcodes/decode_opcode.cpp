@@ -3,72 +3,322 @@
 #include "src/cpu/cpu.h"
 #include "src/cpu/opcodes/opcode_types.h"
 #include "src/cpu/cpu_types.h"
+#include "src/cpu/opcodes/arm/data_processing.h"
+#include "src/cpu/alu.h"
 
-ArmOpcodeType ARM7TDMI::decode_opcode_arm(Word opcode)
+#include <utility>
+
+// Classifies an ARM opcode from its decode key (bits 27-20 and 7-4).
+// Should-be-one/should-be-zero fields outside the key (BX bits 8-19, SWP bits 8-11)
+// are assumed to hold their required values.
+static constexpr ArmOpcodeType classify_opcode_arm(Word key)
 {
-    if (Utils::read_bit_range(opcode, 25, 27) == 0b101)
+    Word high = key >> 4;  // 27 - 20
+    Word low = key & 0xF;  // 7 - 4
+
+    if ((high >> 5) == 0b101)
     {
         return BRANCH;
     }
-    if (Utils::read_bit_range(opcode, 4, 27) == 0b0001'0010'1111'1111'1111'0001)
+    if (high == 0b0001'0010 && low == 0b0001)
     {
         return BX;
     }
-    if (Utils::read_bit_range(opcode, 24, 27) == 0b1111)
+    if ((high >> 4) == 0b1111)
     {
         return SWI;
     }
-    if (Utils::read_bit_range(opcode, 25, 27) == 0b011
-    &&  Utils::read_bit(opcode, 4) == 0b1)
+    if ((high >> 5) == 0b011 && (low & 0b1) == 0b1)
     {
         return UNDEFINED;
     }
-    if (Utils::read_bit_range(opcode, 23, 27) == 0b00010 &&
-        Utils::read_bit_range(opcode, 4,  11) == 0b00001001 &&
-        Utils::read_bit_range(opcode, 20, 21) == 0b00) {
+    if ((high >> 3) == 0b00010 && low == 0b1001 && (high & 0b11) == 0b00) {
         return SWAP;
     }
-    if (Utils::read_bit_range(opcode, 26, 27) == 0b00
-    &&  Utils::read_bit_range(opcode, 23, 24) == 0b10
-    &&  Utils::read_bit(opcode, 20) == 0b0
+    if ((high >> 6) == 0b00
+    &&  ((high >> 3) & 0b11) == 0b10
+    &&  (high & 0b1) == 0b0
     ) {
         return PSR_TRANSFER;
     }
-    if (Utils::read_bit_range(opcode, 22, 27) == 0b000000
-    &&  Utils::read_bit_range(opcode, 4,  7 ) == 0b1001)
+    if ((high >> 2) == 0b000000 && low == 0b1001)
     {
         return MULTIPLY;
     }
-    if (Utils::read_bit_range(opcode, 23, 27) == 0b00001
-    &&  Utils::read_bit_range(opcode, 4,  7 ) == 0b1001)
+    if ((high >> 3) == 0b00001 && low == 0b1001)
     {
         return MULTIPLY_LONG;
     }
-    if (Utils::read_bit_range(opcode, 25, 27) == 0b000 && Utils::read_bit(opcode, 7) && Utils::read_bit(opcode, 4)) {
+    if ((high >> 5) == 0b000 && (low & 0b1000) && (low & 0b0001)) {
         return HALF_WORD_SIGNED_DATA_TRANSFER;
     }
-    if (Utils::read_bit_range(opcode, 26, 27) == 0b00)
+    if ((high >> 6) == 0b00)
     {
         return ALU;
     }
-    if (Utils::read_bit_range(opcode, 26, 27) == 0b01) {
+    if ((high >> 6) == 0b01) {
         return SINGLE_DATA_TRANSFER;
     }
-    if (Utils::read_bit_range(opcode, 25, 27) == 0b100) {
+    if ((high >> 5) == 0b100) {
         return BLOCK_DATA_TRANSFER;
     }
-    SDL_Log("PC: %0x", read_register(15));
-    SDL_assert(false);
-    return ALU;
+    // Coprocessor instructions - no coprocessor on the GBA, so they trap.
+    return UNDEFINED;
 }
 
-ThumbOpcodeType ARM7TDMI::decode_opcode_thumb(HalfWord opcode) {
+// The if-chain the table replaced, on full opcodes, kept to check the
+// classifier against. Coprocessor encodings used to assert and are now
+// undefined.
+static constexpr ArmOpcodeType reference_decode_opcode_arm(Word opcode)
+{
+    auto bits = [opcode](Word start, Word end) {
+        return (opcode >> start) & ((1 << (end - start + 1)) - 1);
+    };
+
+    if (bits(25, 27) == 0b101) {
+        return BRANCH;
+    }
+    if (bits(4, 27) == 0b0001'0010'1111'1111'1111'0001) {
+        return BX;
+    }
+    if (bits(24, 27) == 0b1111) {
+        return SWI;
+    }
+    if (bits(25, 27) == 0b011 && bits(4, 4) == 0b1) {
+        return UNDEFINED;
+    }
+    if (bits(23, 27) == 0b00010 && bits(4, 11) == 0b00001001 && bits(20, 21) == 0b00) {
+        return SWAP;
+    }
+    if (bits(26, 27) == 0b00 && bits(23, 24) == 0b10 && bits(20, 20) == 0b0) {
+        return PSR_TRANSFER;
+    }
+    if (bits(22, 27) == 0b000000 && bits(4, 7) == 0b1001) {
+        return MULTIPLY;
+    }
+    if (bits(23, 27) == 0b00001 && bits(4, 7) == 0b1001) {
+        return MULTIPLY_LONG;
+    }
+    if (bits(25, 27) == 0b000 && bits(7, 7) && bits(4, 4)) {
+        return HALF_WORD_SIGNED_DATA_TRANSFER;
+    }
+    if (bits(26, 27) == 0b00) {
+        return ALU;
+    }
+    if (bits(26, 27) == 0b01) {
+        return SINGLE_DATA_TRANSFER;
+    }
+    if (bits(25, 27) == 0b100) {
+        return BLOCK_DATA_TRANSFER;
+    }
+    return UNDEFINED;
+}
+
+// Every key against the reference, with BX's should-be-one bits 8-19 set
+// and every other bit outside the key clear.
+static constexpr bool arm_keys_match_reference()
+{
+    for (Word key = 0; key < 0x1000; key++) {
+        Word opcode = ((key >> 4) << 20) | ((key & 0xF) << 4);
+        if ((key >> 4) == 0b0001'0010 && (key & 0xF) == 0b0001) {
+            opcode |= 0xFFF << 8;
+        }
+        if (classify_opcode_arm(key) != reference_decode_opcode_arm(opcode)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(arm_keys_match_reference(), "ARM decode keys classify differently from the reference decoder");
+
+static constexpr ARM7TDMI::ArmOpcodeHandler arm_opcode_handler(ArmOpcodeType opcode_type)
+{
+    switch (opcode_type)
+    {
+        case BRANCH: return &ARM7TDMI::arm_opcode_branch;
+        case BX: return &ARM7TDMI::arm_opcode_branch_exchange;
+        case SWI: return &ARM7TDMI::arm_opcode_software_interrupt;
+        case UNDEFINED: return &ARM7TDMI::arm_opcode_undefined_intruction;
+        case MULTIPLY: return &ARM7TDMI::arm_opcode_multiply;
+        case MULTIPLY_LONG: return &ARM7TDMI::arm_opcode_multiply_long;
+        case PSR_TRANSFER: return &ARM7TDMI::arm_opcode_psr_transfer;
+        case SINGLE_DATA_TRANSFER: return &ARM7TDMI::arm_opcode_single_data_transfer;
+        case HALF_WORD_SIGNED_DATA_TRANSFER: return &ARM7TDMI::arm_opcode_half_word_signed_data_transfer;
+        case BLOCK_DATA_TRANSFER: return &ARM7TDMI::arm_opcode_block_data_transfer;
+        case SWAP: return &ARM7TDMI::arm_opcode_swap;
+        default: break;
+    }
+    return &ARM7TDMI::arm_opcode_undefined_intruction;
+}
+
+// Data processing keys select a specialised handler from bits 9-0 of the key:
+// I (25), opcode (24 - 21), S (20), shift type (6 - 5) and shift by register (4).
+template <std::size_t key>
+static constexpr ARM7TDMI::ArmOpcodeHandler data_processing_handler()
+{
+    constexpr Word instruction_type = (key >> 5) & 0xF;
+    constexpr bool set_condition_codes = (key >> 4) & 0b1;
+    constexpr Word operand_form = 
+        (key >> 9) & 0b1 ? OpcodeDataProcess::OPERAND_IMMEDIATE :
+        key & 0b1        ? OpcodeDataProcess::OPERAND_REGISTER_SHIFT_REGISTER :
+                           OpcodeDataProcess::OPERAND_REGISTER_SHIFT_IMMEDIATE;
+    constexpr Word shift_type = operand_form == OpcodeDataProcess::OPERAND_IMMEDIATE 
+        ? static_cast<Word>(OpcodeDataProcess::LSL)
+        : static_cast<Word>((key >> 1) & 0b11);
+
+    return &ARM7TDMI::arm_opcode_data_processing<instruction_type, set_condition_codes, operand_form, shift_type>;
+}
+
+template <std::size_t... keys>
+static constexpr std::array<ARM7TDMI::ArmOpcodeHandler, sizeof...(keys)> build_data_processing_handlers(std::index_sequence<keys...>)
+{
+    return {{data_processing_handler<keys>()...}};
+}
+
+static constexpr std::array<ARM7TDMI::ArmOpcodeHandler, 0x1000> build_arm_opcode_handlers()
+{
+    constexpr std::array<ARM7TDMI::ArmOpcodeHandler, 0x400> data_processing_handlers = build_data_processing_handlers(std::make_index_sequence<0x400>());
+
+    std::array<ARM7TDMI::ArmOpcodeHandler, 0x1000> handlers = {};
+    for (Word key = 0; key < handlers.size(); key++) {
+        ArmOpcodeType opcode_type = classify_opcode_arm(key);
+        if (opcode_type == ALU) {
+            handlers[key] = data_processing_handlers[key & 0x3FF];
+        } else {
+            handlers[key] = arm_opcode_handler(opcode_type);
+        }
+    }
+    return handlers;
+}
+
+const std::array<ARM7TDMI::ArmOpcodeHandler, 0x1000> ARM7TDMI::arm_opcode_handlers = build_arm_opcode_handlers();
+
+ArmOpcodeType ARM7TDMI::decode_opcode_arm(Word opcode)
+{
+    return classify_opcode_arm(arm_decode_key(opcode));
+}
+
+// Every register field is read from its usual place whatever the format,
+// immediates only where the format has one.
+ARM7TDMI::ArmBlockInstruction ARM7TDMI::decode_arm_instruction(Word opcode)
+{
+    ArmBlockInstruction instruction = {
+        arm_opcode_handlers[arm_decode_key(opcode)],
+        opcode,
+        (Byte)(opcode >> 28),
+        (Byte)((opcode >> 12) & 0xF),
+        (Byte)((opcode >> 16) & 0xF),
+        (Byte)(opcode & 0xF),
+        (Byte)((opcode >> 8) & 0xF),
+        (Byte)((opcode >> 7) & 0x1F),
+        0
+    };
+
+    switch (classify_opcode_arm(arm_decode_key(opcode)))
+    {
+        case ALU:
+            if (Utils::read_bit(opcode, 25)) {
+                instruction.shift_amount = ((opcode >> 8) & 0xF) * 2;
+                instruction.immediate = CpuALU::rotate_right(opcode & 0xFF, instruction.shift_amount, false).value;
+            }
+            break;
+        case SINGLE_DATA_TRANSFER:
+            instruction.immediate = opcode & 0xFFF;
+            break;
+        case HALF_WORD_SIGNED_DATA_TRANSFER:
+            instruction.immediate = ((opcode >> 4) & 0xF0) | (opcode & 0xF);
+            break;
+        case BRANCH:
+            instruction.immediate = Utils::sign_extend((opcode & 0xFFFFFF) << 2, 26);
+            break;
+        default:
+            break;
+    }
+    return instruction;
+}
+
+// Classifies a THUMB opcode from its decode key (bits 15-6), which holds every
+// bit the formats are distinguished by.
+static constexpr ThumbOpcodeType classify_opcode_thumb(Word key) {
+    auto get_bitregion = [key](Word region_start, Word region_end) {
+        return (key >> (region_start - 6)) & ((1 << (region_end - region_start + 1)) - 1);
+    };
+    auto get_bit = [key](Word bit) {
+        return (key >> (bit - 6)) & 1;
+    };
+
+    if (get_bitregion(11, 15) == 0b00011) {
+        return ADD_SUBTRACT;
+    }
+    if (get_bitregion(13, 15) == 0b000) {
+        return MOVE_SHIFTED_REGISTER;
+    }
+    if (get_bitregion(13, 15) == 0b001) {
+        return MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE;
+    }
+    if (get_bitregion(10, 15) == 0b010000) {
+        return ALU_OPERATION;
+    }
+    if (get_bitregion(10, 15) == 0b010001) {
+        return HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE;
+    }
+    if (get_bitregion(11, 15) == 0b01001) {
+        return PC_RELATIVE_LOAD;
+    }
+    if (get_bitregion(12, 15) == 0b0101 && get_bit(9) == 0b0) {
+        return LOAD_STORE_REGISTER_OFFSET;
+    }
+    if (get_bitregion(12, 15) == 0b0101 && get_bit(9) == 0b1) {
+        return LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD;
+    }
+    if (get_bitregion(13, 15) == 0b011) {
+        return LOAD_STORE_IMMEDIATE_OFFSET;
+    }
+    if (get_bitregion(12, 15) == 0b1000) {
+        return LOAD_STORE_HALFWORD;
+    }
+    if (get_bitregion(12, 15) == 0b1001) {
+        return SP_RELATIVE_LOAD_STORE;
+    }
+    if (get_bitregion(12, 15) == 0b1010) {
+        return LOAD_ADDRESS;
+    }
+    if (get_bitregion(8,  15) == 0b10110000) {
+        return ADD_OFFSET_TO_STACK_POINTER;
+    }
+    if (get_bitregion(12, 15) == 0b1011 && get_bitregion(9, 10) == 0b10) {
+        return PUSH_POP_REGISTERS;
+    }
+    if (get_bitregion(12, 15) == 0b1100) {
+        return MULTIPLE_LOAD_STORE;
+    }
+    if (get_bitregion(8,  15) == 0b11011111) {
+        return SOFTWARE_INTERRUPT;
+    }
+    if (get_bitregion(12, 15) == 0b1101) {
+        return CONDITIONAL_BRANCH;
+    }
+    if (get_bitregion(11, 15) == 0b11100) {
+        return UNCONDITIONAL_BRANCH;
+    }
+    if (get_bitregion(12, 15) == 0b1111) {
+        return LONG_BRANCH_WITH_LINK;
+    }
+    return THUMB_UNDEFINED;
+}
+
+// The decoder the table replaced, on full opcodes, kept to check the
+// classifier against. Undefined encodings used to assert.
+static constexpr ThumbOpcodeType reference_decode_opcode_thumb(HalfWord opcode)
+{
     auto get_bitregion = [opcode](Word region_start, Word region_end) {
-        return Utils::read_bit_range(opcode, region_start, region_end);
+        return (opcode >> region_start) & ((1 << (region_end - region_start + 1)) - 1);
     };
     auto get_bit = [opcode](Word bit) {
-        return Utils::read_bit(opcode, bit);
+        return (opcode >> bit) & 1;
     };
+
     if (get_bitregion(11, 15) == 0b00011) {
         return ADD_SUBTRACT;
     }
@@ -126,7 +376,141 @@ ThumbOpcodeType ARM7TDMI::decode_opcode_thumb(HalfWord opcode) {
     if (get_bitregion(12, 15) == 0b1111) {
         return LONG_BRANCH_WITH_LINK;
     }
+    return THUMB_UNDEFINED;
+}
+
+// Every key against the reference, with bits 5-0 all clear and all set,
+// as bits below the key must not change the type.
+static constexpr bool thumb_keys_match_reference()
+{
+    for (Word key = 0; key < 0x400; key++) {
+        HalfWord opcode = key << 6;
+        if (classify_opcode_thumb(key) != reference_decode_opcode_thumb(opcode)
+        ||  classify_opcode_thumb(key) != reference_decode_opcode_thumb(opcode | 0x3F)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(thumb_keys_match_reference(), "THUMB decode keys classify differently from the reference decoder");
 
-    SDL_assert(false);
-    return ALU_OPERATION;
-}
\ No newline at end of file
+static constexpr ARM7TDMI::ThumbOpcodeHandler thumb_opcode_handler(Word key)
+{
+    switch (classify_opcode_thumb(key))
+    {
+        case MOVE_SHIFTED_REGISTER: return &ARM7TDMI::thumb_opcode_move_shifted_register;
+        case ADD_SUBTRACT: return &ARM7TDMI::thumb_opcode_add_subtract;
+        case MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE: return &ARM7TDMI::thumb_opcode_move_compare_add_subtract;
+        case ALU_OPERATION: return &ARM7TDMI::thumb_opcode_alu_operations;
+        case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE: return &ARM7TDMI::thumb_opcode_hi_register_operations_branch_exchange;
+        case PC_RELATIVE_LOAD: return &ARM7TDMI::thumb_opcode_pc_relative_load;
+        case LOAD_STORE_REGISTER_OFFSET: return &ARM7TDMI::thumb_opcode_load_store_register_offset;
+        case LOAD_STORE_SIGN_EXTENDED_BYTE_HALFWORD: return &ARM7TDMI::thumb_opcode_load_store_sign_extended_byte_halfword;
+        case LOAD_STORE_IMMEDIATE_OFFSET: return &ARM7TDMI::thumb_opcode_load_store_immediate_offset;
+        case LOAD_STORE_HALFWORD: return &ARM7TDMI::thumb_opcode_load_store_halfword;
+        case SP_RELATIVE_LOAD_STORE: return &ARM7TDMI::thumb_opcode_sp_relative_load_store;
+        case LOAD_ADDRESS: return &ARM7TDMI::thumb_opcode_load_address;
+        case ADD_OFFSET_TO_STACK_POINTER: return &ARM7TDMI::thumb_opcode_add_offset_to_stack_pointer;
+        case PUSH_POP_REGISTERS: return &ARM7TDMI::thumb_opcode_push_pop_registers;
+        case MULTIPLE_LOAD_STORE: return &ARM7TDMI::thumb_opcode_multiple_load_store;
+        case CONDITIONAL_BRANCH: return &ARM7TDMI::thumb_opcode_conditional_branch;
+        case SOFTWARE_INTERRUPT: return &ARM7TDMI::thumb_opcode_software_interrupt;
+        case UNCONDITIONAL_BRANCH: return &ARM7TDMI::thumb_opcode_unconditional_branch;
+        case LONG_BRANCH_WITH_LINK: return &ARM7TDMI::thumb_opcode_long_branch_with_link;
+        case THUMB_UNDEFINED: break;
+    }
+    return &ARM7TDMI::thumb_opcode_undefined_instruction;
+}
+
+static constexpr std::array<ARM7TDMI::ThumbOpcodeHandler, 0x400> build_thumb_opcode_handlers()
+{
+    std::array<ARM7TDMI::ThumbOpcodeHandler, 0x400> handlers = {};
+    for (Word key = 0; key < handlers.size(); key++) {
+        handlers[key] = thumb_opcode_handler(key);
+    }
+    return handlers;
+}
+
+const std::array<ARM7TDMI::ThumbOpcodeHandler, 0x400> ARM7TDMI::thumb_opcode_handlers = build_thumb_opcode_handlers();
+
+ThumbOpcodeType ARM7TDMI::decode_opcode_thumb(HalfWord opcode) {
+    return classify_opcode_thumb(thumb_decode_key(opcode));
+}
+
+ARM7TDMI::ThumbBlockInstruction ARM7TDMI::decode_thumb_instruction(HalfWord opcode)
+{
+    ThumbBlockInstruction instruction = {
+        thumb_opcode_handlers[thumb_decode_key(opcode)],
+        opcode,
+        0xE,
+        (Byte)(opcode & 0x7),
+        (Byte)((opcode >> 3) & 0x7),
+        (Byte)((opcode >> 6) & 0x7),
+        0
+    };
+    Byte high_register = (opcode >> 8) & 0x7;
+    Word offset_5 = (opcode >> 6) & 0x1F;
+    Word word_8 = opcode & 0xFF;
+
+    switch (classify_opcode_thumb(thumb_decode_key(opcode)))
+    {
+        case MOVE_SHIFTED_REGISTER:
+            instruction.immediate = offset_5;
+            break;
+        case ADD_SUBTRACT:
+            instruction.immediate = instruction.rn;
+            break;
+        case MOVE_COMPARE_ADD_SUBTRACT_IMMEDIATE:
+        case MULTIPLE_LOAD_STORE:
+            instruction.rd = high_register;
+            instruction.immediate = word_8;
+            break;
+        case HI_REGISTER_OPERATIONS_BRANCH_EXCHANGE:
+            instruction.rd |= Utils::read_bit(opcode, 7) << 3;
+            instruction.rs |= Utils::read_bit(opcode, 6) << 3;
+            break;
+        case PC_RELATIVE_LOAD:
+        case SP_RELATIVE_LOAD_STORE:
+        case LOAD_ADDRESS:
+            instruction.rd = high_register;
+            instruction.immediate = word_8 << 2;
+            break;
+        case LOAD_STORE_IMMEDIATE_OFFSET:
+            instruction.immediate = Utils::read_bit(opcode, 12) ? offset_5 : offset_5 << 2;
+            break;
+        case LOAD_STORE_HALFWORD:
+            instruction.immediate = offset_5 << 1;
+            break;
+        case ADD_OFFSET_TO_STACK_POINTER:
+            instruction.immediate = (opcode & 0x7F) << 2;
+            if (Utils::read_bit(opcode, 7)) {
+                instruction.immediate = -instruction.immediate;
+            }
+            break;
+        case PUSH_POP_REGISTERS: // PUSH can add LR and POP the PC
+            instruction.immediate = word_8;
+            if (Utils::read_bit(opcode, 8)) {
+                instruction.immediate |= 1 << (Utils::read_bit(opcode, 11) ? REGISTER_PC : REGISTER_LR);
+            }
+            break;
+        case CONDITIONAL_BRANCH:
+            instruction.condition = (opcode >> 8) & 0xF;
+            instruction.immediate = Utils::sign_extend(word_8 << 1, 9);
+            break;
+        case SOFTWARE_INTERRUPT:
+            instruction.immediate = word_8;
+            break;
+        case UNCONDITIONAL_BRANCH:
+            instruction.immediate = Utils::sign_extend((opcode & 0x7FF) << 1, 12);
+            break;
+        case LONG_BRANCH_WITH_LINK: // The first half holds the high part of the offset
+            instruction.immediate = Utils::read_bit(opcode, 11)
+                ? (opcode & 0x7FF) << 1
+                : Utils::sign_extend((opcode & 0x7FF) << 12, 23);
+            break;
+        default:
+            break;
+    }
+    return instruction;
+}
@@ -85,6 +85,8 @@ std::string dissassemble_opcode_thumb(ThumbOpcodeType opcode_type) {
             return "UNCONDITIONAL_BRANCH";
         case LONG_BRANCH_WITH_LINK:
             return "LONG_BRANCH_WITH_LINK";
+        case THUMB_UNDEFINED:
+            return "UNDEFINED";
     }
 
     SDL_assert(false);
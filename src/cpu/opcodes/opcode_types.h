@@ -39,7 +39,8 @@ enum ThumbOpcodeType
     CONDITIONAL_BRANCH,
     SOFTWARE_INTERRUPT,
     UNCONDITIONAL_BRANCH,
-    LONG_BRANCH_WITH_LINK
+    LONG_BRANCH_WITH_LINK,
+    THUMB_UNDEFINED,
 };
 
 #endif
\ No newline at end of file
@@ -6,9 +6,23 @@ void ARM7TDMI::emulate_software_interrupt(Word opcode) {
     switch (opcode)
     {
         case 0x2: { // HALT
+            halted = true;
             break;
         }
-        case 0x5: { // VBLANK HALT
+        case 0x4: // INTERRUPT WAIT
+        case 0x5: { // VBLANK INTERRUPT WAIT
+            bool discard_old_flags = opcode == 0x5 || read_register(0) != 0;
+            interrupt_wait_flags = opcode == 0x5 ? (1 << INTERRUPT_VBLANK) : read_register(1);
+            interrupt_wait_return = read_register(REGISTER_PC) + (cpsr.t() == STATE_THUMB ? 2 : 4);
+
+            if (discard_old_flags) {
+                HalfWord interrupt_check = read_halfword_from_memory(BIOS_INTERRUPT_CHECK_ADDRESS);
+                write_halfword_to_memory(BIOS_INTERRUPT_CHECK_ADDRESS, interrupt_check & ~interrupt_wait_flags);
+            }
+            irq_manager.set_master_enable(true);
+
+            interrupt_wait = !check_interrupt_wait();
+            halted = interrupt_wait;
             break;
         }
         case 0x6: { // DIVISION
@@ -69,4 +83,20 @@ void ARM7TDMI::emulate_software_interrupt(Word opcode) {
             run_exception(EXCEPTION_SOFTWARE_INTERRUPT);
             break;
     }
-}
\ No newline at end of file
+}
+// The BIOS loop behind IntrWait, the game's interrupt handler sets the flags it waits for.
+bool ARM7TDMI::check_interrupt_wait() {
+    HalfWord interrupt_check = read_halfword_from_memory(BIOS_INTERRUPT_CHECK_ADDRESS);
+    if ((interrupt_check & interrupt_wait_flags) == 0) {
+        return false;
+    }
+
+    write_halfword_to_memory(BIOS_INTERRUPT_CHECK_ADDRESS, interrupt_check & ~interrupt_wait_flags);
+    return true;
+}
+
+void ARM7TDMI::wake_on_interrupt() {
+    if (halted && irq_manager.interrupt_requested) {
+        halted = false;
+    }
+}
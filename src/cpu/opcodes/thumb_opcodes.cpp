@@ -1,437 +1,372 @@
 #include "src/cpu/cpu.h"
 
-#include "src/cpu/opcodes/arm/branch.h"
+#include "src/cpu/alu.h"
 #include "src/cpu/opcodes/arm/data_processing.h"
-#include "src/cpu/opcodes/arm/multiply.h"
 #include "src/cpu/opcodes/arm/single_data_transfer.h"
 #include "src/cpu/opcodes/arm/half_word_signed_data_transfer.h"
-#include "src/cpu/opcodes/arm/block_data_transfer.h"
-#include "src/cpu/opcodes/arm/branch_exchange.h"
 
 #include <SDL3/SDL.h>
 #include "opcode_types.h"
 
-void ARM7TDMI::thumb_opcode_move_shifted_register(HalfWord opcode) {
-    Byte sub_opcode = Utils::read_bit_range(opcode, 11, 12);
-    Byte offset = Utils::read_bit_range(opcode, 6, 10);
-    Byte source_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte destination_register = Utils::read_bit_range(opcode, 0, 2);
+// THUMB instructions run directly on the register file and CPSR
+// rather than being translated into ARM opcode objects first.
 
-    OpcodeDataProcess::BitShiftType shift_type;
+static void set_logical_flags(ARM7TDMI * cpu, Word result) {
+    cpu->cpsr.set_nz(result);
+}
 
-    switch (sub_opcode)
-    {
-        case 0:
-            shift_type = OpcodeDataProcess::LSL;
-            break;
-        case 1:
-            shift_type = OpcodeDataProcess::LSR;
-            break;
-        case 2:
-            shift_type = OpcodeDataProcess::ASR;
-            break;
-    }
+static Word add_with_flags(ARM7TDMI * cpu, Word op1, Word op2, bool carry) {
+    Word result = CpuALU::add_with_carry(op1, op2, carry).value;
+    cpu->cpsr.set_nzcv_add(op1, op2, result);
+    return result;
+}
 
-    OpcodeDataProcessingBuilder(OpcodeDataProcess::MOV, true)
-    .set_destination_register(destination_register)
-    .set_register_op2(source_register, shift_type)
-    .set_register_op2_shift_immediate(offset)
-    .get_product()
-    .run(this);
+static Word subtract_with_flags(ARM7TDMI * cpu, Word op1, Word op2, bool carry) {
+    Word result = CpuALU::subtract_with_carry(op1, op2, carry).value;
+    cpu->cpsr.set_nzcv_subtract(op1, op2, result);
+    return result;
+}
+
+// Shift with the carry out written to the C flag. A shift amount of 0 leaves C unchanged.
+static Word shift_with_flags(ARM7TDMI * cpu, Word value, Byte shift_amount, OpcodeDataProcess::BitShiftType shift_type) {
+    if (shift_amount == 0) {
+        return value;
+    }
+    ShiftResult result = OpcodeDataProcess::shift_op2(value, shift_amount, shift_type, cpu->cpsr.c());
+    cpu->cpsr.set_c(result.carry);
+    return result.value;
 }
 
-void ARM7TDMI::thumb_opcode_add_subtract(HalfWord opcode) {
-    bool immediate_flag = Utils::read_bit(opcode, 10);
-    bool sub_opcode = Utils::read_bit(opcode, 9);
+// LDMIA/STMIA with writeback, or the full descending stack (STMDB) when decrement is set.
+static void block_data_transfer(ARM7TDMI * cpu, bool load, Byte base_register, HalfWord register_list, bool decrement) {
+    Word base_address = cpu->read_register(base_register);
+    Word transfer_size = __builtin_popcount(register_list) * 4;
 
-    Byte op2_register_immediate = Utils::read_bit_range(opcode, 6, 8);    
-    Byte source_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte destination_register = Utils::read_bit_range(opcode, 0, 2);
+    if (register_list == 0b0) {
+        register_list = 0x8000;
+        transfer_size = 0x40;
+    }
 
-    OpcodeDataProcess::InstructionType instruction_type;
+    Word write_back_address = decrement ? base_address - transfer_size : base_address + transfer_size;
+    Word current_address = decrement ? write_back_address : base_address;
+    bool first_register = true;
 
-    switch (sub_opcode)
-    {
-        case 0:
-            instruction_type = OpcodeDataProcess::ADD;
-            break;
-        case 1:
-            instruction_type = OpcodeDataProcess::SUB;
-            break;
+    cpu->write_register(base_register, write_back_address);
+    if (load) {
+        cpu->add_internal_cycles(1);
     }
 
-    OpcodeDataProcessingBuilder builder = OpcodeDataProcessingBuilder(instruction_type, true)
-    .set_destination_register(destination_register)
-    .set_source_register(source_register);
+    for (int i = 0; i < 16; i++) {
+        if (Utils::read_bit(register_list, i) == 0) {continue;}
+
+        cpu->add_data_cycles(current_address, ACCESS_32, first_register ? ACCESS_NONSEQUENTIAL : ACCESS_SEQUENTIAL);
+
+        if (load) { // Memory -> Register
+            cpu->write_register(i, cpu->read_word_from_memory(current_address));
+        } else { // Register -> Memory
+            Word register_value = cpu->read_register(i);
+            if (i == base_register && first_register) {
+                register_value = base_address;
+            } else if (i == REGISTER_PC) {
+                register_value += 6;
+            }
+            cpu->write_word_to_memory(current_address, register_value);
+        }
 
-    if (immediate_flag) {
-        builder.set_immediate_op2(op2_register_immediate, 0);
-    } else {
-        builder.set_register_op2(op2_register_immediate, 0)
-        .set_register_op2_shift_immediate(0);
+        first_register = false;
+        current_address += 4;
+    }
+}
+
+void ARM7TDMI::thumb_opcode_move_shifted_register(const ThumbBlockInstruction & instruction) {
+    Byte sub_opcode = Utils::read_bit_range(instruction.opcode, 11, 12);
+    Byte offset = instruction.immediate;
+
+    OpcodeDataProcess::BitShiftType shift_type = (OpcodeDataProcess::BitShiftType)sub_opcode;
+    Word source_value = read_register(instruction.rs);
+
+    // LSR #0 and ASR #0 encode a shift by 32
+    if (offset == 0 && shift_type != OpcodeDataProcess::LSL) {
+        offset = 32;
     }
-    
-    builder.get_product().run(this);
+
+    Word result = shift_with_flags(this, source_value, offset, shift_type);
+    set_logical_flags(this, result);
+    write_register(instruction.rd, result);
 }
 
-void ARM7TDMI::thumb_opcode_move_compare_add_subtract(HalfWord opcode) {
-    Byte opcode_instruction_type = Utils::read_bit_range(opcode, 11, 12);
-    Byte source_destination_register = Utils::read_bit_range(opcode, 8, 10);
-    Byte immediate = Utils::read_bit_range(opcode, 0, 7);
+void ARM7TDMI::thumb_opcode_add_subtract(const ThumbBlockInstruction & instruction) {
+    bool immediate_flag = Utils::read_bit(instruction.opcode, 10);
+    bool sub_opcode = Utils::read_bit(instruction.opcode, 9);
+
+    Word op1 = read_register(instruction.rs);
+    Word op2 = immediate_flag ? instruction.immediate : read_register(instruction.rn);
+
+    Word result = sub_opcode
+        ? subtract_with_flags(this, op1, op2, true)
+        : add_with_flags(this, op1, op2, false);
+
+    write_register(instruction.rd, result);
+}
 
-    OpcodeDataProcess::InstructionType instruction_type;
+void ARM7TDMI::thumb_opcode_move_compare_add_subtract(const ThumbBlockInstruction & instruction) {
+    Byte opcode_instruction_type = Utils::read_bit_range(instruction.opcode, 11, 12);
+    Byte source_destination_register = instruction.rd;
+    Word immediate = instruction.immediate;
+
+    Word register_value = read_register(source_destination_register);
 
     switch (opcode_instruction_type)
     {
-        case 0: instruction_type = OpcodeDataProcess::MOV; break;
-        case 1: instruction_type = OpcodeDataProcess::CMP; break;
-        case 2: instruction_type = OpcodeDataProcess::ADD; break;
-        case 3: instruction_type = OpcodeDataProcess::SUB; break;
+        case 0: // MOV
+            set_logical_flags(this, immediate);
+            write_register(source_destination_register, immediate);
+            break;
+        case 1: // CMP
+            subtract_with_flags(this, register_value, immediate, true);
+            break;
+        case 2: // ADD
+            write_register(source_destination_register, add_with_flags(this, register_value, immediate, false));
+            break;
+        case 3: // SUB
+            write_register(source_destination_register, subtract_with_flags(this, register_value, immediate, true));
+            break;
     }
-
-    OpcodeDataProcessingBuilder(instruction_type, true)
-    .set_destination_register(source_destination_register)
-    .set_source_register(source_destination_register)
-    .set_immediate_op2(immediate, 0)
-    .get_product()
-    .run(this);
 }
 
-void ARM7TDMI::thumb_opcode_alu_operations(HalfWord opcode) {
-    Byte sub_opcode = Utils::read_bit_range(opcode, 6, 9);
-    Byte source_register_2 = Utils::read_bit_range(opcode, 3, 5);
-    Byte source_destination_register = Utils::read_bit_range(opcode, 0, 2);
+void ARM7TDMI::thumb_opcode_alu_operations(const ThumbBlockInstruction & instruction) {
+    Byte sub_opcode = Utils::read_bit_range(instruction.opcode, 6, 9);
+    Byte source_destination_register = instruction.rd;
 
-    OpcodeDataProcess::InstructionType instruction_type;
-    
-    bool multiply = false;
-    bool neg = false;
+    Word op1 = read_register(source_destination_register);
+    Word op2 = read_register(instruction.rs);
+    Word result;
 
-    bool mov_shift = false;
-    OpcodeDataProcess::BitShiftType shift_type;
+    bool register_shift = sub_opcode == 0x2 || sub_opcode == 0x3 || sub_opcode == 0x4 || sub_opcode == 0x7;
+    if (register_shift) {
+        add_internal_cycles(1);
+    }
 
     switch (sub_opcode)
     {
-        case 0x0: instruction_type = OpcodeDataProcess::AND; break;
-        case 0x1: instruction_type = OpcodeDataProcess::EOR; break;
-        case 0x2: mov_shift = true; shift_type = OpcodeDataProcess::LSL; break; // LSL
-        case 0x3: mov_shift = true; shift_type = OpcodeDataProcess::LSR; break; // LSR
-        case 0x4: mov_shift = true; shift_type = OpcodeDataProcess::ASR; break; // ASR
-        case 0x5: instruction_type = OpcodeDataProcess::ADC; break;
-        case 0x6: instruction_type = OpcodeDataProcess::SBC; break;
-        case 0x7: mov_shift = true; shift_type = OpcodeDataProcess::ROR; break; // ROR
-
-        case 0x8: instruction_type = OpcodeDataProcess::TST; break;
-        case 0x9: neg = true; break; // NEG
-        case 0xa: instruction_type = OpcodeDataProcess::CMP; break;
-        case 0xb: instruction_type = OpcodeDataProcess::CMN; break;
-        case 0xc: instruction_type = OpcodeDataProcess::ORR; break;
-        case 0xd: multiply = true; break; // MULTIPLY
-        case 0xe: instruction_type = OpcodeDataProcess::BIC; break;
-        case 0xf: instruction_type = OpcodeDataProcess::MVN; break;
+        case 0x0: result = op1 & op2; break; // AND
+        case 0x1: result = op1 ^ op2; break; // EOR
+        case 0x2: result = shift_with_flags(this, op1, op2 & 0xFF, OpcodeDataProcess::LSL); break; // LSL
+        case 0x3: result = shift_with_flags(this, op1, op2 & 0xFF, OpcodeDataProcess::LSR); break; // LSR
+        case 0x4: result = shift_with_flags(this, op1, op2 & 0xFF, OpcodeDataProcess::ASR); break; // ASR
+        case 0x5: // ADC
+            write_register(source_destination_register, add_with_flags(this, op1, op2, cpsr.c()));
+            return;
+        case 0x6: // SBC
+            write_register(source_destination_register, subtract_with_flags(this, op1, op2, cpsr.c()));
+            return;
+        case 0x7: result = shift_with_flags(this, op1, op2 & 0xFF, OpcodeDataProcess::ROR); break; // ROR
+        case 0x8: // TST
+            set_logical_flags(this, op1 & op2);
+            return;
+        case 0x9: // NEG
+            write_register(source_destination_register, subtract_with_flags(this, 0, op2, true));
+            return;
+        case 0xa: // CMP
+            subtract_with_flags(this, op1, op2, true);
+            return;
+        case 0xb: // CMN
+            add_with_flags(this, op1, op2, false);
+            return;
+        case 0xc: result = op1 | op2; break; // ORR
+        case 0xd: // MUL
+            add_internal_cycles(multiply_cycles(op1, true));
+            result = op1 * op2;
+            break;
+        case 0xe: result = op1 & (~op2); break; // BIC
+        case 0xf: result = ~op2; break; // MVN
     }
 
-    if (multiply) {
-        OpcodeMultiplyBuilder(
-            source_destination_register, 
-            source_destination_register, 
-            source_register_2, 
-            true
-        ).get_product().run(this);
-    } else if (mov_shift) {
-        OpcodeDataProcessingBuilder(OpcodeDataProcess::MOV, true)
-        .set_destination_register(source_destination_register)
-        .set_register_op2(source_destination_register, shift_type)
-        .set_register_op2_shift_register(source_register_2)
-        .get_product().run(this);
-    } else if (neg) {
-        OpcodeDataProcessingBuilder(OpcodeDataProcess::RSB, true)
-        .set_destination_register(source_destination_register)
-        .set_source_register(source_register_2)
-        .set_immediate_op2(0, 0)
-        .get_product().run(this);
-    } else {
-        OpcodeDataProcessingBuilder(instruction_type, true)
-        .set_destination_register(source_destination_register)
-        .set_source_register(source_destination_register)
-        .set_register_op2(source_register_2, 0)
-        .set_register_op2_shift_immediate(0)
-        .get_product().run(this);
-    }
+    set_logical_flags(this, result);
+    write_register(source_destination_register, result);
 }
 
-void ARM7TDMI::thumb_opcode_hi_register_operations_branch_exchange(HalfWord opcode) {
-    Byte opcode_instruction_type = Utils::read_bit_range(opcode, 8, 9);
-    bool hi_operand_flag_1 = Utils::read_bit(opcode, 7);
-    bool hi_operand_flag_2 = Utils::read_bit(opcode, 6);
-
-    Byte source_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte destination_register = Utils::read_bit_range(opcode, 0, 2);
-    Byte source_hi_register = source_register + 8;
-    Byte destination_hi_register = destination_register + 8;
-    
-    Byte target_destination_register = hi_operand_flag_1 ? destination_hi_register : destination_register;
-    Byte target_source_register = hi_operand_flag_2 ? source_hi_register : source_register;
+void ARM7TDMI::thumb_opcode_hi_register_operations_branch_exchange(const ThumbBlockInstruction & instruction) {
+    Byte opcode_instruction_type = Utils::read_bit_range(instruction.opcode, 8, 9);
+    Byte target_destination_register = instruction.rd;
+    Byte target_source_register = instruction.rs;
 
     if (opcode_instruction_type == 3) { // BX
         if (target_source_register == REGISTER_PC) {
             write_register(REGISTER_PC, (read_register(REGISTER_PC)+4)&(~2));
-            cpsr.t = STATE_ARM;
+            cpsr.set_t(STATE_ARM);
             return;
         } 
 
-        OpcodeBranchExchange branch_exchange;
-        OpcodeBranchExchange::build(&branch_exchange, target_source_register);
-        branch_exchange.run(this);
+        Word register_value = read_register(target_source_register);
+        if (Utils::read_bit(register_value, 0)) {
+            cpsr.set_t(STATE_THUMB);
+            write_register(REGISTER_PC, register_value - 1);
+        } else {
+            cpsr.set_t(STATE_ARM);
+            write_register(REGISTER_PC, register_value);
+        }
         return;
     }
 
-    OpcodeDataProcess::InstructionType instruction_type;
+    Word destination_value = read_register(target_destination_register);
+    Word source_value = read_register(target_source_register);
+    if (target_destination_register == REGISTER_PC) {
+        destination_value = (destination_value + 4) & (~1);
+    }
+    if (target_source_register == REGISTER_PC) {
+        source_value = (source_value + 4) & (~1);
+    }
+
     switch (opcode_instruction_type)
     {
         case 0: // ADD
-            instruction_type = OpcodeDataProcess::ADD;
+            write_register(target_destination_register, destination_value + source_value);
             break;
         case 1: // CMP
-            instruction_type = OpcodeDataProcess::CMP;
+            subtract_with_flags(this, destination_value, source_value, true);
             break;
         case 2: // MOV
-            instruction_type = OpcodeDataProcess::MOV;
+            write_register(target_destination_register, source_value);
             break;
     }
-
-    OpcodeDataProcessingBuilder(instruction_type, instruction_type == OpcodeDataProcess::CMP ? true : false)
-    .set_destination_register(target_destination_register)
-    .set_source_register(target_destination_register)
-    .set_register_op2(target_source_register, 0)
-    .set_register_op2_shift_immediate(0)
-    .get_product().run(this);
-
-    
-}
-
-void ARM7TDMI::thumb_opcode_pc_relative_load(HalfWord opcode) {
-    Byte destination_register = Utils::read_bit_range(opcode, 8, 10);
-    Word word_8 = Utils::read_bit_range(opcode, 0, 7);
-
-    Word immediate = word_8 << 2;
-
-    OpcodeSingleDataTransferBuilder(true, REGISTER_PC, destination_register)
-    .set_flags(true, true, false, false)
-    .set_offset_immediate(immediate)
-    .get_product().run(this);
 }
 
-void ARM7TDMI::thumb_opcode_load_store_register_offset(HalfWord opcode) {
-    bool load = Utils::read_bit(opcode, 11);
-    bool byte = Utils::read_bit(opcode, 10);
-
-    Byte offset_register = Utils::read_bit_range(opcode, 6, 8);
-    Byte base_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte source_destination_register = Utils::read_bit_range(opcode, 0, 2);
+void ARM7TDMI::thumb_opcode_pc_relative_load(const ThumbBlockInstruction & instruction) {
+    Word address = ((read_register(REGISTER_PC) + 4) & (~0b11)) + instruction.immediate;
+    add_data_cycles(address, ACCESS_32, ACCESS_NONSEQUENTIAL);
+    add_internal_cycles(1);
 
-    OpcodeSingleDataTransferBuilder(load, base_register, source_destination_register)
-    .set_flags(true, true, byte, false)
-    .set_offset_register(offset_register, 0, 0)
-    .get_product().run(this);
+    write_register(instruction.rd, read_word_from_memory(address));
 }
 
-void ARM7TDMI::thumb_opcode_load_store_sign_extended_byte_halfword(HalfWord opcode) {
-    bool h = Utils::read_bit(opcode, 11);
-    bool sign_extend = Utils::read_bit(opcode, 10);
+void ARM7TDMI::thumb_opcode_load_store_register_offset(const ThumbBlockInstruction & instruction) {
+    bool load = Utils::read_bit(instruction.opcode, 11);
+    bool byte = Utils::read_bit(instruction.opcode, 10);
 
-    Byte offset_register = Utils::read_bit_range(opcode, 6, 8);
-    Byte base_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte source_destination_register = Utils::read_bit_range(opcode, 0, 2);
-
-    bool load;
-    if (h == 0 && sign_extend == 0) {
-        load = false;
-    } else {
-        load = true;
-    }
+    Word address = read_register(instruction.rs) + read_register(instruction.rn);
 
-    OpcodeHalfWordSignedDataTransfer::DataType data_type;
-    if (h == 0 && sign_extend == 0) {
-        data_type = OpcodeHalfWordSignedDataTransfer::UNSIGNED_HALFWORD;
+    if (load) {
+        OpcodeSingleDataTransfer::load(this, address, instruction.rd, byte);
     } else {
-        Byte sh = (sign_extend << 1) | h;
-        data_type = (OpcodeHalfWordSignedDataTransfer::DataType) sh;
+        OpcodeSingleDataTransfer::store(this, address, read_register(instruction.rd), byte);
     }
-
-    OpcodeHalfWordSignedDataTransferBuilder(load, base_register, source_destination_register)
-    .set_datatype(data_type)
-    .set_flags(true, true, false)
-    .set_offset_register(offset_register)
-    .get_product().run(this);
 }
 
-void ARM7TDMI::thumb_opcode_load_store_immediate_offset(HalfWord opcode) {
-    bool byte = Utils::read_bit(opcode, 12);
-    bool load = Utils::read_bit(opcode, 11);
+void ARM7TDMI::thumb_opcode_load_store_sign_extended_byte_halfword(const ThumbBlockInstruction & instruction) {
+    bool h = Utils::read_bit(instruction.opcode, 11);
+    bool sign_extend = Utils::read_bit(instruction.opcode, 10);
 
-    Byte offset_value = Utils::read_bit_range(opcode, 6, 10);
-    Byte base_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte source_destination_register = Utils::read_bit_range(opcode, 0, 2);
+    Word address = read_register(instruction.rs) + read_register(instruction.rn);
 
-    Byte immediate = byte ? offset_value : offset_value << 2;
+    if (h == 0 && sign_extend == 0) { // STRH
+        OpcodeHalfWordSignedDataTransfer::store(this, address, read_register(instruction.rd));
+        return;
+    }
 
-    OpcodeSingleDataTransferBuilder(load, base_register, source_destination_register)
-    .set_flags(true, true, byte, false)
-    .set_offset_immediate(immediate)
-    .get_product().run(this);
+    Byte sh = (sign_extend << 1) | h;
+    OpcodeHalfWordSignedDataTransfer::DataType data_type = (OpcodeHalfWordSignedDataTransfer::DataType) sh;
+    OpcodeHalfWordSignedDataTransfer::load(this, address, instruction.rd, data_type);
 }
 
-void ARM7TDMI::thumb_opcode_load_store_halfword(HalfWord opcode) {
-    bool load = Utils::read_bit(opcode, 11);
+void ARM7TDMI::thumb_opcode_load_store_immediate_offset(const ThumbBlockInstruction & instruction) {
+    bool byte = Utils::read_bit(instruction.opcode, 12);
+    bool load = Utils::read_bit(instruction.opcode, 11);
 
-    Byte offset_value = Utils::read_bit_range(opcode, 6, 10);
-    Byte base_register = Utils::read_bit_range(opcode, 3, 5);
-    Byte source_destination_register = Utils::read_bit_range(opcode, 0, 2);
+    Word address = read_register(instruction.rs) + instruction.immediate;
 
-    Byte immediate = offset_value << 1;
-
-    OpcodeHalfWordSignedDataTransferBuilder(load, base_register, source_destination_register)
-    .set_datatype(OpcodeHalfWordSignedDataTransfer::UNSIGNED_HALFWORD)
-    .set_flags(true, true, false)
-    .set_offset_immediate(immediate)
-    .get_product().run(this);
+    if (load) {
+        OpcodeSingleDataTransfer::load(this, address, instruction.rd, byte);
+    } else {
+        OpcodeSingleDataTransfer::store(this, address, read_register(instruction.rd), byte);
+    }
 }
 
-void ARM7TDMI::thumb_opcode_sp_relative_load_store(HalfWord opcode) {
-    bool load = Utils::read_bit(opcode, 11);
-    Byte destination_register = Utils::read_bit_range(opcode, 8, 10);
-    Word word_8 = Utils::read_bit_range(opcode, 0, 7);
-
-    Word immediate = word_8 << 2;
-
-    OpcodeSingleDataTransferBuilder(load, REGISTER_SP, destination_register)
-    .set_flags(true, true, false, false)
-    .set_offset_immediate(immediate)
-    .get_product().run(this);
-}
+void ARM7TDMI::thumb_opcode_load_store_halfword(const ThumbBlockInstruction & instruction) {
+    bool load = Utils::read_bit(instruction.opcode, 11);
 
-void ARM7TDMI::thumb_opcode_load_address(HalfWord opcode) {
-    bool sp = Utils::read_bit(opcode, 11);
-    Byte destination_register = Utils::read_bit_range(opcode, 8, 10);
-    Word word_8 = Utils::read_bit_range(opcode, 0, 7);
+    Word address = read_register(instruction.rs) + instruction.immediate;
 
-    Byte source_register = sp ? REGISTER_SP : REGISTER_PC;
-    Word immediate = word_8 << 2;
-    
-    if (immediate == 0x128) {
-        SDL_Log("%b", immediate);
+    if (load) {
+        OpcodeHalfWordSignedDataTransfer::load(this, address, instruction.rd, OpcodeHalfWordSignedDataTransfer::UNSIGNED_HALFWORD);
+    } else {
+        OpcodeHalfWordSignedDataTransfer::store(this, address, read_register(instruction.rd));
     }
+}
 
-    OpcodeDataProcessingBuilder(OpcodeDataProcess::ADD, false)
-    .set_destination_register(destination_register)
-    .set_source_register(source_register)
-    .set_immediate_op2(immediate, 0)
-    .get_product().run(this);
+void ARM7TDMI::thumb_opcode_sp_relative_load_store(const ThumbBlockInstruction & instruction) {
+    bool load = Utils::read_bit(instruction.opcode, 11);
+    Word address = read_register(REGISTER_SP) + instruction.immediate;
 
-    if (source_register == REGISTER_PC) {
-        Word wrote_value = read_register(destination_register);
-        write_register(destination_register, wrote_value & (~0b10));
+    if (load) {
+        OpcodeSingleDataTransfer::load(this, address, instruction.rd, false);
+    } else {
+        OpcodeSingleDataTransfer::store(this, address, read_register(instruction.rd), false);
     }
 }
 
-void ARM7TDMI::thumb_opcode_add_offset_to_stack_pointer(HalfWord opcode) {
-    bool sign = Utils::read_bit(opcode, 7);
-    Word s_word_7 = Utils::read_bit_range(opcode, 0, 6);
-
-    Word immediate = s_word_7 << 2;
-
-    OpcodeDataProcess::InstructionType instruction_type;
-    if (sign == 0) {
-        instruction_type = OpcodeDataProcess::ADD;
+void ARM7TDMI::thumb_opcode_load_address(const ThumbBlockInstruction & instruction) {
+    bool sp = Utils::read_bit(instruction.opcode, 11);
+    Word base;
+    if (sp) {
+        base = read_register(REGISTER_SP);
     } else {
-        instruction_type = OpcodeDataProcess::SUB;
+        base = (read_register(REGISTER_PC) + 4) & (~0b11);
     }
 
-    OpcodeDataProcessingBuilder(instruction_type, false)
-    .set_destination_register(REGISTER_SP)
-    .set_source_register(REGISTER_SP)
-    .set_immediate_op2(immediate, 0)
-    .get_product().run(this);
+    write_register(instruction.rd, base + instruction.immediate);
 }
 
-void ARM7TDMI::thumb_opcode_push_pop_registers(HalfWord opcode) {
-    bool load = Utils::read_bit(opcode, 11);
-    bool pc_lr_bit = Utils::read_bit(opcode, 8);
-    Byte r_list = Utils::read_bit_range(opcode, 0, 7);
-
-    bool up  = load ? true : false;
-    bool pre = load ? false : true;
-
-    HalfWord register_list = r_list;
-
-    if (pc_lr_bit) {
-        if (load) {
-            register_list = register_list | (1 << REGISTER_PC);
-        } else {
-            register_list = register_list | (1 << REGISTER_LR);
-        }
-    }
-
-    OpcodeBlockDataTransferBuilder(load, REGISTER_SP)
-    .set_flags(pre, up, false, true)
-    .set_register_list(register_list)
-    .get_product().run(this);
+void ARM7TDMI::thumb_opcode_add_offset_to_stack_pointer(const ThumbBlockInstruction & instruction) {
+    write_register(REGISTER_SP, read_register(REGISTER_SP) + instruction.immediate);
 }
 
-void ARM7TDMI::thumb_opcode_multiple_load_store(HalfWord opcode) {
-    bool load = Utils::read_bit(opcode, 11);
-    Byte base_register = Utils::read_bit_range(opcode, 8, 10);
-    Byte register_list = Utils::read_bit_range(opcode, 0, 7);
+void ARM7TDMI::thumb_opcode_push_pop_registers(const ThumbBlockInstruction & instruction) {
+    bool load = Utils::read_bit(instruction.opcode, 11);
+    block_data_transfer(this, load, REGISTER_SP, instruction.immediate, !load);
+}
 
-    OpcodeBlockDataTransferBuilder(load, base_register)
-    .set_flags(false, true, false, true)
-    .set_register_list(register_list)
-    .get_product().run(this);
+void ARM7TDMI::thumb_opcode_multiple_load_store(const ThumbBlockInstruction & instruction) {
+    bool load = Utils::read_bit(instruction.opcode, 11);
+    block_data_transfer(this, load, instruction.rd, instruction.immediate, false);
 }   
 
-void ARM7TDMI::thumb_opcode_conditional_branch(HalfWord opcode) {
-    Byte condition = Utils::read_bit_range(opcode, 8, 11);
-    Word s_offset_8 = Utils::read_bit_range(opcode, 0, 7);
-
-    if (condition_field(condition) == false) {
+void ARM7TDMI::thumb_opcode_conditional_branch(const ThumbBlockInstruction & instruction) {
+    if (condition_field(instruction.condition) == false) {
         return;
     }
 
-    Word pc = read_register(REGISTER_PC) + 4;
-    Word immediate = s_offset_8 << 1;
-
-    OpcodeBranch::branch(this, pc, immediate, 9);
+    write_register(REGISTER_PC, read_register(REGISTER_PC) + 4 + instruction.immediate);
 }
 
-void ARM7TDMI::thumb_opcode_software_interrupt(HalfWord opcode) {
-    emulate_software_interrupt(Utils::read_bit_range(opcode, 0, 7));
+void ARM7TDMI::thumb_opcode_software_interrupt(const ThumbBlockInstruction & instruction) {
+    emulate_software_interrupt(instruction.immediate);
     // SDL_Log("SWI - THUMB");
     // run_exception(EXCEPTION_SOFTWARE_INTERRUPT);
 }
 
-void ARM7TDMI::thumb_opcode_unconditional_branch(HalfWord opcode) {
-    HalfWord offset_11 = Utils::read_bit_range(opcode, 0, 10);
-    Word pc = read_register(REGISTER_PC) + 4;
-    Word immediate = offset_11 << 1;
-
-    OpcodeBranch::branch(this, pc, immediate, 12);
+void ARM7TDMI::thumb_opcode_unconditional_branch(const ThumbBlockInstruction & instruction) {
+    write_register(REGISTER_PC, read_register(REGISTER_PC) + 4 + instruction.immediate);
 }  
 
-void ARM7TDMI::thumb_opcode_long_branch_with_link(HalfWord opcode) {
-    bool low_offset = Utils::read_bit(opcode, 11);
-    Word offset = Utils::read_bit_range(opcode, 0, 10);
+void ARM7TDMI::thumb_opcode_long_branch_with_link(const ThumbBlockInstruction & instruction) {
+    bool low_offset = Utils::read_bit(instruction.opcode, 11);
 
     if (low_offset == 0) {
         Word pc = read_register(REGISTER_PC) + 4;
-        
-        Word signed_high_offset = Utils::sign_extend((offset << 12), 23);
-        write_register(REGISTER_LR, signed_high_offset + pc);
+        write_register(REGISTER_LR, instruction.immediate + pc);
     } else {
-        Word branch_offset = (offset << 1) + read_register(REGISTER_LR);
+        Word branch_offset = instruction.immediate + read_register(REGISTER_LR);
         Word following_address = read_register(REGISTER_PC) + 2;
 
         write_register(REGISTER_LR, following_address | 1);
         write_register(REGISTER_PC, branch_offset);
     }
 }
+
+// LR_und holds the next instruction, which is 2 on in THUMB state rather
+// than the 4 run_exception saves.
+void ARM7TDMI::thumb_opcode_undefined_instruction(const ThumbBlockInstruction & instruction) {
+    run_exception(EXCEPTION_UNDEFINED);
+    write_register(REGISTER_LR, read_register(REGISTER_LR) - 2);
+}
@@ -1,31 +1,40 @@
 #include "psr.h"
 #include "cpu_types.h"
-#include "../utils.h"
 
-ProgramStatusRegister::ProgramStatusRegister() : mode(MODE_USER), t(STATE_ARM), f(false), i(false), n(false), z(false), c(false), v(false)
+ProgramStatusRegister::ProgramStatusRegister() : bits(MODE_USER), lazy_result(0), lazy_op1(0), lazy_op2(0), lazy_nz(false), lazy_cv(LAZY_CV_NONE)
 {
 };
 
 Word ProgramStatusRegister::value() {
-    Word value = 0;
-    Utils::write_bit(&value, 31, n);
-    Utils::write_bit(&value, 30, z);
-    Utils::write_bit(&value, 29, c);
-    Utils::write_bit(&value, 28, v);
-    Utils::write_bit(&value, 7, i);
-    Utils::write_bit(&value, 6, f);
-    Utils::write_bit(&value, 5, t);
-    Utils::write_bit_range(&value, 0, 4, mode);
-    return value;
+    resolve_nz();
+    resolve_cv();
+    return bits;
 };
 
 void ProgramStatusRegister::write_value(Word value) {
-    n = Utils::read_bit(value, 31);
-    z = Utils::read_bit(value, 30);
-    c = Utils::read_bit(value, 29);
-    v = Utils::read_bit(value, 28);
-    i = Utils::read_bit(value, 7);
-    f = Utils::read_bit(value, 6);
-    t = (CPUState)Utils::read_bit(value, 5);
-    mode = (OperatingMode)Utils::read_bit_range(value, 0, 4);
+    bits = value;
+    lazy_nz = false;
+    lazy_cv = LAZY_CV_NONE;
 } 
+
+void ProgramStatusRegister::resolve_nz() {
+    if (!lazy_nz) {
+        return;
+    }
+    bool n_flag = n();
+    bool z_flag = z();
+    lazy_nz = false;
+    write_bit(PSR_N_BIT, n_flag);
+    write_bit(PSR_Z_BIT, z_flag);
+}
+
+void ProgramStatusRegister::resolve_cv() {
+    if (lazy_cv == LAZY_CV_NONE) {
+        return;
+    }
+    bool c_flag = c();
+    bool v_flag = v();
+    lazy_cv = LAZY_CV_NONE;
+    write_bit(PSR_C_BIT, c_flag);
+    write_bit(PSR_V_BIT, v_flag);
+}
@@ -3,6 +3,15 @@
 
 #include "cpu_types.h"
 
+#define PSR_N_BIT 31
+#define PSR_Z_BIT 30
+#define PSR_C_BIT 29
+#define PSR_V_BIT 28
+#define PSR_I_BIT 7
+#define PSR_F_BIT 6
+#define PSR_T_BIT 5
+#define PSR_MODE_MASK 0x1F
+
 enum CPUState {
     STATE_ARM = 0,
     STATE_THUMB = 1
@@ -18,20 +27,101 @@ enum OperatingMode {
     MODE_UNDEFINED  = 0b11011
 };
 
+// How the C and V flags are derived from the recorded operands.
+enum LazyCarryOverflow {
+    LAZY_CV_NONE, // C and V are held in bits
+    LAZY_CV_ADD, // op1 + op2 (+ carry in)
+    LAZY_CV_SUBTRACT // op1 - op2 (- borrow in)
+};
+
+// Status register packed in its architectural layout. Flag updates only
+// record the result and operands, N/Z/C/V are worked out when read.
 typedef struct ProgramStatusRegister {
     ProgramStatusRegister();
     Word value();
     void write_value(Word value);
+
     // Flags
-    bool n; // Negative
-    bool z; // Zero
-    bool c; // Carry
-    bool v; // Overflow
-
-    bool i; // IRQ Disable;
-    bool f; // FIQ Disable;
-    CPUState t; // State Bit
-    OperatingMode mode;
+    bool n() { return lazy_nz ? lazy_result >> 31 : (bits >> PSR_N_BIT) & 1; } // Negative
+    bool z() { return lazy_nz ? lazy_result == 0 : (bits >> PSR_Z_BIT) & 1; } // Zero
+    bool c() { // Carry
+        switch (lazy_cv) {
+            case LAZY_CV_ADD:
+                return ((lazy_op1 & lazy_op2) | ((lazy_op1 | lazy_op2) & ~lazy_result)) >> 31;
+            case LAZY_CV_SUBTRACT:
+                return ((lazy_op1 & ~lazy_op2) | ((lazy_op1 | ~lazy_op2) & ~lazy_result)) >> 31;
+            default:
+                return (bits >> PSR_C_BIT) & 1;
+        }
+    }
+    bool v() { // Overflow
+        switch (lazy_cv) {
+            case LAZY_CV_ADD:
+                return (~(lazy_op1 ^ lazy_op2) & (lazy_op1 ^ lazy_result)) >> 31;
+            case LAZY_CV_SUBTRACT:
+                return ((lazy_op1 ^ lazy_op2) & (lazy_op1 ^ lazy_result)) >> 31;
+            default:
+                return (bits >> PSR_V_BIT) & 1;
+        }
+    }
+
+    void set_n(bool n) { resolve_nz(); write_bit(PSR_N_BIT, n); }
+    void set_z(bool z) { resolve_nz(); write_bit(PSR_Z_BIT, z); }
+    void set_c(bool c) { resolve_cv(); write_bit(PSR_C_BIT, c); }
+    void set_v(bool v) { resolve_cv(); write_bit(PSR_V_BIT, v); }
+
+    // N and Z from a result, C and V untouched. Pending C and V are worked
+    // out first as they depend on the result being replaced.
+    void set_nz(Word result) {
+        resolve_cv();
+        lazy_result = result;
+        lazy_nz = true;
+    }
+    // N, Z, C and V of op1 + op2 + carry in = result.
+    void set_nzcv_add(Word op1, Word op2, Word result) {
+        lazy_result = result;
+        lazy_nz = true;
+        lazy_op1 = op1;
+        lazy_op2 = op2;
+        lazy_cv = LAZY_CV_ADD;
+    }
+    // N, Z, C and V of op1 - op2 - borrow in = result.
+    void set_nzcv_subtract(Word op1, Word op2, Word result) {
+        lazy_result = result;
+        lazy_nz = true;
+        lazy_op1 = op1;
+        lazy_op2 = op2;
+        lazy_cv = LAZY_CV_SUBTRACT;
+    }
+
+    // Control bits
+    bool i() { return (bits >> PSR_I_BIT) & 1; } // IRQ Disable
+    bool f() { return (bits >> PSR_F_BIT) & 1; } // FIQ Disable
+    CPUState t() { return (CPUState)((bits >> PSR_T_BIT) & 1); } // State Bit
+    OperatingMode mode() { return (OperatingMode)(bits & PSR_MODE_MASK); }
+
+    void set_i(bool i) { write_bit(PSR_I_BIT, i); }
+    void set_f(bool f) { write_bit(PSR_F_BIT, f); }
+    void set_t(CPUState t) { write_bit(PSR_T_BIT, t); }
+    // Only changes the bits, ARM7TDMI::set_mode also swaps the register banks.
+    void set_mode(OperatingMode mode) { bits = (bits & ~PSR_MODE_MASK) | mode; }
+
+    private:
+        friend struct ARM7TDMI; // Compiled blocks update the flags in place
+
+        Word bits;
+
+        Word lazy_result;
+        Word lazy_op1;
+        Word lazy_op2;
+        bool lazy_nz;
+        LazyCarryOverflow lazy_cv;
+
+        void write_bit(Byte bit, bool bit_value) {
+            bits = (bits & ~(1u << bit)) | ((Word)bit_value << bit);
+        }
+        void resolve_nz();
+        void resolve_cv();
 } PSR;
 
-#endif
\ No newline at end of file
+#endif
@@ -1,16 +1,69 @@
-#include <stdlib.h>
+#include <string.h>
 #include "register.h"
 
-RegisterSet::RegisterSet()
+RegisterFile::RegisterFile()
 {
-    for (int i = 0; i < 16; i++) {
-        registers[i] = (Word *) malloc(sizeof(Word));
-    }
+    memset(registers, 0, sizeof(registers));
+    memset(banked_r8_r12, 0, sizeof(banked_r8_r12));
+    memset(banked_r13_r14, 0, sizeof(banked_r13_r14));
 };
 
-void RegisterSet::write_register(int register_number, Word register_value) {
+RegisterBank RegisterFile::mode_to_bank(OperatingMode mode)
+{
+    // Indexed by the low four bits of the mode, invalid modes fall back to the user bank.
+    static const RegisterBank banks[16] = {
+        BANK_USER, BANK_FIQ, BANK_IRQ, BANK_SUPERVISOR,
+        BANK_USER, BANK_USER, BANK_USER, BANK_ABORT,
+        BANK_USER, BANK_USER, BANK_USER, BANK_UNDEFINED,
+        BANK_USER, BANK_USER, BANK_USER, BANK_USER
+    };
+    return banks[mode & 0xF];
+}
+
+void RegisterFile::switch_bank(RegisterBank current_bank, RegisterBank new_bank)
+{
+    if (current_bank == new_bank) {
+        return;
+    }
+
+    banked_r13_r14[current_bank][0] = registers[REGISTER_SP];
+    banked_r13_r14[current_bank][1] = registers[REGISTER_LR];
+
+    if (current_bank == BANK_FIQ || new_bank == BANK_FIQ) {
+        memcpy(banked_r8_r12[current_bank == BANK_FIQ], &registers[8], sizeof(banked_r8_r12[0]));
+        memcpy(&registers[8], banked_r8_r12[new_bank == BANK_FIQ], sizeof(banked_r8_r12[0]));
+    }
+
+    registers[REGISTER_SP] = banked_r13_r14[new_bank][0];
+    registers[REGISTER_LR] = banked_r13_r14[new_bank][1];
+}
+
+Word RegisterFile::read_user_register(RegisterBank current_bank, int register_number)
+{
+    if (current_bank == BANK_USER || register_number < 8 || register_number == REGISTER_PC) {
+        return registers[register_number];
+    }
+    if (register_number >= REGISTER_SP) {
+        return banked_r13_r14[BANK_USER][register_number - REGISTER_SP];
+    }
+    return current_bank == BANK_FIQ 
+        ? banked_r8_r12[0][register_number - 8] 
+        : registers[register_number];
+}
+
+void RegisterFile::write_user_register(RegisterBank current_bank, int register_number, Word register_value)
+{
     if (register_number == REGISTER_PC) {
         register_value = register_value & (~1);
     }
-    *(registers[register_number]) = register_value;
-}
\ No newline at end of file
+
+    if (current_bank == BANK_USER || register_number < 8 || register_number == REGISTER_PC) {
+        registers[register_number] = register_value;
+    } else if (register_number >= REGISTER_SP) {
+        banked_r13_r14[BANK_USER][register_number - REGISTER_SP] = register_value;
+    } else if (current_bank == BANK_FIQ) {
+        banked_r8_r12[0][register_number - 8] = register_value;
+    } else {
+        registers[register_number] = register_value;
+    }
+}
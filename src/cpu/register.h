@@ -10,12 +10,33 @@ enum SpecialRegisters {
     REGISTER_PC = 15
 };
 
-typedef struct RegisterSet {
-    RegisterSet();
-    void write_register(int register_number, Word register_value);
-    Word * registers[16];
-   
-    ProgramStatusRegister spsr;
-} RegisterSet;
-
-#endif
\ No newline at end of file
+enum RegisterBank {
+    BANK_USER, // Shared by user and system mode
+    BANK_FIQ,
+    BANK_IRQ,
+    BANK_SUPERVISOR,
+    BANK_ABORT,
+    BANK_UNDEFINED,
+    BANK_COUNT
+};
+
+// The registers of the current mode live in one flat array. Banked copies of
+// r8-r14 and the saved PSRs are only touched when the CPSR mode changes.
+typedef struct RegisterFile {
+    RegisterFile();
+
+    alignas(64) Word registers[16];
+
+    Word banked_r8_r12[2][5]; // [0] every mode but FIQ, [1] FIQ
+    Word banked_r13_r14[BANK_COUNT][2];
+    ProgramStatusRegister spsr[BANK_COUNT];
+
+    static RegisterBank mode_to_bank(OperatingMode mode);
+    void switch_bank(RegisterBank current_bank, RegisterBank new_bank);
+
+    // Access the user mode registers while in another mode (LDM/STM with S bit).
+    Word read_user_register(RegisterBank current_bank, int register_number);
+    void write_user_register(RegisterBank current_bank, int register_number, Word register_value);
+} RegisterFile;
+
+#endif
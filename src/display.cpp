@@ -1,6 +1,7 @@
 #include "src/scheduler.h"
 #include "src/memory.h"
 #include "src/display.h"
+#include "src/compositor.h"
 #include <functional>
 
 Display::Display(SDL_Renderer * renderer, Context * context, Memory * memory) : 
@@ -30,10 +31,25 @@ window_outside(&memory->io_registers[0x004a], true)
         sprites[i] = Sprite(memory, i);
     }
 
-    memset(screen_buffers, 0xFF, sizeof(screen_buffers));
+    memset(frame_buffer, 0, sizeof(frame_buffer));
+    memset(layer_priorities, 0, sizeof(layer_priorities));
+
+    screen_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (screen_texture == nullptr) {
+        SDL_Log("SDL texture creation failed: %s", SDL_GetError());
+    } else {
+        SDL_SetTextureScaleMode(screen_texture, SDL_SCALEMODE_NEAREST);
+    }
+}
+
+Display::~Display() {
+    SDL_DestroyTexture(screen_texture);
+    free(sprites);
 }
 
 void Display::update_scanline(int scanline) {
+    memset(layer_lines, 0xFF, sizeof(layer_lines));
+
     switch (display_control.mode.get())
     {  
         case 0:
@@ -64,8 +80,10 @@ void Display::update_scanline(int scanline) {
 
     HalfWord background_color = Memory::read_halfword_from_memory(memory->palette_ram, 0);
     for (int x = 0; x < SCREEN_WIDTH; x++) {
-        set_screen_pixel(x, scanline, background_color, BUFFER_BACKGROUND_COLOR);
+        set_line_pixel(x, background_color, BUFFER_BACKGROUND_COLOR, 4);
     }
+
+    composite_scanline(scanline);
 }
 
 void Display::update_scanline_bgmode_0(int scanline) {
@@ -86,39 +104,34 @@ void Display::update_scanline_bgmode_2(int scanline) {
 }
 
 void Display::update_scanline_bgmode_3(int scanline) {
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            HalfWord color = Memory::read_halfword_from_memory(memory->vram, (y*SCREEN_WIDTH*2) + (x*2))&(~0x8000);
-            set_screen_pixel(x, y, color, BUFFER_BG2);
-        }
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        HalfWord color = Memory::read_halfword_from_memory(memory->vram, (scanline*SCREEN_WIDTH*2) + (x*2))&(~0x8000);
+        set_line_pixel(x, color, BUFFER_BG2, tiled_backgrounds[2].control.priority.get());
     }
 }
 
 void Display::update_scanline_bgmode_4(int scanline) {
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            Word palette_address =(y*SCREEN_WIDTH) + x;
-            if (display_control.display_frame_select.get() == 1) {
-                palette_address += 0xA000;
-            }
-            HalfWord palette_index = memory->vram[palette_address];
-
-            set_screen_pixel(x, y, get_palette_color(palette_index, BG_PALETTE), BUFFER_BG2);
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        Word palette_address =(scanline*SCREEN_WIDTH) + x;
+        if (display_control.display_frame_select.get() == 1) {
+            palette_address += 0xA000;
         }
+        HalfWord palette_index = memory->vram[palette_address];
+
+        set_line_pixel(x, get_palette_color(palette_index, BG_PALETTE), BUFFER_BG2, tiled_backgrounds[2].control.priority.get());
     }
 }
 
 void Display::update_scanline_bgmode_5(int scanline) {
-    for (int y = 0; y < MODE_5_SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < MODE_5_SCREEN_WIDTH; x++) {
-            Word palette_address = ((y*MODE_5_SCREEN_WIDTH) + x)*2;
-            if (display_control.display_frame_select.get() == 1) {
-                palette_address += 0xA000;
-            }
-
-            HalfWord color = Memory::read_halfword_from_memory(memory->vram, palette_address);
-            set_screen_pixel(x, y, color, BUFFER_BG2);
+    if (scanline >= MODE_5_SCREEN_HEIGHT) {return;}
+    for (int x = 0; x < MODE_5_SCREEN_WIDTH; x++) {
+        Word palette_address = ((scanline*MODE_5_SCREEN_WIDTH) + x)*2;
+        if (display_control.display_frame_select.get() == 1) {
+            palette_address += 0xA000;
         }
+
+        HalfWord color = Memory::read_halfword_from_memory(memory->vram, palette_address);
+        set_line_pixel(x, color, BUFFER_BG2, tiled_backgrounds[2].control.priority.get());
     }
 }
 
@@ -181,7 +194,7 @@ void Display::render_tiled_background_affine_scanline(TiledBackground background
                 8
             );
 
-            set_screen_pixel(screen_x, scanline, mapped_pixel_color, number_to_bg_buffer_type(background.number));
+            set_line_pixel(screen_x, mapped_pixel_color, number_to_bg_buffer_type(background.number), background.control.priority.get());
         }
     }   
     
@@ -278,7 +291,7 @@ void Display::render_tiled_background_scanline(TiledBackground background, int s
                 //     SDL_Log("%b", background_color);
                 // }
 
-                set_screen_pixel(screen_x, scanline, background_color, number_to_bg_buffer_type(background.number));
+                set_line_pixel(screen_x, background_color, number_to_bg_buffer_type(background.number), background.control.priority.get());
             }
         }
     }
@@ -424,10 +437,8 @@ void Display::render_sprite_scanline(Sprite sprite, int y) {
             HalfWord mapped_pixel_color = get_pixel_color(target_sprite_pixel_x, target_sprite_pixel_y);
 
             Word screen_x = base_x+x;
-            Word screen_y = base_y+relative_y;
             screen_x %= 512;
-            screen_y %= 256;
-            set_screen_pixel(screen_x, screen_y, mapped_pixel_color, BUFFER_SPIRTE);
+            set_line_pixel(screen_x, mapped_pixel_color, BUFFER_SPIRTE, sprite.attribute_2.priority.get());
         }
     } else {
         for (int x = 0; x < pixel_size_x; x++) {
@@ -440,7 +451,7 @@ void Display::render_sprite_scanline(Sprite sprite, int y) {
 
             Word screen_x = sprite.attribute_1.x.get()+x;
             screen_x %= 512;
-            set_screen_pixel(screen_x, y, pixel_color, BUFFER_SPIRTE);
+            set_line_pixel(screen_x, pixel_color, BUFFER_SPIRTE, sprite.attribute_2.priority.get());
         }
     }
 }
@@ -504,99 +515,94 @@ HalfWord Display::get_tile_pixel_8bpp(Word x, Word y, Word tile_base, Word charb
     return palette_color;
 }
 
-void Display::render() {
-    // SDL_Log("00600898C: 0x%0x", memory->read_word_from_memory(0x00600898C));
-    SDL_RenderClear(renderer);
-
+// Picks the top pixel of each layer on the line into the frame.
+// Works out which layers each pixel's window lets through, then leaves
+// the layer selection to the compositor.
+void Display::composite_scanline(int y) {
     bool window_0_active = display_control.display_window_0.get();
     bool window_1_active = display_control.display_window_1.get();
     bool window_obj_active = display_control.display_objects_window.get();
 
-    bool windows_active = window_0_active || window_1_active || window_obj_active;
-
-    RenderSettings settings;
-    settings.bg0 = true;
-    settings.bg1 = true;
-    settings.bg2 = true;
-    settings.bg3 = true;
-    settings.obj = true;
-    settings.sfx = true;
-
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            HalfWord color = screen_buffers[BUFFER_BACKGROUND_COLOR][x][y];
-            HalfWord sprite_color = screen_buffers[BUFFER_SPIRTE][x][y];
-
-            if (windows_active) {
-                window_0.update_inside(x, y);
-                window_1.update_inside(x, y);
-                window_obj.inside = sprite_color != COLOR_TRANSPARENT;
-                window_outside.inside = (!window_0.inside) && (!window_1.inside) && (!window_obj.inside);
-
-                settings = window_outside.get_render_settings();
-                if (window_obj.inside && window_obj_active) settings = window_obj.get_render_settings();
-                if (window_1.inside   && window_1_active)   settings = window_1.get_render_settings();
-                if (window_0.inside   && window_0_active)   settings = window_0.get_render_settings();
-            }
-
-            bool sprites_enabled = display_control.display_objects.get() == 1;
-            if (sprite_color != COLOR_TRANSPARENT && sprites_enabled && settings.obj) {
-                color = sprite_color;
-            } else {
-                Word backgrounds_displayed = display_control.display_backgrounds.get();
-                for (int i = 0; i < 4; i++) {
-                    HalfWord background_color = screen_buffers[i+1][x][y];
-
-                    bool background_setting;
-                    bool background_enabled = Utils::read_bit(backgrounds_displayed, i);
-
-                    switch (i) {
-                        case 0:
-                            background_setting = settings.bg0;
-                            break;
-                        case 1:
-                            background_setting = settings.bg1;
-                            break;
-                        case 2:
-                            background_setting = settings.bg2;
-                            break;
-                        case 3:
-                            background_setting = settings.bg3;
-                            break;
-                    }
-
-                    if (background_color != COLOR_TRANSPARENT && background_enabled && background_setting) {
-                        
-                        color = background_color;
-                        break;
-                    }
+    Byte window_masks[SCREEN_WIDTH];
+    if (window_0_active || window_1_active || window_obj_active) {
+        memset(window_masks, window_outside.layers.get(), SCREEN_WIDTH);
+        if (window_obj_active) {
+            Byte obj_layers = window_obj.layers.get();
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                if (layer_lines[BUFFER_SPIRTE][x] != COLOR_TRANSPARENT) {
+                    window_masks[x] = obj_layers;
                 }
             }
-            
-            Byte r = Utils::read_bit_range(color, 0,  4);
-            Byte g = Utils::read_bit_range(color, 5,  9);
-            Byte b = Utils::read_bit_range(color, 10, 14);
-
-            // if (color != 0b0111111111111111) {
-            //     SDL_Log("color: %b, y: %d", color, y);
-            // }
-            
-            SDL_SetRenderDrawColor(renderer, r << 3, g << 3, b << 3, SDL_ALPHA_OPAQUE);
-            SDL_RenderPoint(renderer, x, y);
         }
+        // Window 0 goes last, it's on top.
+        window_1.update_line(y, window_masks, window_1_active);
+        window_0.update_line(y, window_masks, window_0_active);
+    } else {
+        memset(window_masks, 0x3F, SCREEN_WIDTH);
     }
-    
-    memset(screen_buffers, 0xFF, sizeof(screen_buffers));
 
+    Byte layers_enabled = (display_control.display_backgrounds.get() | (display_control.display_objects.get() << 4)) | 0x20;
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        window_masks[x] &= layers_enabled;
+    }
+
+    CompositorLine line = {
+        {
+            layer_lines[BUFFER_SPIRTE],
+            layer_lines[BUFFER_BG0],
+            layer_lines[BUFFER_BG1],
+            layer_lines[BUFFER_BG2],
+            layer_lines[BUFFER_BG3],
+        },
+        {
+            layer_priorities[BUFFER_SPIRTE],
+            layer_priorities[BUFFER_BG0],
+            layer_priorities[BUFFER_BG1],
+            layer_priorities[BUFFER_BG2],
+            layer_priorities[BUFFER_BG3],
+        },
+        {0x10, 0x01, 0x02, 0x04, 0x08},
+        layer_lines[BUFFER_BACKGROUND_COLOR],
+        window_masks,
+        SCREEN_WIDTH,
+    };
+    Compositor::composite_line(line, frame_buffer[y]);
+}
+
+// Copies the frame into the streaming texture and presents it in one draw,
+// the renderer scales it up.
+void Display::render() {
+    u_int64_t start_ns = SDL_GetTicksNS();
+    // SDL_Log("00600898C: 0x%0x", memory->read_word_from_memory(0x00600898C));
+    void * pixels;
+    int pitch;
+    if (!SDL_LockTexture(screen_texture, nullptr, &pixels, &pitch)) {
+        SDL_Log("SDL texture lock failed: %s", SDL_GetError());
+        return;
+    }
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        memcpy((Byte *)pixels + y * pitch, frame_buffer[y], sizeof(frame_buffer[y]));
+    }
+    SDL_UnlockTexture(screen_texture);
+
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, screen_texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
+
+    last_present_ns = SDL_GetTicksNS() - start_ns;
+    total_present_ns += last_present_ns;
+    presented_frames++;
 }
 
-void Display::set_screen_pixel(Word x, Word y, HalfWord color, BufferType buffer) {
+// Sprites are drawn from 127 down, so a sprite only covers one drawn
+// before it when its priority is the same or lower.
+void Display::set_line_pixel(Word x, HalfWord color, BufferType buffer, Byte priority) {
     if (color == COLOR_TRANSPARENT) {return;}
     if (x >= SCREEN_WIDTH) {return;}
-    if (y >= SCREEN_HEIGHT) {return;}
+    if (layer_lines[buffer][x] != COLOR_TRANSPARENT && priority > layer_priorities[buffer][x]) {return;}
 
-    screen_buffers[buffer][x][y] = color;
+    layer_lines[buffer][x] = color;
+    layer_priorities[buffer][x] = priority;
 }
 
 HalfWord Display::get_palette_color(Byte index, Word palatte_start_address) {
@@ -625,6 +631,18 @@ Display::BufferType Display::number_to_bg_buffer_type(int number) {
 }
 
 void Display::start_draw_loop(Scheduler * scheduler) {
+    this->scheduler = scheduler;
+    scheduler->set_event_handler(EVENT_HDRAW_END, [](void * context, Word) {
+        ((Display *)context)->end_hdraw();
+    }, this);
+    scheduler->set_event_handler(EVENT_HBLANK_END, [](void * context, Word) {
+        ((Display *)context)->display_status.hblank.set(false);
+        ((Display *)context)->start_scanline();
+    }, this);
+    start_scanline();
+}
+
+void Display::start_scanline() {
     scanline++;
 
     if (scanline > 226) {
@@ -632,9 +650,12 @@ void Display::start_draw_loop(Scheduler * scheduler) {
         scanline = 0;
     } else if (scanline >= 160) {
         
+        if (scanline == 160) {
+            context->dma->trigger(DMA_VBLANK);
+        }
         display_status.vblank.set(true);
         if (display_status.vblank_irq.get() == true) {
-            context->cpu->start_interrupt(INTERRUPT_VBLANK);
+            context->cpu->request_interrupt(INTERRUPT_VBLANK);
             // DO IRQ   
         }
     }
@@ -642,25 +663,28 @@ void Display::start_draw_loop(Scheduler * scheduler) {
     vcount.set(scanline);
     
     if (display_status.vcount_irq.get() == true && scanline == display_status.vcount_setting.get()) {
-        context->cpu->start_interrupt(INTERRUPT_VCOUNT);
+        context->cpu->request_interrupt(INTERRUPT_VCOUNT);
         // DO IRQ   
     }
-    
-    
 
-    scheduler->schedule_event(HDRAW_CYCLE_LENGTH, [scheduler, this](){
+    scheduler->schedule_event(HDRAW_CYCLE_LENGTH, EVENT_HDRAW_END);
+}
+
+void Display::end_hdraw() {
+    if (scanline < SCREEN_HEIGHT) {
         update_scanline(scanline);
-        display_status.hblank.set(true);
-        if (display_status.hblank_irq.get() == true) {
-            context->cpu->start_interrupt(INTERRUPT_HBLANK);
-            // DO IRQ   
-        }
-        scheduler->schedule_event(HBLANK_CYCLE_LENGTH, [scheduler, this](){
-            display_status.hblank.set(false);
-            start_draw_loop(scheduler);
-        });
-    });
-};
+    }
+    display_status.hblank.set(true);
+    if (display_status.hblank_irq.get() == true) {
+        context->cpu->request_interrupt(INTERRUPT_HBLANK);
+        // DO IRQ   
+    }
+    if (scanline < 160) {
+        context->dma->trigger(DMA_HBLANK);
+    }
+    context->dma->trigger_video_capture(scanline);
+    scheduler->schedule_event(HBLANK_CYCLE_LENGTH, EVENT_HBLANK_END);
+}
 
 Display::DisplayControl::DisplayControl(Byte * memory_location) :
 mode(memory_location, 0, 2),
@@ -720,24 +744,7 @@ palette_bank(address, 12, 15)
 {}
 
 Display::Window::Window(Byte * content_address, bool start) :
-bg0(content_address, start ? 0 : 8),
-bg1(content_address, start ? 1 : 9),
-bg2(content_address, start ? 2 : 10),
-bg3(content_address, start ? 3 : 11),
-obj(content_address, start ? 4 : 12),
-sfx(content_address, start ? 5 : 13),
-inside(false) {}
-
-Display::RenderSettings Display::Window::get_render_settings() {
-    return {
-        .bg0 = bg0.get() != 0,
-        .bg1 = bg1.get() != 0,
-        .bg2 = bg2.get() != 0,
-        .bg3 = bg3.get() != 0,
-        .obj = obj.get() != 0,
-        .sfx = sfx.get() != 0,
-    };
-}
+layers(content_address, start ? 0 : 8, start ? 5 : 13) {}
 
 Display::SizableWindow::SizableWindow(Byte * content_address, bool start, Byte * h_address, Byte * v_address) : 
 Window(content_address, start),
@@ -749,14 +756,31 @@ inside_h(false),
 inside_v(false)
 {}
 
-void Display::SizableWindow::update_inside(Word x, Word y) {
+// Edges take effect where the line crosses them, so whether the window
+// is open carries over from the line before. Edges past the screen are
+// never crossed. Inactive windows still follow the edges.
+void Display::SizableWindow::update_line(Word y, Byte * window_masks, bool active) {
     if (y == top.get()) inside_v = true;
     if (y == bottom.get()) inside_v = false;
 
-    if (x == left.get()) inside_h = true;
-    if (x == right.get()) inside_h = false;
+    Word left_x = left.get();
+    Word right_x = right.get();
+    Byte window_layers = layers.get();
 
-    inside = inside_h && inside_v;
+    Word x = 0;
+    while (x < SCREEN_WIDTH) {
+        if (x == left_x) inside_h = true;
+        if (x == right_x) inside_h = false;
+
+        Word span_end = SCREEN_WIDTH;
+        if (left_x > x && left_x < span_end) span_end = left_x;
+        if (right_x > x && right_x < span_end) span_end = right_x;
+
+        if (active && inside_h && inside_v) {
+            memset(&window_masks[x], window_layers, span_end - x);
+        }
+        x = span_end;
+    }
 }
 
 Display::AttributeZero::AttributeZero(Byte * oam_address) :
@@ -39,6 +39,7 @@
 
 typedef struct Display {
     Display(SDL_Renderer * renderer, Context * context, Memory * memory);
+    ~Display();
 
     struct DisplayControl {
         DisplayControl(Byte * memory_location);
@@ -133,26 +134,11 @@ typedef struct Display {
         int number;
     } TiledBackground;
     
-    typedef struct RenderSettings {
-        bool bg0;
-        bool bg1;
-        bool bg2;
-        bool bg3;
-        bool obj;
-        bool sfx;
-    } RenderSettings;
-
+    // Layers the window lets through, bits 0-3 for BG0-BG3, 4 for sprites
+    // and 5 for effects.
     typedef struct Window {
         Window(Byte * content_address, bool start);
-        BitRegion bg0;
-        BitRegion bg1;
-        BitRegion bg2;
-        BitRegion bg3;
-        BitRegion obj;
-        BitRegion sfx;
-
-        RenderSettings get_render_settings();
-        bool inside;
+        BitRegion layers;
     } Window;
 
     typedef struct SizableWindow : Window {
@@ -164,7 +150,7 @@ typedef struct Display {
 
         bool inside_h;
         bool inside_v;
-        void update_inside(Word x, Word y);
+        void update_line(Word y, Byte * window_masks, bool active);
     } SizableWindow;
 
 
@@ -176,8 +162,10 @@ typedef struct Display {
     TiledBackground tiled_backgrounds[4];
 
     SDL_Renderer * renderer;
+    SDL_Texture * screen_texture = nullptr;
     Context * context;
     Memory * memory;
+    Scheduler * scheduler = nullptr;
 
     BitRegion vcount;
 
@@ -192,9 +180,14 @@ typedef struct Display {
         BUFFER_BACKGROUND_COLOR=5,
     };
 
-    HalfWord screen_buffers[6][SCREEN_WIDTH][SCREEN_HEIGHT];
+    // Layers are drawn a line at a time and composited straight into the
+    // frame, render only copies the frame out.
+    HalfWord layer_lines[6][SCREEN_WIDTH];
+    Byte layer_priorities[6][SCREEN_WIDTH]; // Only meaningful where the line is opaque
+    Word frame_buffer[SCREEN_HEIGHT][SCREEN_WIDTH];
 
     void update_scanline(int y);
+    void composite_scanline(int y);
 
     void update_scanline_bgmode_0(int y);
     void update_scanline_bgmode_1(int y);
@@ -214,12 +207,19 @@ typedef struct Display {
     inline Word flip(Word number, Word flip_value);
 
     void render();
+
+    // Time taken by render, compositing included.
+    u_int64_t last_present_ns = 0;
+    u_int64_t total_present_ns = 0;
+    Word presented_frames = 0;
     
-    void set_screen_pixel(Word x, Word y, HalfWord color, BufferType buffer);
+    void set_line_pixel(Word x, HalfWord color, BufferType buffer, Byte priority);
     HalfWord get_palette_color(Byte index, Word palette_start_address);
     BufferType number_to_bg_buffer_type(int number);
 
     void start_draw_loop(Scheduler * scheduler);
+    void start_scanline();
+    void end_hdraw();
 } Display;
 
 #endif
\ No newline at end of file
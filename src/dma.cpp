@@ -0,0 +1,227 @@
+#include <algorithm>
+
+#include "src/dma.h"
+
+Dma::Dma(ARM7TDMI * cpu) :
+cpu(cpu),
+channels{
+    Channel(this, &cpu->memory, 0),
+    Channel(this, &cpu->memory, 1),
+    Channel(this, &cpu->memory, 2),
+    Channel(this, &cpu->memory, 3),
+}
+{
+    for (Channel & channel : channels) {
+        cpu->memory.set_io_register_hook(DMA_REGISTERS_ADDRESS + DMA_REGISTERS_SIZE * channel.number + 0x0A, nullptr,
+            [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+                Channel * channel = (Channel *)context;
+                return channel->dma->write_control(*channel, (current_value & ~mask) | (written_value & mask));
+            },
+            &channel
+        );
+    }
+}
+
+Dma::Channel::Channel(Dma * dma, Memory * memory, Word number) :
+control(&memory->io_registers[(DMA_REGISTERS_ADDRESS & (IO_REGISTERS_SIZE - 1)) + DMA_REGISTERS_SIZE * number + 0x0A]),
+dma(dma),
+registers(&memory->io_registers[(DMA_REGISTERS_ADDRESS & (IO_REGISTERS_SIZE - 1)) + DMA_REGISTERS_SIZE * number]),
+number(number),
+source(0),
+destination(0),
+count(0)
+{}
+
+Dma::Channel::Control::Control(Byte * address) :
+value(address, 0, 15),
+destination_control(address, 5, 6),
+source_control(address, 7, 8),
+repeat(address, 9),
+word_transfer(address, 10),
+timing(address, 12, 13),
+transfer_interrupt(address, 14),
+enabled(address, 15)
+{}
+
+// Only DMA 0 can't read the game pak, only DMA 3 can write it.
+void Dma::Channel::latch_source() {
+    source = Memory::read_word_from_memory(registers, 0x00) & (number == 0 ? 0x07FFFFFF : 0x0FFFFFFF);
+}
+
+void Dma::Channel::latch_destination() {
+    destination = Memory::read_word_from_memory(registers, 0x04) & (number == 3 ? 0x0FFFFFFF : 0x07FFFFFF);
+}
+
+// A count of 0 is the largest the channel can do.
+void Dma::Channel::latch_count() {
+    Word count_register = Memory::read_halfword_from_memory(registers, 0x08);
+    Word max_count = number == 3 ? 0x10000 : 0x4000;
+    count_register &= max_count - 1;
+    count = count_register == 0 ? max_count : count_register;
+}
+
+// The addresses and count are latched when the channel is enabled.
+// Immediate transfers run before the write returns.
+HalfWord Dma::write_control(Channel & channel, HalfWord value) {
+    bool was_enabled = channel.control.enabled.get();
+    channel.control.value.set(value);
+    if (was_enabled || !channel.control.enabled.get()) {
+        return value;
+    }
+
+    channel.latch_source();
+    channel.latch_destination();
+    channel.latch_count();
+    if (channel.control.timing.get() == DMA_IMMEDIATE) {
+        transfer(channel);
+    }
+    return channel.control.value.get();
+}
+
+// Channels are checked in priority order, DMA 0 first.
+void Dma::trigger(DmaTiming timing) {
+    for (Channel & channel : channels) {
+        if (channel.control.enabled.get() && channel.control.timing.get() == timing) {
+            transfer(channel);
+        }
+    }
+}
+
+// DMA 3 copies a line at the start of HBlank on scanlines 2 to 161.
+void Dma::trigger_video_capture(int scanline) {
+    Channel & channel = channels[3];
+    if (!channel.control.enabled.get() || channel.control.timing.get() != DMA_SPECIAL) {
+        return;
+    }
+
+    if (scanline == 162) {
+        channel.control.enabled.set(false);
+    } else if (scanline >= 2 && scanline < 162) {
+        transfer(channel);
+    }
+}
+
+// Called when a sound FIFO wants refilling.
+void Dma::trigger_sound_fifo(Word fifo_address) {
+    for (int number = 1; number <= 2; number++) {
+        Channel & channel = channels[number];
+        if (channel.control.enabled.get() && channel.control.timing.get() == DMA_SPECIAL && channel.destination == fifo_address) {
+            transfer(channel);
+        }
+    }
+}
+
+static int address_step(Word address_control, Word unit_size) {
+    switch (address_control) {
+        case DMA_DECREMENT: return -(int)unit_size;
+        case DMA_FIXED: return 0;
+        default: return unit_size;
+    }
+}
+
+void Dma::transfer(Channel & channel) {
+    Memory & memory = cpu->memory;
+    bool word_transfer = channel.control.word_transfer.get();
+    Word destination_control = channel.control.destination_control.get();
+    Word count = channel.count;
+
+    // Sound FIFO transfers are always four words to the FIFO.
+    if (channel.control.timing.get() == DMA_SPECIAL && channel.number != 3) {
+        word_transfer = true;
+        destination_control = DMA_FIXED;
+        count = 4;
+    }
+
+    Word unit_size = word_transfer ? 4 : 2;
+    int source_step = address_step(channel.control.source_control.get(), unit_size);
+    int destination_step = address_step(destination_control, unit_size);
+    Word source = channel.source & ~(unit_size - 1);
+    Word destination = channel.destination & ~(unit_size - 1);
+
+    // 2N + 2(n-1)S + 2I, with the reads and writes on their own regions.
+    AccessWidth width = word_transfer ? ACCESS_32 : ACCESS_16;
+    Byte source_region = (source >> 24) & 0xF;
+    Byte destination_region = (destination >> 24) & 0xF;
+    cpu->cycles += 2
+        + memory.data_access_cycles[ACCESS_NONSEQUENTIAL][width][source_region]
+        + memory.data_access_cycles[ACCESS_NONSEQUENTIAL][width][destination_region]
+        + (count - 1) * (memory.data_access_cycles[ACCESS_SEQUENTIAL][width][source_region]
+            + memory.data_access_cycles[ACCESS_SEQUENTIAL][width][destination_region]);
+
+    Word remaining = count;
+    while (remaining > 0) {
+        if (source_step == (int)unit_size && destination_step == (int)unit_size) {
+            Word copied = copy_plain_units(source, destination, remaining, unit_size);
+            if (copied > 0) {
+                source += copied * unit_size;
+                destination += copied * unit_size;
+                remaining -= copied;
+                continue;
+            }
+        }
+
+        if (word_transfer) {
+            memory.write_memory<Word>(destination, memory.read_memory<Word>(source));
+        } else {
+            memory.write_memory<HalfWord>(destination, memory.read_memory<HalfWord>(source));
+        }
+        source += source_step;
+        destination += destination_step;
+        remaining--;
+    }
+
+    channel.source = source;
+    channel.destination = destination;
+    finish_transfer(channel);
+}
+
+// Copies as many units as sit on plain pages at both ends in one go and
+// returns how many, 0 when the next unit has to go through the bus.
+Word Dma::copy_plain_units(Word source, Word destination, Word count, Word unit_size) {
+    if (source >= 0x10000000 || destination >= 0x10000000) {
+        return 0;
+    }
+
+    Memory::MemoryPage & source_page = cpu->memory.pages[source >> MEMORY_PAGE_SHIFT];
+    Memory::MemoryPage & destination_page = cpu->memory.pages[destination >> MEMORY_PAGE_SHIFT];
+    if (source_page.read == nullptr || destination_page.write == nullptr) {
+        return 0;
+    }
+
+    // Up to the end of the page, or of the region for mirrors under a page.
+    Word source_offset = source & source_page.mask;
+    Word destination_offset = destination & destination_page.mask;
+    Word bytes = std::min({
+        count * unit_size,
+        source_page.mask + 1 - source_offset,
+        destination_page.mask + 1 - destination_offset
+    });
+
+    // Copying forward onto a later part of itself repeats the start, a
+    // move wouldn't.
+    Byte * from = &source_page.read[source_offset];
+    Byte * to = &destination_page.write[destination_offset];
+    if (to > from && to < from + bytes) {
+        return 0;
+    }
+
+    memmove(to, from, bytes);
+    return bytes / unit_size;
+}
+
+// Repeating channels reload their count, and their destination if asked,
+// and wait for the next trigger. The rest switch off.
+void Dma::finish_transfer(Channel & channel) {
+    if (channel.control.transfer_interrupt.get()) {
+        cpu->request_interrupt((Interrupt)(INTERRUPT_DMA_0 + channel.number));
+    }
+
+    if (channel.control.repeat.get() && channel.control.timing.get() != DMA_IMMEDIATE) {
+        channel.latch_count();
+        if (channel.control.destination_control.get() == DMA_INCREMENT_RELOAD) {
+            channel.latch_destination();
+        }
+    } else {
+        channel.control.enabled.set(false);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef DMA_INCLUDED
+#define DMA_INCLUDED
+
+#include "src/cpu/cpu.h"
+#include "src/cpu/cpu_types.h"
+#include "src/cpu/bit_region.h"
+#include "src/memory.h"
+
+#define DMA_CHANNELS 4
+#define DMA_REGISTERS_ADDRESS 0x040000B0
+#define DMA_REGISTERS_SIZE 0x0C
+
+#define SOUND_FIFO_A_ADDRESS 0x040000A0
+#define SOUND_FIFO_B_ADDRESS 0x040000A4
+
+enum DmaTiming {
+    DMA_IMMEDIATE,
+    DMA_VBLANK,
+    DMA_HBLANK,
+    DMA_SPECIAL, // Sound FIFO for DMA 1 and 2, video capture for DMA 3
+};
+
+enum DmaAddressControl {
+    DMA_INCREMENT,
+    DMA_DECREMENT,
+    DMA_FIXED,
+    DMA_INCREMENT_RELOAD, // Destination only, reloaded on repeat
+};
+
+// Transfers run as soon as they are triggered, the CPU is held for their
+// cycles. Runs of units between plain pages are copied in one go.
+typedef struct Dma {
+    Dma(ARM7TDMI * cpu);
+
+    typedef struct Channel {
+        Channel(Dma * dma, Memory * memory, Word number);
+        struct Control {
+            Control(Byte * address);
+            BitRegion value;
+            BitRegion destination_control;
+            BitRegion source_control;
+            BitRegion repeat;
+            BitRegion word_transfer;
+            BitRegion timing;
+            BitRegion transfer_interrupt;
+            BitRegion enabled;
+        } control;
+
+        Dma * dma;
+        Byte * registers;
+        Word number;
+
+        // Latched from the registers when the channel is enabled
+        Word source;
+        Word destination;
+        Word count;
+
+        void latch_source();
+        void latch_destination();
+        void latch_count();
+    } Channel;
+
+    ARM7TDMI * cpu;
+    Channel channels[DMA_CHANNELS];
+
+    HalfWord write_control(Channel & channel, HalfWord value);
+    void trigger(DmaTiming timing);
+    void trigger_video_capture(int scanline);
+    void trigger_sound_fifo(Word fifo_address);
+
+    void transfer(Channel & channel);
+    Word copy_plain_units(Word source, Word destination, Word count, Word unit_size);
+    void finish_transfer(Channel & channel);
+} Dma;
+
+#endif
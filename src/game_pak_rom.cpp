@@ -0,0 +1,87 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <SDL3/SDL.h>
+
+#include "src/memory.h"
+
+// Maps the file privately so processes running the same ROM share its pages.
+bool Memory::load_game_pak_rom(const char * filename, bool populate)
+{
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        SDL_Log("Failed to open ROM %s: %s", filename, strerror(errno));
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) < 0 || file_stat.st_size == 0) {
+        SDL_Log("Failed to read ROM %s", filename);
+        close(file);
+        return false;
+    }
+
+    size_t size = file_stat.st_size;
+    if (size > GAME_PAK_ROM_SIZE) {
+        SDL_Log("ROM %s is larger than 32 MiB, the rest is ignored", filename);
+        size = GAME_PAK_ROM_SIZE;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void * rom = mmap(nullptr, size, PROT_READ, flags, file, 0);
+    close(file);
+    if (rom == MAP_FAILED) {
+        SDL_Log("Failed to map ROM %s: %s", filename, strerror(errno));
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(rom, size, MADV_HUGEPAGE);
+#endif
+
+    unload_game_pak_rom();
+    game_pak_rom = (Byte *)rom;
+    game_pak_rom_size = size;
+    game_pak_rom_mapped = true;
+    map_game_pak_rom();
+    return true;
+}
+
+void Memory::unload_game_pak_rom()
+{
+    if (game_pak_rom_mapped) {
+        munmap(game_pak_rom, game_pak_rom_size);
+    }
+    game_pak_rom = nullptr;
+    game_pak_rom_size = 0;
+    game_pak_rom_mapped = false;
+    map_game_pak_rom();
+}
+
+// The three wait state mirrors. A page running past the end of the ROM
+// is left to the slow path, which returns open bus there.
+void Memory::map_game_pak_rom()
+{
+    for (Word address = 0x08000000; address < 0x0E000000; address += MEMORY_PAGE_SIZE) {
+        Word rom_address = address & (GAME_PAK_ROM_SIZE - 1);
+        MemoryPage & page = pages[address >> MEMORY_PAGE_SHIFT];
+        page.read = rom_address + MEMORY_PAGE_SIZE <= game_pak_rom_size ? &game_pak_rom[rom_address] : nullptr;
+        page.write = nullptr;
+        page.mask = MEMORY_PAGE_SIZE - 1;
+    }
+}
+
+// With no ROM to drive it the bus holds the halfword address.
+Byte Memory::game_pak_open_bus(Word address)
+{
+    HalfWord value = (address >> 1) & 0xFFFF;
+    return value >> ((address & 1) * 8);
+}
@@ -14,16 +14,27 @@
 #include "src/display.h"
 #include "src/scheduler.h"
 #include "src/context.h"
+#include "src/dma.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <cstdio>
 
 #include "src/cpu/opcodes/arm/multiply.h"
 
+// #define PROFILE
+
 #define SCALE 3
 
+// Frames are paced against the wall clock here, the scheduler only knows
+// emulated time. After falling this many frames behind the clock is reset
+// instead of catching up.
+#define FRAME_NANOSECONDS ((u_int64_t)CYCLES_PER_FRAME * 1000000000 / CYCLES_PER_SECOND)
+#define MAX_FRAMES_BEHIND 4
+
 static ARM7TDMI * cpu = new ARM7TDMI();
 static Scheduler * scheduler = new Scheduler(cpu);
+static Dma * dma = new Dma(cpu);
 
 static Context global_context;
 
@@ -32,7 +43,8 @@ static Display * display = nullptr;
 static SDL_Window * window = nullptr;
 static SDL_Renderer * renderer = nullptr;
 
-Word ticks_since_last_render = 0;
+static u_int64_t next_frame_ns = 0;
+static int benchmark_frames = 0; // Run this many frames unpaced then quit
 
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
     // SDL_SetAppMetadata();
@@ -53,38 +65,46 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
         return SDL_APP_FAILURE;
     }
 
-    SDL_SetRenderScale(renderer, SCALE, SCALE);
+    SDL_SetRenderLogicalPresentation(renderer, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE);
 
     global_context.cpu = cpu;
     global_context.memory = &cpu->memory;
+    global_context.dma = dma;
 
     display = new Display(renderer, &global_context, &cpu->memory);
     
     cpu->skip_bios();
 
-    if (argc > 1) {
-        FILE * fileptr;
-        
-        std::string filename = "test-roms/";
-        filename = filename + argv[1];
-
-        SDL_Log("%s", filename.c_str());
-
-        long file_length;
-
-        fileptr = fopen(filename.c_str(), "rb");
-        fseek(fileptr, 0, SEEK_END);
-        file_length = ftell(fileptr);
-        rewind(fileptr);
+    const char * rom_name = nullptr;
+    bool preload_rom = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jit") == 0) {
+            cpu->use_jit = cpu->jit.available();
+            if (!cpu->use_jit) {
+                SDL_Log("JIT unavailable, using the interpreter");
+            }
+        } else if (strcmp(argv[i], "--no-idle-loops") == 0) {
+            cpu->detect_idle_loops = false;
+        } else if (strcmp(argv[i], "--preload-rom") == 0) {
+            preload_rom = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            benchmark_frames = atoi(argv[++i]);
+        } else if (rom_name == nullptr) {
+            rom_name = argv[i];
+        }
+    }
 
-        fread(&cpu->memory.game_pak_rom, 1, file_length, fileptr);
-        fclose(fileptr);
+    if (rom_name != nullptr) {
+        SDL_Log("%s", rom_name);
+        if (!cpu->memory.load_game_pak_rom(rom_name, preload_rom)) {
+            return SDL_APP_FAILURE;
+        }
+        cpu->load_idle_loop_override();
     }
 
     display->start_draw_loop(scheduler);
 
-    scheduler->total_passed_milliseconds = SDL_GetTicks();
-    scheduler->total_passed_nanoseconds = SDL_GetTicksNS();
+    next_frame_ns = SDL_GetTicksNS();
 
     return SDL_APP_CONTINUE;
 }
@@ -128,20 +148,46 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
 int current_scanline = 0;
 
 SDL_AppResult SDL_AppIterate(void *appstate) {   
-    scheduler->tick();
-
-    ticks_since_last_render += scheduler->passed_milliseconds;
-    if (ticks_since_last_render > 1000/60) {
-        // SDL_Log("%0x interrupt", cpu->read_word_from_memory(0x03007FFC));
+    if (benchmark_frames > 0) {
+        u_int64_t start_ns = SDL_GetTicksNS();
+        for (int frame = 0; frame < benchmark_frames; frame++) {
+            scheduler->run_frame();
+        }
+        u_int64_t passed_ns = SDL_GetTicksNS() - start_ns;
+        SDL_Log("%d frames in %lu ms, %.1f frames per second", benchmark_frames, passed_ns / 1000000, benchmark_frames * 1e9 / passed_ns);
         display->render();
-        ticks_since_last_render = 0;
+        SDL_Log("present time: %lu us", display->last_present_ns / 1000);
+        return SDL_APP_SUCCESS;
+    }
+
+    u_int64_t now_ns = SDL_GetTicksNS();
+    if (now_ns < next_frame_ns) {
+        SDL_DelayNS(next_frame_ns - now_ns);
+        return SDL_APP_CONTINUE;
     }
+
+    if (now_ns - next_frame_ns > MAX_FRAMES_BEHIND * FRAME_NANOSECONDS) {
+        next_frame_ns = now_ns;
+    }
+    while (next_frame_ns <= now_ns) {
+        scheduler->run_frame();
+        next_frame_ns += FRAME_NANOSECONDS;
+    }
+
+    // SDL_Log("%0x interrupt", cpu->read_word_from_memory(0x03007FFC));
+    display->render();
+    #ifdef PROFILE
+        if (display->presented_frames % 600 == 0) {
+            SDL_Log("average present time: %lu us", display->total_present_ns / display->presented_frames / 1000);
+        }
+    #endif
     
     return SDL_APP_CONTINUE;
 }
 
 void SDL_AppQuit(void *appstate, SDL_AppResult result) {
     delete scheduler;
+    delete dma;
     delete display;
     delete cpu;
 }
\ No newline at end of file
@@ -1,64 +1,259 @@
 #include "src/memory.h"
+#include "src/utils.h"
 #include <SDL3/SDL.h>
 #define SDL_Log 
-Word Memory::read_word_from_memory(Word address) {
-    return (
-        (read_from_memory(address  ) << 0) 
-    |   (read_from_memory(address+1) << 8)
-    |   (read_from_memory(address+2) << 16)
-    |   (read_from_memory(address+3) << 24)
+Memory::Memory()
+{
+    map_pages(0x02000000, 0x03000000, wram_board, WRAM_BOARD_SIZE, true);
+    map_pages(0x03000000, 0x04000000, wram_chip, WRAM_CHIP_SIZE, true);
+    map_pages(0x05000000, 0x06000000, palette_ram, PALETTE_RAM_SIZE, true);
+    // 96 KiB of VRAM in a 128 KiB mirror, the last 32 KiB repeat
+    for (Word base_address = 0x06000000; base_address < 0x07000000; base_address += 0x20000) {
+        map_pages(base_address, base_address + 0x10000, vram, 0x10000, true);
+        map_pages(base_address + 0x10000, base_address + 0x20000, &vram[0x10000], 0x8000, true);
+    }
+    map_pages(0x07000000, 0x08000000, oam, OAM_SIZE, true);
+    map_game_pak_rom();
+    map_pages(0x0E000000, 0x10000000, sram, SRAM_SIZE, true);
+
+    update_wait_states(0);
+    set_io_register_hook(WAITCNT_ADDRESS, nullptr,
+        [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+            HalfWord wait_control = (current_value & ~mask) | (written_value & mask);
+            ((Memory *)context)->update_wait_states(wait_control);
+            return wait_control;
+        },
+        this
     );
 }
 
-HalfWord Memory::read_halfword_from_memory(Word address) {
-    return (
-        (read_from_memory(address  ) << 0) 
-    |   (read_from_memory(address+1) << 8)
-    );
+Memory::~Memory()
+{
+    unload_game_pak_rom();
 }
 
-Byte Memory::read_from_memory(Word address) {
-    Word address_space = address >> 24;
-    Word address_main = address & 0x00FFFFFF;
+void Memory::update_wait_states(HalfWord wait_control)
+{
+    static const Byte nonsequential_waits[4] = {4, 3, 2, 8};
+    static const Byte sequential_waits[3][2] = {{2, 1}, {4, 1}, {8, 1}};
 
-    MemoryPointer memory_pointer = address_to_memory_pointer(address);
-    if (memory_pointer.valid == true) {
-        for (auto region : addressable_regions) {
-            if (address >= region.base_address && address <= region.base_address+region.length) {
-                return region.read(*memory_pointer.pointer);
-            }
+    for (int region = 0; region < 0x10; region++) {
+        // On board WRAM has two wait states, palette RAM and VRAM a 16 bit bus.
+        Byte cycles_16 = region == 0x2 ? 3 : 1;
+        Byte cycles_32 = (region == 0x2 || region == 0x5 || region == 0x6) ? cycles_16 * 2 : cycles_16;
+        for (int type = 0; type < 2; type++) {
+            data_access_cycles[type][ACCESS_16][region] = cycles_16;
+            data_access_cycles[type][ACCESS_32][region] = cycles_32;
         }
-        
-        return *memory_pointer.pointer;
     }
 
-    return 0x0;
+    // Game pak ROM in its three wait state mirrors, 32 bit accesses are split in two.
+    for (int wait_state = 0; wait_state < 3; wait_state++) {
+        Byte nonsequential = 1 + nonsequential_waits[Utils::read_bit_range(wait_control, 2 + wait_state * 3, 3 + wait_state * 3)];
+        Byte sequential = 1 + sequential_waits[wait_state][Utils::read_bit(wait_control, 4 + wait_state * 3)];
+        for (int region = 0x8 + wait_state * 2; region < 0xA + wait_state * 2; region++) {
+            data_access_cycles[ACCESS_NONSEQUENTIAL][ACCESS_16][region] = nonsequential;
+            data_access_cycles[ACCESS_SEQUENTIAL][ACCESS_16][region] = sequential;
+            data_access_cycles[ACCESS_NONSEQUENTIAL][ACCESS_32][region] = nonsequential + sequential;
+            data_access_cycles[ACCESS_SEQUENTIAL][ACCESS_32][region] = sequential * 2;
+        }
+    }
+
+    // SRAM has an 8 bit bus and no sequential accesses.
+    Byte sram_cycles = 1 + nonsequential_waits[Utils::read_bit_range(wait_control, 0, 1)];
+    for (int region = 0xE; region < 0x10; region++) {
+        for (int type = 0; type < 2; type++) {
+            data_access_cycles[type][ACCESS_16][region] = sram_cycles;
+            data_access_cycles[type][ACCESS_32][region] = sram_cycles;
+        }
+    }
+
+    // The prefetch buffer fills while the CPU is busy elsewhere, sequential
+    // code fetches from it take a cycle per halfword.
+    memcpy(code_fetch_cycles, data_access_cycles, sizeof(code_fetch_cycles));
+    if (Utils::read_bit(wait_control, 14)) {
+        for (int region = 0x8; region < 0xE; region++) {
+            code_fetch_cycles[ACCESS_SEQUENTIAL][ACCESS_16][region] = 1;
+            code_fetch_cycles[ACCESS_SEQUENTIAL][ACCESS_32][region] = 2;
+        }
+    }
 }
 
-void Memory::write_word_to_memory(Word address, Word value) {
-    write_to_memory(address  , (value >> 0 ) & 0xFF); 
-    write_to_memory(address+1, (value >> 8 ) & 0xFF); 
-    write_to_memory(address+2, (value >> 16) & 0xFF); 
-    write_to_memory(address+3, (value >> 24) & 0xFF); 
+void Memory::map_pages(Word start_address, Word end_address, Byte * region, Word region_size, bool writable)
+{
+    for (Word address = start_address; address < end_address; address += MEMORY_PAGE_SIZE) {
+        MemoryPage & page = pages[address >> MEMORY_PAGE_SHIFT];
+        if (region_size < MEMORY_PAGE_SIZE) {
+            page.read = region;
+            page.mask = region_size - 1;
+        } else {
+            page.read = &region[(address - start_address) % region_size];
+            page.mask = MEMORY_PAGE_SIZE - 1;
+        }
+        page.write = writable ? page.read : nullptr;
+    }
+}
+
+void Memory::set_io_register_hook(Word address, IoReadHook read, IoWriteHook write, void * context)
+{
+    io_register_hooks[(address & (IO_REGISTERS_SIZE - 1)) >> 1] = {read, write, context};
+}
+
+HalfWord Memory::read_io_halfword(Word offset) {
+    // DISPSTAT, VCOUNT and IF only change when an event runs, a loop
+    // polling anything else (the timer counters most of all) isn't idle.
+    if (offset != 0x004 && offset != 0x006 && offset != 0x202) {
+        unsettled_io_read = true;
+    }
+    HalfWord value = read_halfword_from_memory(io_registers, offset);
+    IoRegisterHook & hook = io_register_hooks[offset >> 1];
+    return hook.read != nullptr ? hook.read(hook.context, value) : value;
+}
+
+void Memory::write_io_halfword(Word offset, HalfWord value, HalfWord mask) {
+    HalfWord current_value = read_halfword_from_memory(io_registers, offset);
+    IoRegisterHook & hook = io_register_hooks[offset >> 1];
+    if (hook.write != nullptr) {
+        value = hook.write(hook.context, current_value, value, mask);
+    } else {
+        value = (current_value & ~mask) | (value & mask);
+    }
+    write_halfword_to_memory(io_registers, offset, value);
+}
+
+static bool is_io_register(Word address) {
+    return address >= 0x04000000 && address < 0x04000000 + IO_REGISTERS_SIZE;
+}
+
+Word Memory::read_slow(Word address, int size) {
+    Word value = 0;
+    if (is_io_register(address)) {
+        Word offset = address & (IO_REGISTERS_SIZE - 1);
+        if (size == 1) {
+            return (read_io_halfword(offset & ~1) >> ((offset & 1) * 8)) & 0xFF;
+        }
+        for (int i = 0; i < size; i += 2) {
+            value |= (Word)read_io_halfword(offset + i) << (i * 8);
+        }
+        return value;
+    }
+
+    for (int i = 0; i < size; i++) {
+        value |= (Word)read_byte_slow(address + i) << (i * 8);
+    }
+    return value;
+}
+
+void Memory::write_slow(Word address, Word value, int size) {
+    if (is_io_register(address)) {
+        Word offset = address & (IO_REGISTERS_SIZE - 1);
+        if (size == 1) {
+            int shift = (offset & 1) * 8;
+            write_io_halfword(offset & ~1, value << shift, 0xFF << shift);
+            return;
+        }
+        for (int i = 0; i < size; i += 2) {
+            write_io_halfword(offset + i, value >> (i * 8), 0xFFFF);
+        }
+        return;
+    }
+
+    for (int i = 0; i < size; i++) {
+        write_byte_slow(address + i, (value >> (i * 8)) & 0xFF);
+    }
 }
 
-void Memory::write_halfword_to_memory(Word address, HalfWord value) {
-    write_to_memory(address  , (value >> 0 ) & 0xFF); 
-    write_to_memory(address+1, (value >> 8 ) & 0xFF); 
+Byte Memory::read_byte_slow(Word address) {
+    MemoryPointer memory_pointer = address_to_memory_pointer(address);
+    if (memory_pointer.valid == true) {
+        return *memory_pointer.pointer;
+    }
+
+    Word address_space = address >> 24;
+    if (address_space >= 0x8 && address_space < 0xE) {
+        return game_pak_open_bus(address);
+    }
+    return 0x0;
 }
 
-void Memory::write_to_memory(Word address, Byte value) {
+void Memory::write_byte_slow(Word address, Byte value) {
     Word address_space = address >> 24;
     Word address_main = address & 0x00FFFFFF;
 
+    // Game pak ROM is read only, cached and compiled blocks there rely on it never changing.
+    if (address_space >= 0x8 && address_space < 0xE) {
+        return;
+    }
+
     MemoryPointer memory_pointer = address_to_memory_pointer(address);
     if (memory_pointer.valid == true) {
-        for (auto region : addressable_regions) {
-            if (address >= region.base_address && address <= region.base_address+region.length) {
-                value = region.write(*memory_pointer.pointer, value);
-            }
-        }
         *memory_pointer.pointer = value;
+
+        int code_page = wram_code_page(address);
+        if (code_page >= 0 && wram_code_pages[code_page]) {
+            unmark_code_page(code_page);
+            written_code_pages.push_back(code_page);
+            code_page_written = true;
+        }
+    }
+}
+
+int Memory::wram_code_page(Word address) {
+    switch (address >> 24) {
+        case 0x2:
+            return (address % WRAM_BOARD_SIZE) >> CODE_PAGE_SHIFT;
+        case 0x3:
+            return (WRAM_BOARD_SIZE + (address % WRAM_CHIP_SIZE)) >> CODE_PAGE_SHIFT;
+        default:
+            return -1;
+    }
+}
+
+// WRAM pages holding cached code take the slow write path so writes to the code are seen.
+void Memory::mark_code_page(Word address) {
+    int code_page = wram_code_page(address);
+    if (code_page < 0 || wram_code_pages[code_page]) {
+        return;
+    }
+
+    wram_code_pages[code_page] = true;
+    int wram_page = code_page >> (MEMORY_PAGE_SHIFT - CODE_PAGE_SHIFT);
+    if (marked_code_pages[wram_page]++ == 0) {
+        set_wram_page_writable(wram_page, false);
+    }
+}
+
+void Memory::unmark_code_page(int code_page) {
+    wram_code_pages[code_page] = false;
+    int wram_page = code_page >> (MEMORY_PAGE_SHIFT - CODE_PAGE_SHIFT);
+    if (--marked_code_pages[wram_page] == 0) {
+        set_wram_page_writable(wram_page, true);
+    }
+}
+
+void Memory::clear_code_pages() {
+    for (int i = 0; i < WRAM_CODE_PAGES; i++) {
+        wram_code_pages[i] = false;
+    }
+    for (int i = 0; i < WRAM_MEMORY_PAGES; i++) {
+        if (marked_code_pages[i] != 0) {
+            marked_code_pages[i] = 0;
+            set_wram_page_writable(i, true);
+        }
+    }
+}
+
+// Sets the write pointer of a 16 KiB WRAM page in every mirror.
+void Memory::set_wram_page_writable(int wram_page, bool writable) {
+    Word wram_offset = wram_page << MEMORY_PAGE_SHIFT;
+    bool board = wram_offset < WRAM_BOARD_SIZE;
+    Byte * page_memory = board ? &wram_board[wram_offset] : &wram_chip[wram_offset - WRAM_BOARD_SIZE];
+    Word mirror_start = board ? 0x02000000 + wram_offset : 0x03000000 + wram_offset - WRAM_BOARD_SIZE;
+    Word mirror_end = board ? 0x03000000 : 0x04000000;
+    Word mirror_size = board ? WRAM_BOARD_SIZE : WRAM_CHIP_SIZE;
+
+    for (Word address = mirror_start; address < mirror_end; address += mirror_size) {
+        pages[address >> MEMORY_PAGE_SHIFT].write = writable ? page_memory : nullptr;
     }
 }
 
@@ -139,8 +334,11 @@ Memory::MemoryPointer Memory::address_to_memory_pointer(Word address) {
     }
 
     if (address_space < 0xE) {
-        memory_pointer.pointer = &game_pak_rom[address - (0x08 << 24)];
-        memory_pointer.valid = true;
+        Word rom_address = address & (GAME_PAK_ROM_SIZE - 1);
+        if (rom_address < game_pak_rom_size) {
+            memory_pointer.pointer = &game_pak_rom[rom_address];
+            memory_pointer.valid = true;
+        }
         return memory_pointer;
     }
 
@@ -169,15 +367,3 @@ void Memory::write_halfword_to_memory(Byte * memory, Word address, HalfWord valu
 void Memory::write_to_memory(Byte * memory, Word address, Byte value) {
     memory[address] = value;
 }
-
-Memory::AddressableRegion::AddressableRegion(
-    Word base_address, 
-    Word length, 
-    std::function<Byte(Byte, Byte)> write, 
-    std::function<Byte(Byte)> read
-) :
-base_address(base_address),
-length(length),
-write(write),
-read(read)
-{} 
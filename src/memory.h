@@ -1,7 +1,7 @@
 #ifndef MEMORY_INCLUDED
 #define MEMORY_INCLUDED
 
-#include <functional>
+#include <string.h>
 #include <vector>
 
 #include "src/cpu/cpu_types.h"
@@ -9,16 +9,42 @@
 #define BIOS_SIZE 0x00004000
 #define WRAM_BOARD_SIZE 0x00040000
 #define WRAM_CHIP_SIZE 0x00008000
-#define IO_REGISTERS_SIZE 0x3FF
+#define IO_REGISTERS_SIZE 0x400
 
 #define PALETTE_RAM_SIZE 0x400
 #define VRAM_SIZE 0x18000
 #define OAM_SIZE 0x400
 
-#define GAME_PAK_ROM_SIZE 0x06000000
+#define WAITCNT_ADDRESS 0x04000204
+
+#define GAME_PAK_ROM_SIZE 0x02000000 // Largest cartridge, mirrored three times
 #define SRAM_SIZE 0x00010000
 
+// Writes to WRAM are tracked in 64 byte pages so cached instruction blocks built there can be dropped.
+#define CODE_PAGE_SHIFT 6
+#define WRAM_CODE_PAGES ((WRAM_BOARD_SIZE + WRAM_CHIP_SIZE) >> CODE_PAGE_SHIFT)
+
+// The 28 bit bus is mapped in 16 KiB pages.
+#define MEMORY_PAGE_SHIFT 14
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_COUNT (0x10000000 >> MEMORY_PAGE_SHIFT)
+#define WRAM_MEMORY_PAGES ((WRAM_BOARD_SIZE + WRAM_CHIP_SIZE) >> MEMORY_PAGE_SHIFT)
+
+// Byte accesses take as long as halfword ones.
+enum AccessWidth {
+    ACCESS_16,
+    ACCESS_32
+};
+
+enum AccessType {
+    ACCESS_NONSEQUENTIAL,
+    ACCESS_SEQUENTIAL
+};
+
 typedef struct Memory {
+    Memory();
+    ~Memory();
+
     Byte wram_board[WRAM_BOARD_SIZE];
     Byte wram_chip[WRAM_CHIP_SIZE];
     Byte io_registers[IO_REGISTERS_SIZE];
@@ -27,27 +53,112 @@ typedef struct Memory {
     Byte vram[VRAM_SIZE];
     Byte oam[OAM_SIZE];
     
-    Byte game_pak_rom[GAME_PAK_ROM_SIZE];
+    // Mapped read only from the ROM file, reads past the end are open bus.
+    Byte * game_pak_rom = nullptr;
+    Word game_pak_rom_size = 0;
+    bool game_pak_rom_mapped = false;
     Byte sram[SRAM_SIZE];
 
-    typedef struct AddressableRegion {
-        AddressableRegion(Word base_address, Word length, std::function<Byte(Byte, Byte)> write, std::function<Byte(Byte)> read);
-        Word base_address;
-        Word length;
-
-        std::function<Byte(Byte, Byte)> write;
-        std::function<Byte(Byte)> read;
-    } AddressableRegion;
-
-    std::vector<AddressableRegion> addressable_regions;
+    // I/O registers with side effects, hooked per halfword. Registers
+    // without a hook are read and written like plain memory. The write
+    // hook returns the value to store, mask has the bytes written set.
+    typedef HalfWord (*IoReadHook)(void * context, HalfWord value);
+    typedef HalfWord (*IoWriteHook)(void * context, HalfWord current_value, HalfWord written_value, HalfWord mask);
+
+    typedef struct IoRegisterHook {
+        IoReadHook read;
+        IoWriteHook write;
+        void * context;
+    } IoRegisterHook;
+
+    IoRegisterHook io_register_hooks[IO_REGISTERS_SIZE / 2] = {};
+    void set_io_register_hook(Word address, IoReadHook read, IoWriteHook write, void * context);
+
+    bool unsettled_io_read = false; // Cleared when an idle loop is armed
+    HalfWord read_io_halfword(Word offset);
+    void write_io_halfword(Word offset, HalfWord value, HalfWord mask);
+
+    // Host pointers for plain memory, mirrors included. Pages that need
+    // more than a plain load or store (I/O, ROM writes, WRAM holding
+    // cached code) are null and take the slow path.
+    typedef struct MemoryPage {
+        Byte * read;
+        Byte * write;
+        Word mask; // Offset into read and write, smaller than the page for mirrors under 16 KiB
+    } MemoryPage;
+
+    MemoryPage pages[MEMORY_PAGE_COUNT] = {};
+
+    void map_pages(Word start_address, Word end_address, Byte * region, Word region_size, bool writable);
+    void set_wram_page_writable(int wram_page, bool writable);
+
+    bool load_game_pak_rom(const char * filename, bool populate);
+    void unload_game_pak_rom();
+    void map_game_pak_rom();
+    static Byte game_pak_open_bus(Word address);
+
+    // Cycles for one access to each 16 MiB region by AccessType and
+    // AccessWidth, rebuilt whenever WAITCNT is written. Code fetches
+    // differ from data accesses only in the game pak prefetch buffer.
+    Byte data_access_cycles[2][2][0x10];
+    Byte code_fetch_cycles[2][2][0x10];
+    void update_wait_states(HalfWord wait_control);
+
+    bool wram_code_pages[WRAM_CODE_PAGES] = {};
+    int marked_code_pages[WRAM_MEMORY_PAGES] = {}; // Per 16 KiB page of WRAM
+    std::vector<int> written_code_pages;
+    bool code_page_written = false;
+
+    static int wram_code_page(Word address);
+    void mark_code_page(Word address);
+    void unmark_code_page(int code_page);
+    void clear_code_pages();
     
-    Word read_word_from_memory(Word address);
-    HalfWord read_halfword_from_memory(Word address);
-    Byte read_from_memory(Word address);
-
-    void write_word_to_memory(Word address, Word value);
-    void write_halfword_to_memory(Word address, HalfWord value);
-    void write_to_memory(Word address, Byte value);
+    // Halfword and word accesses are aligned down as on the bus, rotating
+    // misaligned loads is left to the CPU. Plain pages are read and written
+    // with a single load or store. I/O goes a halfword at a time through
+    // the register hooks, anything else a byte at a time.
+    template <class T>
+    T read_memory(Word address) {
+        address &= ~(Word)(sizeof(T) - 1);
+        if (address < 0x10000000) {
+            MemoryPage & page = pages[address >> MEMORY_PAGE_SHIFT];
+            if (page.read != nullptr) {
+                T value;
+                memcpy(&value, &page.read[address & page.mask], sizeof(value));
+                return value;
+            }
+        }
+
+        return read_slow(address, sizeof(T));
+    }
+
+    template <class T>
+    void write_memory(Word address, T value) {
+        address &= ~(Word)(sizeof(T) - 1);
+        if (address < 0x10000000) {
+            MemoryPage & page = pages[address >> MEMORY_PAGE_SHIFT];
+            if (page.write != nullptr) {
+                memcpy(&page.write[address & page.mask], &value, sizeof(value));
+                return;
+            }
+        }
+
+        write_slow(address, value, sizeof(T));
+    }
+
+    Word read_word_from_memory(Word address) { return read_memory<Word>(address); }
+    HalfWord read_halfword_from_memory(Word address) { return read_memory<HalfWord>(address); }
+    Byte read_from_memory(Word address) { return read_memory<Byte>(address); }
+
+    void write_word_to_memory(Word address, Word value) { write_memory<Word>(address, value); }
+    void write_halfword_to_memory(Word address, HalfWord value) { write_memory<HalfWord>(address, value); }
+    void write_to_memory(Word address, Byte value) { write_memory<Byte>(address, value); }
+
+    Word read_slow(Word address, int size);
+    void write_slow(Word address, Word value, int size);
+    Byte read_byte_slow(Word address);
+    void write_byte_slow(Word address, Byte value);
 
     typedef struct MemoryPointer {
         Byte * pointer;
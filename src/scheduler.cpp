@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <climits>
+#include <utility>
+
 #include "src/scheduler.h"
 #include "src/display.h"
 
@@ -6,132 +10,320 @@
 Scheduler::Scheduler(ARM7TDMI * cpu) : 
 cpu(cpu), 
 timers{
-    Timer(&cpu->memory, &timers[1] ,0),
-    Timer(&cpu->memory, &timers[2] ,1),
-    Timer(&cpu->memory, &timers[3] ,2),
-    Timer(&cpu->memory, nullptr ,3),
+    Timer(this, &cpu->memory, &timers[1] ,0),
+    Timer(this, &cpu->memory, &timers[2] ,1),
+    Timer(this, &cpu->memory, &timers[3] ,2),
+    Timer(this, &cpu->memory, nullptr ,3),
 } 
-{}
+{
+    event_slots.reserve(INITIAL_EVENT_SLOTS);
+    free_event_slots.reserve(INITIAL_EVENT_SLOTS);
+    event_heap.reserve(INITIAL_EVENT_SLOTS);
+
+    set_event_handler(EVENT_TIMER_OVERFLOW, [](void * context, Word payload) {
+        ((Scheduler *)context)->timers[payload].overflow();
+    }, this);
 
-void Scheduler::schedule_event(Word cycles, std::function<void()> event) {
-    ScheduledEvent scheduled_event = {cycles, event};
-    events.push_back(scheduled_event);
-    events.sort([](const ScheduledEvent& first, const ScheduledEvent& second){
-        return first.cycles_till_done < second.cycles_till_done;
-    });
+    for (Timer & timer : timers) {
+        Word address = 0x04000100 + 0x04 * timer.number;
+        // Writes to TMxCNT_L set the reload value, reads see the counter.
+        cpu->memory.set_io_register_hook(address,
+            [](void * context, HalfWord) -> HalfWord {
+                return ((Timer *)context)->read_counter();
+            },
+            [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+                Timer * timer = (Timer *)context;
+                timer->reload_value = (timer->reload_value & ~mask) | (written_value & mask);
+                return current_value;
+            },
+            &timer
+        );
+        cpu->memory.set_io_register_hook(address + 2, nullptr,
+            [](void * context, HalfWord current_value, HalfWord written_value, HalfWord mask) -> HalfWord {
+                return ((Timer *)context)->write_control((current_value & ~mask) | (written_value & mask));
+            },
+            &timer
+        );
+    }
 }
- 
-void Scheduler::move_events_forward(Word cycles) {
-    for (auto & scheduled_event : events) {
-        scheduled_event.cycles_till_done -= cycles;
+
+// The due cycle of the event being run, so repeating events don't drift,
+// otherwise the CPU's cycle.
+u_int64_t Scheduler::event_base_cycle() {
+    return running_event ? running_event_cycle : current_cycle + cpu->cycles;
+}
+
+void Scheduler::set_event_handler(EventType type, EventHandler handler, void * context) {
+    event_handlers[type] = {handler, context};
+}
+
+EventId Scheduler::schedule_event(Word cycles, EventType type, Word payload) {
+    SDL_assert(event_handlers[type].handler != nullptr);
+    EventId id;
+    if (free_event_slots.empty()) {
+        id = event_slots.size();
+        event_slots.push_back({});
+    } else {
+        id = free_event_slots.back();
+        free_event_slots.pop_back();
     }
+
+    ScheduledEvent & scheduled_event = event_slots[id];
+    scheduled_event.timestamp = event_base_cycle() + cycles;
+    scheduled_event.order = next_event_order++;
+    scheduled_event.type = type;
+    scheduled_event.payload = payload;
+    scheduled_event.heap_index = event_heap.size();
+
+    event_heap.push_back(id);
+    sift_up(scheduled_event.heap_index);
+    return id;
 }
 
-void Scheduler::tick() {
-    passed_nanoseconds = SDL_GetTicksNS() - total_passed_nanoseconds;
-    passed_milliseconds = SDL_GetTicks() - total_passed_milliseconds;
+// Moves a pending event, it runs after anything already due on the same cycle.
+void Scheduler::reschedule_event(EventId id, Word cycles) {
+    SDL_assert(is_event_scheduled(id));
+    ScheduledEvent & scheduled_event = event_slots[id];
+    scheduled_event.timestamp = event_base_cycle() + cycles;
+    scheduled_event.order = next_event_order++;
+    sift_up(scheduled_event.heap_index);
+    sift_down(scheduled_event.heap_index);
+}
+
+void Scheduler::cancel_event(EventId id) {
+    if (!is_event_scheduled(id)) {return;}
+    remove_heap_entry(event_slots[id].heap_index);
+}
 
-    int cycles_to_pass = passed_milliseconds * CYCLES_PER_MILISECOND;
+bool Scheduler::is_event_scheduled(EventId id) {
+    return id >= 0 && id < (EventId)event_slots.size() && event_slots[id].heap_index >= 0;
+}
+
+bool Scheduler::event_due_before(EventId first, EventId second) {
+    ScheduledEvent & first_event = event_slots[first];
+    ScheduledEvent & second_event = event_slots[second];
+    if (first_event.timestamp != second_event.timestamp) {
+        return first_event.timestamp < second_event.timestamp;
+    }
+    return first_event.order < second_event.order;
+}
+
+void Scheduler::swap_heap_entries(int first, int second) {
+    std::swap(event_heap[first], event_heap[second]);
+    event_slots[event_heap[first]].heap_index = first;
+    event_slots[event_heap[second]].heap_index = second;
+}
+
+void Scheduler::sift_up(int heap_index) {
+    while (heap_index > 0) {
+        int parent = (heap_index - 1) / 2;
+        if (!event_due_before(event_heap[heap_index], event_heap[parent])) {break;}
+        swap_heap_entries(heap_index, parent);
+        heap_index = parent;
+    }
+}
+
+void Scheduler::sift_down(int heap_index) {
+    int size = event_heap.size();
+    while (true) {
+        int earliest = heap_index;
+        int left = heap_index * 2 + 1;
+        int right = left + 1;
+        if (left < size && event_due_before(event_heap[left], event_heap[earliest])) {earliest = left;}
+        if (right < size && event_due_before(event_heap[right], event_heap[earliest])) {earliest = right;}
+        if (earliest == heap_index) {break;}
+        swap_heap_entries(heap_index, earliest);
+        heap_index = earliest;
+    }
+}
+
+void Scheduler::remove_heap_entry(int heap_index) {
+    EventId id = event_heap[heap_index];
+    int last = event_heap.size() - 1;
+    if (heap_index != last) {
+        swap_heap_entries(heap_index, last);
+    }
+    event_heap.pop_back();
+    if (heap_index != last) {
+        sift_up(heap_index);
+        sift_down(heap_index);
+    }
+
+    event_slots[id].heap_index = -1;
+    free_event_slots.push_back(id);
+}
+
+// Returns the number of events run.
+int Scheduler::run_due_events() {
     int event_total = 0;
+    while (!event_heap.empty() && event_slots[event_heap.front()].timestamp <= current_cycle) {
+        EventId id = event_heap.front();
+        ScheduledEvent event = event_slots[id];
+        running_event_cycle = event.timestamp;
+        remove_heap_entry(0);
 
-    int time = SDL_GetTicks();
-    u_int64_t time_ns = SDL_GetTicksNS();
-
-    int passed_cycles = cycles_to_pass;
-
-    while (passed_cycles > 0) {
-        ScheduledEvent next_event = events.front();
-        int cycles_till_next_event = next_event.cycles_till_done;
-
-        
-        while (cycles_till_next_event > 0) {
-            int cpu_passed_cycles = 3;
-            cpu->run_next_opcode();
-            cycles_till_next_event -= cpu_passed_cycles;
-            
-            // for (int i = 0; i < 4; i++) {
-            //     Timer timer = timers[i];
-            //     if (timer.control.enabled.get() == 0 || timer.control.cascade.get() == 1) {continue;}
-            //     timer.pass_cycles(cpu_passed_cycles);
-            // }
+        EventHandlerEntry & entry = event_handlers[event.type];
+        running_event = true;
+        entry.handler(entry.context, event.payload);
+        running_event = false;
+        cpu->idle_loop_armed = IDLE_LOOP_NONE;
+        cpu->wake_on_interrupt();
+        event_total++;
+    }
+    return event_total;
+}
+
+// Runs the given number of cycles and returns the number of events run. An
+// instruction can run past the end, the next call starts that much shorter.
+int Scheduler::run_cycles(u_int64_t cycles) {
+    run_target_cycle += cycles;
+    u_int64_t target_cycle = run_target_cycle;
+    int event_total = 0;
+
+    // The next event is looked up again after every block, the CPU can
+    // schedule one sooner than it.
+    while (true) {
+        event_total += run_due_events();
+        if (current_cycle >= target_cycle) {break;}
+
+        u_int64_t next_event_cycle = target_cycle;
+        if (!event_heap.empty() && event_slots[event_heap.front()].timestamp < target_cycle) {
+            next_event_cycle = event_slots[event_heap.front()].timestamp;
         }
 
-        move_events_forward(next_event.cycles_till_done);
-        passed_cycles -= next_event.cycles_till_done;
+        cpu->wake_on_interrupt();
+        if (cpu->halted) {
+            halted_cycles += next_event_cycle - current_cycle;
+            current_cycle = next_event_cycle;
+            continue;
+        }
 
-        next_event.event();
+        cpu->run_next_block(std::min<u_int64_t>(next_event_cycle - current_cycle, INT_MAX));
+        current_cycle += cpu->cycles;
+        cpu->cycles = 0;
 
-        events.pop_front();
-        event_total++;
+        if (cpu->idle_loop_reached) {
+            cpu->idle_loop_reached = false;
+            if (current_cycle < next_event_cycle) {
+                idle_skipped_cycles += next_event_cycle - current_cycle;
+                current_cycle = next_event_cycle;
+            }
+        }
     }
 
+    return event_total;
+}
+
+// Runs up to the next frame boundary, frames start every CYCLES_PER_FRAME
+// cycles from power on whatever run_cycles was called with before.
+int Scheduler::run_frame() {
+    #ifdef PROFILE
+        u_int64_t time_ns = SDL_GetTicksNS();
+    #endif
+
+    int event_total = run_cycles(CYCLES_PER_FRAME - run_target_cycle % CYCLES_PER_FRAME);
+
     #ifdef PROFILE
-        int passed_time = SDL_GetTicks()-time;
         u_int64_t passed_time_ns = SDL_GetTicksNS()-time_ns;
-        int cycles_per_second = 0;
-        if (passed_time > 0) {
-            cycles_per_second = (cycles_to_pass/passed_time)*1000;
-        }
-        SDL_Log("passed_cycles: %d, time taken (ms): %d, time taken (ns): %lu, cycles per second: %d", cycles_to_pass, passed_time, passed_time_ns, cycles_per_second);
+        SDL_Log("frame time taken (ns): %lu, events: %d", passed_time_ns, event_total);
+        SDL_Log("idle loop cycles skipped: %lu, halted cycles: %lu", idle_skipped_cycles, halted_cycles);
     #endif
-    
-    total_passed_milliseconds = SDL_GetTicks();
-    passed_nanoseconds = SDL_GetTicksNS();
-}    
 
-Scheduler::Timer::Timer(Memory * memory, Timer * next_timer, Word number) : 
-data(&memory->io_registers[0x00000100 + (0x04*number)], 0, 15),
+    return event_total;
+}
+
+Scheduler::Timer::Timer(Scheduler * scheduler, Memory * memory, Timer * next_timer, Word number) : 
 control(&memory->io_registers[0x00000102 + (0x04*number)]),
+scheduler(scheduler),
 next_timer(next_timer),
-cycles_until_increment(get_frequency()),
-reset_value(0)
+number(number),
+counter(0),
+counter_cycle(0),
+reload_value(0),
+overflow_event(EVENT_NONE)
 {}
 
 Scheduler::Timer::Control::Control(Byte * address) :
+value(address, 0, 15),
 frequency(address, 0, 1),
 cascade(address, 2),
 overflow_interrupt(address, 6),
 enabled(address, 7)
 {}
 
-void Scheduler::Timer::pass_cycles(Word cycles) {
-    int frequency = get_frequency();
-    cycles += cycles_until_increment;
-
-    while (cycles >= 0)
-    {
-        if (cycles >= frequency) {
-            cycles -= frequency;
-            increment_data();
-        } else {
-            cycles_until_increment = frequency - cycles;
-            cycles = -1;
-        }
+// Cascading timers count overflows of the one before, timer 0 has nothing
+// to cascade from.
+bool Scheduler::Timer::counts_cycles() {
+    return control.enabled.get() && (number == 0 || !control.cascade.get());
+}
+
+int Scheduler::Timer::prescaler_shift() {
+    static const int shifts[4] = {0, 6, 8, 10}; // 1, 64, 256 and 1024 cycles
+    return shifts[control.frequency.get()];
+}
+
+HalfWord Scheduler::Timer::read_counter() {
+    if (!counts_cycles()) {return counter;}
+    u_int64_t count = counter + ((scheduler->event_base_cycle() - counter_cycle) >> prescaler_shift());
+    // A block can run past the overflow before its event fires, count on
+    // from the reload value rather than wrapping.
+    if (count >= 0x10000) {
+        count = reload_value + (count - 0x10000) % (0x10000 - reload_value);
     }
+    return count;
 }
 
-void Scheduler::Timer::increment_data() {
-    data.set(data.get()+1);
-    if (data.get() == 0) {
-        data.set(reset_value);
-        if (next_timer == nullptr) return;
-        if (next_timer->control.enabled.get() == 1 && next_timer->control.cascade.get() == 1) {
-            next_timer->increment_data();
-        }
+// Counting stops at the old settings and carries on from the same count
+// with the new ones. Starting the timer reloads the counter.
+HalfWord Scheduler::Timer::write_control(HalfWord value) {
+    bool was_enabled = control.enabled.get();
+    counter = read_counter();
+    counter_cycle = scheduler->event_base_cycle();
+
+    control.value.set(value);
+    if (control.enabled.get() && !was_enabled) {
+        counter = reload_value;
     }
+    schedule_overflow();
+    return value;
 }
 
-int Scheduler::Timer::get_frequency() {
-    switch (control.frequency.get()) {
-        case 0:
-            return 1;
-        case 1:
-            return 64;
-        case 2:
-            return 256;
-        case 3:
-            return 1024;
+void Scheduler::Timer::schedule_overflow() {
+    if (!counts_cycles()) {
+        scheduler->cancel_event(overflow_event);
+        overflow_event = EVENT_NONE;
+        return;
+    }
+
+    Word cycles = (0x10000 - counter) << prescaler_shift();
+    if (scheduler->is_event_scheduled(overflow_event)) {
+        scheduler->reschedule_event(overflow_event, cycles);
+    } else {
+        overflow_event = scheduler->schedule_event(cycles, EVENT_TIMER_OVERFLOW, number);
     }
+}
 
-    return 0;
-}
\ No newline at end of file
+void Scheduler::Timer::overflow() {
+    counter = reload_value;
+    counter_cycle = scheduler->event_base_cycle();
+    overflow_event = EVENT_NONE;
+    schedule_overflow();
+    signal_overflow();
+}
+
+void Scheduler::Timer::signal_overflow() {
+    if (control.overflow_interrupt.get()) {
+        scheduler->cpu->request_interrupt((Interrupt)(INTERRUPT_TIMER_0 + number));
+    }
+    if (next_timer != nullptr && next_timer->control.enabled.get() && next_timer->control.cascade.get()) {
+        next_timer->increment_cascade();
+    }
+}
+
+void Scheduler::Timer::increment_cascade() {
+    counter++;
+    if (counter == 0) {
+        counter = reload_value;
+        signal_overflow();
+    }
+}
@@ -2,9 +2,7 @@
 #define SCHEDULER_INCLUDED
 
 #include <SDL3/SDL.h>
-#include <functional>
-#include <list>
-#include <map>
+#include <vector>
 
 #include "src/cpu/cpu.h"
 #include "src/cpu/cpu_types.h"
@@ -12,50 +10,114 @@
 
 #define CYCLES_PER_SECOND 16777216
 #define CYCLES_PER_MILISECOND 16777
+#define CYCLES_PER_FRAME 280896 // 228 scanlines of 1232 cycles
+
+typedef int EventId;
+#define EVENT_NONE -1
+
+// Events are a type and a payload word, run through the handler set for
+// their type. Nothing is allocated per event once the slots have grown.
+enum EventType {
+    EVENT_HDRAW_END,
+    EVENT_HBLANK_END,
+    EVENT_TIMER_OVERFLOW, // Payload is the timer number
+    EVENT_TYPE_COUNT
+};
+
+#define INITIAL_EVENT_SLOTS 32
 
 typedef struct Scheduler {
     Scheduler(ARM7TDMI * cpu);
 
+    // Events keep their slot, and with it their EventId, until they run or
+    // are cancelled. Slots are reused after that.
     typedef struct ScheduledEvent {
-        Word cycles_till_done;
-        std::function<void()> event;
+        u_int64_t timestamp;
+        u_int64_t order; // Events due on the same cycle run in the order they were scheduled
+        EventType type;
+        Word payload;
+        int heap_index; // -1 once run or cancelled
     } ScheduledEvent;
 
+    typedef void (*EventHandler)(void * context, Word payload);
+
+    typedef struct EventHandlerEntry {
+        EventHandler handler;
+        void * context;
+    } EventHandlerEntry;
+
+    // Timers only keep the counter and the cycle it was last set on, the
+    // current count is worked out when TMxCNT_L is read. A running timer
+    // has one event pending for its overflow.
     typedef struct Timer {
-        Timer(Memory * memory, Timer * timer, Word number);
+        Timer(Scheduler * scheduler, Memory * memory, Timer * timer, Word number);
         struct Control {
             Control(Byte * address);
+            BitRegion value;
             BitRegion frequency;
             BitRegion cascade;
             BitRegion overflow_interrupt;
             BitRegion enabled;
         } control;
 
+        Scheduler * scheduler;
         Timer * next_timer;
-        BitRegion data;
+        Word number;
 
-        int cycles_until_increment;
-        HalfWord reset_value;
+        HalfWord counter;
+        u_int64_t counter_cycle;
+        HalfWord reload_value;
+        EventId overflow_event;
 
-        void increment_data();
-        void pass_cycles(Word cycles);
-        int get_frequency();
+        bool counts_cycles();
+        int prescaler_shift();
+        HalfWord read_counter();
+        HalfWord write_control(HalfWord value);
+        void schedule_overflow();
+        void overflow();
+        void signal_overflow();
+        void increment_cascade();
     } Timer;
 
     Timer timers[4];
 
     ARM7TDMI * cpu;
-    Word total_passed_milliseconds;
-    u_int64_t total_passed_nanoseconds;
 
-    Word passed_milliseconds;
-    Word passed_nanoseconds;
+    u_int64_t idle_skipped_cycles = 0;
+    u_int64_t halted_cycles = 0;
+
+    // Cycles since power on. Events are due at an absolute cycle, relative
+    // times count from event_base_cycle.
+    u_int64_t current_cycle = 0;
+    u_int64_t run_target_cycle = 0; // Where the last run_cycles stopped, before any overshoot
+    bool running_event = false;
+    u_int64_t running_event_cycle = 0;
+    u_int64_t event_base_cycle();
+
+    EventHandlerEntry event_handlers[EVENT_TYPE_COUNT] = {};
+    std::vector<ScheduledEvent> event_slots;
+    std::vector<EventId> free_event_slots;
+    std::vector<EventId> event_heap; // Binary min heap of slots by due cycle
+    u_int64_t next_event_order = 0;
+
+    void set_event_handler(EventType type, EventHandler handler, void * context);
+    EventId schedule_event(Word cycles, EventType type, Word payload = 0);
+    void reschedule_event(EventId id, Word cycles);
+    void cancel_event(EventId id);
+    bool is_event_scheduled(EventId id);
+
+    bool event_due_before(EventId first, EventId second);
+    void swap_heap_entries(int first, int second);
+    void sift_up(int heap_index);
+    void sift_down(int heap_index);
+    void remove_heap_entry(int heap_index);
 
-    std::list<ScheduledEvent> events;
+    int run_due_events();
 
-    void schedule_event(Word cycles, std::function<void()> event);
-    void move_events_forward(Word cycles);
-    void tick();  
+    // Emulated time only, the same calls always run the same way. Pacing
+    // against the wall clock is left to the frontend.
+    int run_cycles(u_int64_t cycles);
+    int run_frame();
 } Scheduler;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+#include "src/cpu/alu.h"
+#include "tests/reference_alu.h"
+
+#define RANDOM_OPERAND_PAIRS 1000000
+#define RANDOM_SHIFTED_NUMBERS 20000
+
+static int failures = 0;
+
+static void expect(bool passed, const char * kernel, Word op1, Word op2, bool carry_in)
+{
+    if (passed) {return;}
+    if (failures < 20) {
+        printf("alu_test: %s(0x%08x, 0x%08x, carry %d) differs from the reference\n", kernel, op1, op2, carry_in);
+    }
+    failures++;
+}
+
+static bool same(AluResult result, Word value, bool carry, bool overflow)
+{
+    return result.value == value && result.carry == carry && result.overflow == overflow;
+}
+
+static bool same(ShiftResult result, Word value, bool carry)
+{
+    return result.value == value && result.carry == carry;
+}
+
+static void check_arithmetic(Word a, Word b, bool c)
+{
+    ReferenceALU reference;
+    Word value;
+
+    value = reference.add(2, a, b);
+    expect(same(CpuALU::add(a, b), value, reference.carry_flag, ReferenceALU::overflow(a, b, value, false)), "add", a, b, c);
+
+    value = reference.add(3, a, b, (Word)c);
+    expect(same(CpuALU::add_with_carry(a, b, c), value, reference.carry_flag, ReferenceALU::overflow(a, b, value, false)), "add_with_carry", a, b, c);
+
+    value = reference.subtract(1, a, b);
+    expect(same(CpuALU::subtract(a, b), value, reference.carry_flag, ReferenceALU::overflow(a, b, value, true)), "subtract", a, b, c);
+
+    value = reference.subtract(2, a, b, (Word)!c);
+    expect(same(CpuALU::subtract_with_carry(a, b, c), value, reference.carry_flag, ReferenceALU::overflow(a, b, value, true)), "subtract_with_carry", a, b, c);
+
+    value = reference.subtract(1, b, a);
+    expect(same(CpuALU::reverse_subtract(a, b), value, reference.carry_flag, ReferenceALU::overflow(b, a, value, true)), "reverse_subtract", a, b, c);
+
+    value = reference.subtract(2, b, a, (Word)!c);
+    expect(same(CpuALU::reverse_subtract_with_carry(a, b, c), value, reference.carry_flag, ReferenceALU::overflow(b, a, value, true)), "reverse_subtract_with_carry", a, b, c);
+}
+
+// The reference only covers amounts from 1, a shift of 0 passes the value
+// and carry through.
+static void check_shifts(Word number, bool c)
+{
+    ReferenceALU reference;
+    Word value;
+
+    for (Word amount = 1; amount <= 64; amount++) {
+        value = reference.logical_left_shift(number, amount);
+        expect(same(CpuALU::logical_left_shift(number, amount, c), value, reference.carry_flag), "logical_left_shift", number, amount, c);
+
+        value = reference.logical_right_shift(number, amount);
+        expect(same(CpuALU::logical_right_shift(number, amount, c), value, reference.carry_flag), "logical_right_shift", number, amount, c);
+
+        value = reference.arithmetic_right_shift(number, amount);
+        expect(same(CpuALU::arithmetic_right_shift(number, amount, c), value, reference.carry_flag), "arithmetic_right_shift", number, amount, c);
+
+        value = reference.rotate_right(number, amount);
+        expect(same(CpuALU::rotate_right(number, amount, c), value, reference.carry_flag), "rotate_right", number, amount, c);
+    }
+
+    expect(same(CpuALU::logical_left_shift(number, 0, c), number, c), "logical_left_shift", number, 0, c);
+    expect(same(CpuALU::logical_right_shift(number, 0, c), number, c), "logical_right_shift", number, 0, c);
+    expect(same(CpuALU::arithmetic_right_shift(number, 0, c), number, c), "arithmetic_right_shift", number, 0, c);
+    expect(same(CpuALU::rotate_right(number, 0, c), number, c), "rotate_right", number, 0, c);
+
+    value = reference.rotate_right_extended(number, c);
+    expect(same(CpuALU::rotate_right_extended(number, c), value, reference.carry_flag), "rotate_right_extended", number, 0, c);
+}
+
+int main()
+{
+    std::vector<Word> edges = {
+        0x00000000, 0x00000001, 0x00000002, 0x7FFFFFFE, 0x7FFFFFFF,
+        0x80000000, 0x80000001, 0xFFFFFFFE, 0xFFFFFFFF, 0x0000FFFF,
+        0xFFFF0000, 0x55555555, 0xAAAAAAAA,
+    };
+    std::mt19937 random(1);
+
+    for (bool c : {false, true}) {
+        for (Word a : edges) {
+            for (Word b : edges) {
+                check_arithmetic(a, b, c);
+            }
+            check_shifts(a, c);
+        }
+    }
+
+    for (int i = 0; i < RANDOM_OPERAND_PAIRS; i++) {
+        Word a = random();
+        Word b = random();
+        check_arithmetic(a, b, random() & 1);
+        check_arithmetic(a, edges[random() % edges.size()], random() & 1);
+    }
+
+    for (int i = 0; i < RANDOM_SHIFTED_NUMBERS; i++) {
+        check_shifts(random(), random() & 1);
+    }
+
+    printf("alu_test: %d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include <random>
+
+#include "src/compositor.h"
+
+#define RANDOM_LINES 20000
+#define MAX_WIDTH 300
+
+static int failures = 0;
+
+static void expect_same(const Word * expected, const Word * output, int width, const char * path)
+{
+    if (memcmp(expected, output, width * sizeof(Word)) == 0) {return;}
+    if (failures < 20) {
+        for (int x = 0; x < width; x++) {
+            if (expected[x] != output[x]) {
+                printf("compositor_test: %s differs from the scalar path at x %d of %d\n", path, x, width);
+                break;
+            }
+        }
+    }
+    failures++;
+}
+
+int main()
+{
+    static HalfWord layers[COMPOSITOR_LAYERS][MAX_WIDTH];
+    static Byte priorities[COMPOSITOR_LAYERS][MAX_WIDTH];
+    static HalfWord backdrop[MAX_WIDTH];
+    static Byte layer_masks[MAX_WIDTH];
+    static Word expected[MAX_WIDTH];
+    static Word output[MAX_WIDTH];
+    std::mt19937 random(1);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+#else
+    bool has_avx2 = false;
+#endif
+
+    for (int i = 0; i < RANDOM_LINES; i++) {
+        // Every width up to a few vectors, then random ones, so the tail
+        // after the last full vector gets every length.
+        int width = i < 64 ? i : random() % (MAX_WIDTH + 1);
+
+        for (int layer = 0; layer < COMPOSITOR_LAYERS; layer++) {
+            for (int x = 0; x < width; x++) {
+                layers[layer][x] = random() % 4 == 0 ? COMPOSITOR_TRANSPARENT : random() & 0x7FFF;
+                priorities[layer][x] = random() % 4;
+            }
+        }
+        for (int x = 0; x < width; x++) {
+            backdrop[x] = random() & 0x7FFF;
+            layer_masks[x] = random() & 0x3F;
+        }
+
+        CompositorLine line = {
+            {layers[0], layers[1], layers[2], layers[3], layers[4]},
+            {priorities[0], priorities[1], priorities[2], priorities[3], priorities[4]},
+            {0x10, 0x01, 0x02, 0x04, 0x08},
+            backdrop,
+            layer_masks,
+            width,
+        };
+        Compositor::composite_line_scalar(line, expected, 0);
+
+        int x = Compositor::composite_line_sse2(line, output);
+        Compositor::composite_line_scalar(line, output, x);
+        expect_same(expected, output, width, "composite_line_sse2");
+
+        if (has_avx2) {
+            x = Compositor::composite_line_avx2(line, output);
+            Compositor::composite_line_scalar(line, output, x);
+            expect_same(expected, output, width, "composite_line_avx2");
+        }
+
+        Compositor::composite_line(line, output);
+        expect_same(expected, output, width, "composite_line");
+    }
+
+    printf("compositor_test: %d failures%s\n", failures, has_avx2 ? "" : " (no AVX2, only SSE2 checked)");
+    return failures == 0 ? 0 : 1;
+}
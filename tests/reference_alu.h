@@ -0,0 +1,123 @@
+#ifndef REFERENCE_ALU_INCLUDED
+#define REFERENCE_ALU_INCLUDED
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "src/cpu/cpu_types.h"
+#include "src/utils.h"
+
+// The varargs CpuALU the fixed arity kernels replaced, kept for the tests
+// to check them against. The carry is left in carry_flag by every call.
+typedef struct ReferenceALU {
+    bool carry_flag;
+
+    Word add(int total_addends, ...)
+    {
+        u_int64_t result = 0;
+        va_list addends;
+
+        va_start(addends, total_addends);
+        for (int i = 0; i < total_addends; i++)
+        {
+            Word arg = va_arg(addends, Word);
+            result += arg;
+        }
+        va_end(addends);
+
+        carry_flag = result > UINT_MAX;
+        return result & UINT_MAX;
+    }
+
+    Word subtract(int total_subtrahends, Word base, ...)
+    {
+        u_int64_t result = base;
+        va_list subtrahends;
+
+        va_start(subtrahends, base);
+        for (int i = 0; i < total_subtrahends; i++)
+        {
+            Word arg = va_arg(subtrahends, Word);
+            result -= arg;
+        }
+        va_end(subtrahends);
+
+        carry_flag = result <= UINT_MAX;
+        return result & UINT_MAX;
+    }
+
+    Word logical_left_shift(Word number, unsigned int shift_amount)
+    {
+        if (shift_amount < 32) {
+            carry_flag = Utils::read_bit(number, (31 - shift_amount) + 1);
+        } else if (shift_amount == 32) {
+            carry_flag = Utils::read_bit(number, 0);
+            return 0;
+        } else if (shift_amount > 32) {
+            carry_flag = 0;
+            return 0;
+        }
+
+        return (number << shift_amount) & UINT32_MAX;
+    }
+
+    Word logical_right_shift(Word number, unsigned int shift_amount)
+    {
+        if (shift_amount == 32) {
+            carry_flag = Utils::read_bit(number, 31);
+            return 0;
+        } else if (shift_amount > 32) {
+            carry_flag = 0;
+            return 0;
+        }
+
+        carry_flag = Utils::read_bit(number, shift_amount - 1);
+        return number >> shift_amount;
+    }
+
+    int32_t arithmetic_right_shift(int32_t number, unsigned int shift_amount)
+    {
+        if (shift_amount >= 32) {
+            bool bit_31 = Utils::read_bit(number, 31);
+            carry_flag = bit_31;
+            return bit_31 ? UINT32_MAX : 0;
+        }
+
+        carry_flag = Utils::read_bit(number, shift_amount - 1);
+        return (number >> shift_amount) & UINT32_MAX;
+    }
+
+    Word rotate_right(Word number, unsigned int rotate_amount)
+    {
+        while (rotate_amount > 32)
+        {
+            rotate_amount -= 32;
+        }
+
+        if (rotate_amount == 32) {
+            carry_flag = Utils::read_bit(number, 31);
+            return number;
+        }
+
+        carry_flag = Utils::read_bit(number, rotate_amount - 1);
+        return (number >> rotate_amount) | (number << (32 - rotate_amount));
+    }
+
+    Word rotate_right_extended(Word number, bool cpsr_c)
+    {
+        carry_flag = Utils::read_bit(number, 0);
+        return (number >> 1) | (cpsr_c << 31);
+    }
+
+    // What OpcodeDataProcess::get_overflow_flag worked out, op1 and op2 in
+    // the order they are added or subtracted.
+    static bool overflow(Word op1, Word op2, Word result, bool subtraction)
+    {
+        if (subtraction) {op2 = (UINT32_MAX - op2);}
+
+        return ((op1^result)&(op2^result)&(1 << 31)) != 0;
+    }
+} ReferenceALU;
+
+#endif